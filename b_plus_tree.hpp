@@ -0,0 +1,1028 @@
+#ifndef B_PLUS_TREE_HPP
+#define B_PLUS_TREE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "node_pool.hpp"
+#include "traversal.hpp"
+
+/**
+ * \brief Ordered map, balanced as a B+tree
+ *
+ * Each node holds many sorted keys in about \p NodeBytes bytes, so a lookup
+ * touches a few contiguous cache lines per level instead of one node per
+ * comparison as in RedBlackTree. The items are only stored in the leaves,
+ * which are chained in key order: iterating and scanning ranges walk
+ * the chain without going back up the tree.
+ *
+ * Same interface as RedBlackTree, nodes are allocated from NodePools
+ * getting their blocks from \p Allocator.
+ * \note Inserting and erasing move the items within and across leaves,
+ *       which invalidates the iterators to the leaves involved.
+ */
+template<class Key, class Value, class Comparator = std::less<Key>,
+         class Allocator = std::allocator<std::pair<const Key, Value>>,
+         std::size_t NodeBytes = 256>
+class BPlusTree {
+private:
+    struct Leaf;
+
+public:
+    typedef Key                 key_type;
+    typedef Value               value_type;
+    typedef Allocator           allocator_type;
+    typedef NodePool<Allocator> pool_type;
+
+    /// Maximum number of items in a leaf
+    static const std::size_t leaf_capacity =
+        NodeBytes / (sizeof(Key) + sizeof(Value)) < 4 ? 4 : NodeBytes / (sizeof(Key) + sizeof(Value));
+    /// Maximum number of keys in an inner node, which has one more child
+    static const std::size_t inner_capacity =
+        NodeBytes / (sizeof(Key) + sizeof(void*)) < 4 ? 4 : NodeBytes / (sizeof(Key) + sizeof(void*));
+
+    static_assert(leaf_capacity < 0xFFFF && inner_capacity < 0xFFFF, "NodeBytes is too large");
+
+    template<bool Const>
+    class iterator_base {
+    public:
+        typedef typename std::conditional<Const, const Value&, Value&>::type reference_type;
+        typedef typename std::remove_reference<reference_type>::type* pointer_type;
+        typedef typename std::conditional<Const, const BPlusTree*, BPlusTree*>::type tree_pointer;
+        typedef typename std::conditional<Const, const Leaf*, Leaf*>::type leaf_pointer;
+
+        iterator_base() : tree(nullptr), leaf(nullptr), index(0) {}
+
+        /**
+         * \brief Conversion from iterator to const_iterator
+         */
+        operator iterator_base<true>() const {
+            return iterator_base<true>(tree, leaf, index);
+        }
+
+        iterator_base& operator++() {
+            if (leaf && ++index == leaf->count) {
+                leaf = leaf->next;
+                index = 0;
+            }
+            return *this;
+        }
+
+        iterator_base& operator--() {
+            if (leaf && index > 0) {
+                index--;
+            } else if (leaf) {
+                leaf = leaf->previous;
+                index = leaf ? leaf->count - 1 : 0;
+            } else if (tree->last_) {
+                leaf = tree->last_;
+                index = leaf->count - 1;
+            }
+            return *this;
+        }
+
+        iterator_base operator++ (int) {
+            iterator_base copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        iterator_base operator-- (int) {
+            iterator_base copy = *this;
+            --*this;
+            return copy;
+        }
+
+        reference_type operator* () const {
+            return leaf->value(index);
+        }
+
+        pointer_type operator-> () const {
+            return &leaf->value(index);
+        }
+
+        /**
+         * \brief Key of the element
+         */
+        const Key& key() const {
+            return leaf->key(index);
+        }
+
+        bool operator== (const iterator_base& other) const {
+            return leaf == other.leaf && index == other.index;
+        }
+
+        bool operator!= (const iterator_base& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        iterator_base(tree_pointer tree, leaf_pointer leaf, std::size_t index)
+            : tree(tree), leaf(leaf), index(index) {}
+
+        tree_pointer tree;
+        leaf_pointer leaf;
+        std::size_t  index;
+
+        friend class BPlusTree;
+        template<bool> friend class iterator_base;
+    };
+    typedef iterator_base<false>    iterator;
+    typedef iterator_base<true>     const_iterator;
+
+    explicit BPlusTree(const Allocator& allocator = Allocator())
+        : leaf_pool_(sizeof(Leaf), alignof(Leaf), allocator),
+          inner_pool_(sizeof(Inner), alignof(Inner), allocator) {}
+
+    BPlusTree(BPlusTree&& other) : BPlusTree(other.get_allocator()) {
+        swap(other);
+    }
+
+    /**
+     * \brief Copies the nodes into new pools
+     * \complexity O(n)
+     */
+    BPlusTree(const BPlusTree& other) : BPlusTree(other.get_allocator()) {
+        if (other.root_) {
+            Leaf* previous = nullptr;
+            root_ = copy_node(other.root_, previous);
+            last_ = previous;
+            size_ = other.size_;
+        }
+    }
+
+    BPlusTree& operator= (BPlusTree other) {
+        swap(other);
+        return *this;
+    }
+
+    /**
+     * \complexity O(blocks) if the keys and values are trivially destructible, O(n) otherwise
+     */
+    ~BPlusTree() {
+        destroy_nodes();
+    }
+
+    void swap(BPlusTree& other) {
+        std::swap(root_, other.root_);
+        std::swap(first_, other.first_);
+        std::swap(last_, other.last_);
+        std::swap(size_, other.size_);
+        leaf_pool_.swap(other.leaf_pool_);
+        inner_pool_.swap(other.inner_pool_);
+    }
+
+    /**
+     * \brief Removes all the nodes and gives the pool blocks back to the allocator
+     * \complexity O(blocks) if the keys and values are trivially destructible, O(n) otherwise
+     */
+    void clear() {
+        destroy_nodes();
+        leaf_pool_.clear();
+        inner_pool_.clear();
+        root_ = nullptr;
+        first_ = last_ = nullptr;
+        size_ = 0;
+    }
+
+    /**
+     * \brief Insert new element (assign if already present)
+     * \complexity O(log n)
+     */
+    iterator insert(const Key& key, const Value& value) {
+        return insert_item(key, value, true);
+    }
+
+    /**
+     * \brief Remove an element
+     * \return Iterator to the element following the removed one
+     * \complexity O(log n)
+     */
+    iterator erase(iterator it) {
+        if (it == end() || it.tree != this)
+            return end();
+        return erase_key(it.leaf->key(it.index));
+    }
+
+    /**
+     * \brief Remove the element with the given key
+     * \return Iterator to the element following the removed one
+     * \complexity O(log n)
+     */
+    iterator erase(const Key& search) {
+        return erase_key(search);
+    }
+
+    /**
+     * \brief Get reference to given value (inserted with default-constructed value if not present)
+     * \complexity O(log n)
+     */
+    value_type& operator[] (const Key& key) {
+        return *insert_item(key, Value(), false);
+    }
+
+    /**
+     * \brief Print the tree structure to stdout, one node per line
+     * \complexity O(n)
+     */
+    void print_structure() const {
+        if (root_)
+            print_structure_recursive(root_, 0);
+        else
+            std::cout << "NULL\n";
+    }
+
+    /**
+     * \brief Get iterator to the first element
+     * \complexity O(1)
+     */
+    iterator begin() {
+        return iterator(this, first_, 0);
+    }
+    /**
+     * \brief Get iterator to past-the-last element
+     * \complexity O(1)
+     */
+    iterator end() {
+        return iterator(this, nullptr, 0);
+    }
+
+    /**
+     * \brief Get iterator to the first element
+     * \complexity O(1)
+     */
+    const_iterator begin() const {
+        return const_iterator(this, first_, 0);
+    }
+    /**
+     * \brief Get iterator to past-the-last element
+     * \complexity O(1)
+     */
+    const_iterator end() const {
+        return const_iterator(this, nullptr, 0);
+    }
+
+    /**
+     * \brief Get iterator to the first element
+     * \complexity O(1)
+     */
+    const_iterator cbegin() const {
+        return begin();
+    }
+    /**
+     * \brief Get iterator to past-the-last element
+     * \complexity O(1)
+     */
+    const_iterator cend() const {
+        return end();
+    }
+
+    /**
+     * \brief Get iterator to the given key
+     * \complexity O(log n)
+     */
+    iterator find(const Key& search) {
+        Leaf* leaf = find_leaf(search);
+        std::size_t index = leaf ? lower_index(leaf, search) : 0;
+        if (!leaf || index == leaf->count || less(search, leaf->key(index)))
+            return end();
+        return iterator(this, leaf, index);
+    }
+
+    /**
+     * \brief Get iterator to the given key
+     * \complexity O(log n)
+     */
+    const_iterator find(const Key& search) const {
+        return const_cast<BPlusTree*>(this)->find(search);
+    }
+
+    /**
+     * \brief Get iterator to the first element whose key isn't less than \p search
+     * \complexity O(log n)
+     */
+    iterator lower_bound(const Key& search) {
+        Leaf* leaf = find_leaf(search);
+        return leaf ? normalized(leaf, lower_index(leaf, search)) : end();
+    }
+
+    /**
+     * \brief Get iterator to the first element whose key isn't less than \p search
+     * \complexity O(log n)
+     */
+    const_iterator lower_bound(const Key& search) const {
+        return const_cast<BPlusTree*>(this)->lower_bound(search);
+    }
+
+    /**
+     * \brief Get iterator to the first element whose key is greater than \p search
+     * \complexity O(log n)
+     */
+    iterator upper_bound(const Key& search) {
+        Leaf* leaf = find_leaf(search);
+        return leaf ? normalized(leaf, upper_index(leaf, search)) : end();
+    }
+
+    /**
+     * \brief Get iterator to the first element whose key is greater than \p search
+     * \complexity O(log n)
+     */
+    const_iterator upper_bound(const Key& search) const {
+        return const_cast<BPlusTree*>(this)->upper_bound(search);
+    }
+
+    /**
+     * \brief Range of the elements with the given key (at most one)
+     * \complexity O(log n)
+     */
+    std::pair<iterator, iterator> equal_range(const Key& search) {
+        iterator first = lower_bound(search);
+        iterator last = first;
+        if (last != end() && !less(search, last.key()))
+            ++last;
+        return std::make_pair(first, last);
+    }
+
+    /**
+     * \brief Range of the elements with the given key (at most one)
+     * \complexity O(log n)
+     */
+    std::pair<const_iterator, const_iterator> equal_range(const Key& search) const {
+        return const_cast<BPlusTree*>(this)->equal_range(search);
+    }
+
+    /**
+     * \brief Number of elements in the tree
+     * \complexity O(1)
+     */
+    int size() const {
+        return size_;
+    }
+
+    /**
+     * \brief Whether the tree is empty
+     */
+    bool empty() const {
+        return !root_;
+    }
+
+    /**
+     * \brief Number of levels, 0 for an empty tree
+     * \complexity O(log n)
+     */
+    int height() const {
+        int height = 0;
+        for (const Node* node = root_; node; height++)
+            node = node->leaf ? nullptr : static_cast<const Inner*>(node)->children[0];
+        return height;
+    }
+
+    allocator_type get_allocator() const {
+        return allocator_type(leaf_pool_.get_allocator());
+    }
+
+    /**
+     * \brief Number of nodes taken from the pools, in use or free for reuse
+     * \complexity O(1)
+     */
+    std::size_t node_count() const {
+        return leaf_pool_.node_count() + inner_pool_.node_count();
+    }
+
+    /**
+     * \brief Number of bytes reserved by the pool blocks
+     * \complexity O(1)
+     */
+    std::size_t bytes_reserved() const {
+        return leaf_pool_.bytes_reserved() + inner_pool_.bytes_reserved();
+    }
+
+    /**
+     * \brief Calls \p func(key, value) on each element
+     *
+     * \p Policy is one of the policies in namespace traversal: the inner
+     * nodes only hold copies of the keys, so pre-order and post-order
+     * visit the elements in the same order as in-order, walking the
+     * leaf chain in the policy Direction.
+     * \complexity O(n)
+     */
+    template<class Policy, class Func>
+        void traverse(const Func& func)
+        {
+            traverse_leaves(func, static_cast<Policy*>(nullptr));
+        }
+
+    /**
+     * \brief Calls \p func(key, value) in key order on the elements
+     * whose key is in [\p low, \p high)
+     * \complexity O(log n + k) for k elements in the range
+     */
+    template<class Func>
+        void traverse_range(const Key& low, const Key& high, const Func& func)
+        {
+            Leaf* leaf = find_leaf(low);
+            if (!leaf)
+                return;
+            for (std::size_t index = lower_index(leaf, low); leaf; leaf = leaf->next, index = 0)
+                for (; index < leaf->count; index++) {
+                    if (!less(leaf->key(index), high))
+                        return;
+                    func(leaf->key(index), leaf->value(index));
+                }
+        }
+
+private:
+    typedef typename std::aligned_storage<sizeof(Key), alignof(Key)>::type key_storage;
+    typedef typename std::aligned_storage<sizeof(Value), alignof(Value)>::type value_storage;
+
+    /**
+     * \brief Node header, \c count is the number of keys
+     */
+    struct Node {
+        explicit Node(bool leaf) : leaf(leaf), count(0) {}
+
+        bool          leaf;
+        std::uint16_t count;
+    };
+
+    /**
+     * \brief Node holding the items
+     *
+     * The arrays have a spare slot for the item which overflows the leaf
+     * before it is split. Only the first \c count slots hold objects.
+     */
+    struct Leaf : Node {
+        Leaf() : Node(true) {}
+
+        Key& key(std::size_t index) { return reinterpret_cast<Key*>(keys)[index]; }
+        const Key& key(std::size_t index) const { return reinterpret_cast<const Key*>(keys)[index]; }
+        Value& value(std::size_t index) { return reinterpret_cast<Value*>(values)[index]; }
+        const Value& value(std::size_t index) const { return reinterpret_cast<const Value*>(values)[index]; }
+
+        Leaf* previous = nullptr;
+        Leaf* next = nullptr;
+        key_storage   keys[leaf_capacity + 1];
+        value_storage values[leaf_capacity + 1];
+    };
+
+    /**
+     * \brief Node routing the searches, children[i] holds the keys in
+     * [key(i-1), key(i)), the keys are copies of keys in the leaves
+     *
+     * Like Leaf, the arrays have a spare slot for overflows.
+     */
+    struct Inner : Node {
+        Inner() : Node(false) {}
+
+        Key& key(std::size_t index) { return reinterpret_cast<Key*>(keys)[index]; }
+        const Key& key(std::size_t index) const { return reinterpret_cast<const Key*>(keys)[index]; }
+
+        key_storage keys[inner_capacity + 1];
+        Node*       children[inner_capacity + 2];
+    };
+
+    /**
+     * \brief Inner node visited by a descent and the index of the child taken
+     */
+    struct PathEntry {
+        Inner*      node;
+        std::size_t child;
+    };
+
+    /// Nodes other than the root and the ones left by append splits have at least this many keys
+    static const std::size_t leaf_minimum = leaf_capacity / 2;
+    static const std::size_t inner_minimum = inner_capacity / 2;
+    /// Bound on the height, as each level multiplies the size by at least 3
+    static const std::size_t max_height = 48;
+
+    static bool less(const Key& a, const Key& b) {
+        return Comparator()(a, b);
+    }
+
+    /**
+     * \brief Number of keys of \p node less than \p key
+     * \complexity O(log capacity)
+     */
+    template<class NodeType>
+        static std::size_t lower_index(const NodeType* node, const Key& key) {
+            std::size_t low = 0, high = node->count;
+            while (low < high) {
+                std::size_t middle = (low + high) / 2;
+                if (less(node->key(middle), key))
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+            return low;
+        }
+
+    /**
+     * \brief Number of keys of \p node not greater than \p key
+     * \complexity O(log capacity)
+     */
+    template<class NodeType>
+        static std::size_t upper_index(const NodeType* node, const Key& key) {
+            std::size_t low = 0, high = node->count;
+            while (low < high) {
+                std::size_t middle = (low + high) / 2;
+                if (less(key, node->key(middle)))
+                    high = middle;
+                else
+                    low = middle + 1;
+            }
+            return low;
+        }
+
+    /**
+     * \brief Inserts \p item at \p index among the \p count objects in \p array
+     */
+    template<class T, class U>
+        static void insert_at(T* array, std::size_t count, std::size_t index, U&& item) {
+            if (index == count) {
+                ::new (array + count) T(std::forward<U>(item));
+                return;
+            }
+            ::new (array + count) T(std::move(array[count - 1]));
+            std::move_backward(array + index, array + count - 1, array + count);
+            array[index] = std::forward<U>(item);
+        }
+
+    /**
+     * \brief Removes the object at \p index among the \p count objects in \p array
+     */
+    template<class T>
+        static void erase_at(T* array, std::size_t count, std::size_t index) {
+            std::move(array + index + 1, array + count, array + index);
+            array[count - 1].~T();
+        }
+
+    /**
+     * \brief Moves \p count objects to the uninitialized \p output
+     */
+    template<class T>
+        static void relocate(T* input, std::size_t count, T* output) {
+            for (std::size_t i = 0; i < count; i++) {
+                ::new (output + i) T(std::move(input[i]));
+                input[i].~T();
+            }
+        }
+
+    /**
+     * \brief Slot arrays of a node, including the unconstructed slots
+     */
+    static Key* keys_of(Leaf* leaf) { return reinterpret_cast<Key*>(leaf->keys); }
+    static Key* keys_of(Inner* inner) { return reinterpret_cast<Key*>(inner->keys); }
+    static Value* values_of(Leaf* leaf) { return reinterpret_cast<Value*>(leaf->values); }
+
+    /**
+     * \brief Iterator to \p index in \p leaf, moving to the next leaf past its end
+     */
+    iterator normalized(Leaf* leaf, std::size_t index) {
+        if (index == leaf->count) {
+            leaf = leaf->next;
+            index = 0;
+        }
+        return iterator(this, leaf, index);
+    }
+
+    /**
+     * \brief Leaf which would hold \p key, null if the tree is empty
+     * \complexity O(log n)
+     */
+    Leaf* find_leaf(const Key& key) const {
+        Node* node = root_;
+        if (!node)
+            return nullptr;
+        while (!node->leaf) {
+            const Inner* inner = static_cast<const Inner*>(node);
+            node = inner->children[upper_index(inner, key)];
+        }
+        return static_cast<Leaf*>(node);
+    }
+
+    /**
+     * \brief Leaf which would hold \p key, recording the inner nodes on the way
+     * \return The leaf and the number of entries written to \p path
+     * \pre The tree isn't empty
+     */
+    Leaf* descend(const Key& key, PathEntry* path, std::size_t& depth) {
+        Node* node = root_;
+        depth = 0;
+        while (!node->leaf) {
+            Inner* inner = static_cast<Inner*>(node);
+            std::size_t child = upper_index(inner, key);
+            path[depth++] = PathEntry{inner, child};
+            node = inner->children[child];
+        }
+        return static_cast<Leaf*>(node);
+    }
+
+    /**
+     * \brief Insert new element (assign if already present and \p assign)
+     * \return Iterator to the element with the given key
+     * \complexity O(log n)
+     */
+    template<class V>
+        iterator insert_item(const Key& key, V&& value, bool assign) {
+            if (!root_)
+                root_ = first_ = last_ = leaf_pool_.template create<Leaf>();
+
+            PathEntry path[max_height];
+            std::size_t depth;
+            Leaf* leaf = descend(key, path, depth);
+            std::size_t index = lower_index(leaf, key);
+            if (index < leaf->count && !less(key, leaf->key(index))) {
+                if (assign)
+                    leaf->value(index) = std::forward<V>(value);
+                return iterator(this, leaf, index);
+            }
+
+            insert_at(keys_of(leaf), leaf->count, index, key);
+            insert_at(values_of(leaf), leaf->count, index, std::forward<V>(value));
+            leaf->count++;
+            size_++;
+            if (leaf->count <= leaf_capacity)
+                return iterator(this, leaf, index);
+
+            // Appends in key order leave the nodes full, instead of half full
+            bool append = index + 1 == leaf->count && !leaf->next;
+            for (std::size_t i = 0; i < depth && append; i++)
+                append = path[i].child == path[i].node->count;
+
+            Leaf* right = split_leaf(leaf, append);
+            insert_in_parent(path, depth, Key(right->key(0)), right, append);
+            if (index >= leaf->count)
+                return iterator(this, right, index - leaf->count);
+            return iterator(this, leaf, index);
+        }
+
+    /**
+     * \brief Moves the upper half of an overflowing leaf to a new leaf after it
+     * \param append Whether to only move the last item
+     * \return The new leaf
+     */
+    Leaf* split_leaf(Leaf* leaf, bool append) {
+        Leaf* right = leaf_pool_.template create<Leaf>();
+        std::size_t keep = append ? leaf->count - 1 : leaf->count / 2;
+        right->count = leaf->count - keep;
+        relocate(keys_of(leaf) + keep, right->count, keys_of(right));
+        relocate(values_of(leaf) + keep, right->count, values_of(right));
+        leaf->count = keep;
+
+        right->previous = leaf;
+        right->next = leaf->next;
+        if (leaf->next)
+            leaf->next->previous = right;
+        else
+            last_ = right;
+        leaf->next = right;
+        return right;
+    }
+
+    /**
+     * \brief Adds \p right after the node at the end of \p path, with
+     * \p separator as lowest key, splitting the inner nodes which overflow
+     * \param append Whether \p path is the rightmost one, in that case each
+     *        split only moves the last key and the last two children
+     */
+    void insert_in_parent(PathEntry* path, std::size_t depth, Key separator, Node* right, bool append) {
+        while (depth > 0) {
+            PathEntry entry = path[--depth];
+            Inner* inner = entry.node;
+            insert_at(keys_of(inner), inner->count, entry.child, std::move(separator));
+            insert_at(inner->children, inner->count + 1, entry.child + 1, right);
+            inner->count++;
+            if (inner->count <= inner_capacity)
+                return;
+
+            // The middle key moves up, the keys after it go to the new node
+            Inner* sibling = inner_pool_.template create<Inner>();
+            std::size_t middle = append ? inner->count - 2 : inner->count / 2;
+            separator = std::move(inner->key(middle));
+            inner->key(middle).~Key();
+            sibling->count = inner->count - middle - 1;
+            relocate(keys_of(inner) + middle + 1, sibling->count, keys_of(sibling));
+            std::copy(inner->children + middle + 1, inner->children + inner->count + 1, sibling->children);
+            inner->count = middle;
+            right = sibling;
+        }
+
+        Inner* root = inner_pool_.template create<Inner>();
+        ::new (keys_of(root)) Key(std::move(separator));
+        root->children[0] = root_;
+        root->children[1] = right;
+        root->count = 1;
+        root_ = root;
+    }
+
+    /**
+     * \brief Removes the element with the given key, merging or refilling
+     * the nodes left under their minimum
+     * \return Iterator to the element following the removed one
+     * \complexity O(log n)
+     */
+    iterator erase_key(const Key& key) {
+        if (!root_)
+            return end();
+
+        PathEntry path[max_height];
+        std::size_t depth;
+        Leaf* leaf = descend(key, path, depth);
+        std::size_t index = lower_index(leaf, key);
+        if (index == leaf->count || less(key, leaf->key(index)))
+            return end();
+
+        erase_at(keys_of(leaf), leaf->count, index);
+        erase_at(values_of(leaf), leaf->count, index);
+        leaf->count--;
+        size_--;
+
+        if (depth == 0) {
+            if (leaf->count == 0) {
+                leaf_pool_.destroy(leaf);
+                root_ = first_ = last_ = nullptr;
+                return end();
+            }
+            return normalized(leaf, index);
+        }
+
+        if (leaf->count >= leaf_minimum)
+            return normalized(leaf, index);
+
+        // The element following the erased one, tracked as the items move
+        Leaf* next_leaf = leaf;
+        std::size_t next_index = index;
+        if (!rebalance_leaf(path[depth - 1], leaf, next_leaf, next_index))
+            return normalized(next_leaf, next_index);
+
+        for (depth--; depth > 0; depth--) {
+            Inner* inner = path[depth].node;
+            if (inner->count >= inner_minimum || !rebalance_inner(path[depth - 1], inner))
+                break;
+        }
+
+        if (!root_->leaf && root_->count == 0) {
+            Inner* root = static_cast<Inner*>(root_);
+            root_ = root->children[0];
+            inner_pool_.destroy(root);
+        }
+        return normalized(next_leaf, next_index);
+    }
+
+    /**
+     * \brief Refills \p leaf from a sibling or merges it with one
+     * \param parent Parent of \p leaf and its index there
+     * \param next_leaf, next_index Position of an element in \p leaf, updated as it moves
+     * \return Whether a child has been removed from the parent
+     */
+    bool rebalance_leaf(const PathEntry& parent, Leaf* leaf, Leaf*& next_leaf, std::size_t& next_index) {
+        Inner* inner = parent.node;
+        std::size_t child = parent.child;
+        Leaf* left = child > 0 ? static_cast<Leaf*>(inner->children[child - 1]) : nullptr;
+        Leaf* right = child < inner->count ? static_cast<Leaf*>(inner->children[child + 1]) : nullptr;
+
+        if (left && left->count > leaf_minimum) {
+            std::size_t last = left->count - 1;
+            insert_at(keys_of(leaf), leaf->count, 0, std::move(left->key(last)));
+            insert_at(values_of(leaf), leaf->count, 0, std::move(left->value(last)));
+            leaf->count++;
+            erase_at(keys_of(left), left->count, last);
+            erase_at(values_of(left), left->count, last);
+            left->count--;
+            inner->key(child - 1) = leaf->key(0);
+            next_index++;
+            return false;
+        }
+
+        if (right && right->count > leaf_minimum) {
+            insert_at(keys_of(leaf), leaf->count, leaf->count, std::move(right->key(0)));
+            insert_at(values_of(leaf), leaf->count, leaf->count, std::move(right->value(0)));
+            leaf->count++;
+            erase_at(keys_of(right), right->count, 0);
+            erase_at(values_of(right), right->count, 0);
+            right->count--;
+            inner->key(child) = right->key(0);
+            return false;
+        }
+
+        if (left) {
+            next_leaf = left;
+            next_index += left->count;
+            merge_leaves(left, leaf);
+            remove_child(inner, child - 1);
+        } else {
+            merge_leaves(leaf, right);
+            remove_child(inner, child);
+        }
+        return true;
+    }
+
+    /**
+     * \brief Moves the items of \p right at the end of \p left and destroys \p right
+     */
+    void merge_leaves(Leaf* left, Leaf* right) {
+        relocate(keys_of(right), right->count, keys_of(left) + left->count);
+        relocate(values_of(right), right->count, values_of(left) + left->count);
+        left->count += right->count;
+        right->count = 0;
+
+        left->next = right->next;
+        if (right->next)
+            right->next->previous = left;
+        else
+            last_ = left;
+        leaf_pool_.destroy(right);
+    }
+
+    /**
+     * \brief Refills \p node through its parent from a sibling or merges it with one
+     * \param parent Parent of \p node and its index there
+     * \return Whether a child has been removed from the parent
+     */
+    bool rebalance_inner(const PathEntry& parent, Inner* node) {
+        Inner* inner = parent.node;
+        std::size_t child = parent.child;
+        Inner* left = child > 0 ? static_cast<Inner*>(inner->children[child - 1]) : nullptr;
+        Inner* right = child < inner->count ? static_cast<Inner*>(inner->children[child + 1]) : nullptr;
+
+        if (left && left->count > inner_minimum) {
+            // Rotates the last child of left through the parent key
+            insert_at(keys_of(node), node->count, 0, std::move(inner->key(child - 1)));
+            insert_at(node->children, node->count + 1, 0, left->children[left->count]);
+            node->count++;
+            inner->key(child - 1) = std::move(left->key(left->count - 1));
+            left->key(left->count - 1).~Key();
+            left->count--;
+            return false;
+        }
+
+        if (right && right->count > inner_minimum) {
+            insert_at(keys_of(node), node->count, node->count, std::move(inner->key(child)));
+            node->children[node->count + 1] = right->children[0];
+            node->count++;
+            inner->key(child) = std::move(right->key(0));
+            erase_at(keys_of(right), right->count, 0);
+            std::copy(right->children + 1, right->children + right->count + 1, right->children);
+            right->count--;
+            return false;
+        }
+
+        if (left) {
+            merge_inner(left, inner, child - 1, node);
+        } else {
+            merge_inner(node, inner, child, right);
+        }
+        return true;
+    }
+
+    /**
+     * \brief Moves the separator \p parent->key(index) and the contents of
+     * \p right at the end of \p left, destroys \p right and removes it from \p parent
+     */
+    void merge_inner(Inner* left, Inner* parent, std::size_t index, Inner* right) {
+        ::new (keys_of(left) + left->count) Key(std::move(parent->key(index)));
+        relocate(keys_of(right), right->count, keys_of(left) + left->count + 1);
+        std::copy(right->children, right->children + right->count + 1, left->children + left->count + 1);
+        left->count += right->count + 1;
+        right->count = 0;
+        inner_pool_.destroy(right);
+        remove_child(parent, index);
+    }
+
+    /**
+     * \brief Removes the key at \p index and the child after it from \p inner
+     */
+    static void remove_child(Inner* inner, std::size_t index) {
+        erase_at(keys_of(inner), inner->count, index);
+        std::copy(inner->children + index + 2, inner->children + inner->count + 1,
+                  inner->children + index + 1);
+        inner->count--;
+    }
+
+    /**
+     * \brief Copies the sub-tree rooted in \p node
+     * \param previous Last leaf copied so far, the new leaves are chained after it
+     * \complexity O(n)
+     */
+    Node* copy_node(const Node* node, Leaf*& previous) {
+        if (node->leaf) {
+            const Leaf* leaf = static_cast<const Leaf*>(node);
+            Leaf* copy = leaf_pool_.template create<Leaf>();
+            for (std::size_t i = 0; i < leaf->count; i++) {
+                ::new (keys_of(copy) + i) Key(leaf->key(i));
+                ::new (values_of(copy) + i) Value(leaf->value(i));
+                copy->count++;
+            }
+            copy->previous = previous;
+            if (previous)
+                previous->next = copy;
+            else
+                first_ = copy;
+            previous = copy;
+            return copy;
+        }
+
+        const Inner* inner = static_cast<const Inner*>(node);
+        Inner* copy = inner_pool_.template create<Inner>();
+        for (std::size_t i = 0; i <= inner->count; i++)
+            copy->children[i] = copy_node(inner->children[i], previous);
+        for (std::size_t i = 0; i < inner->count; i++)
+            ::new (keys_of(copy) + i) Key(inner->key(i));
+        copy->count = inner->count;
+        return copy;
+    }
+
+    /**
+     * \brief Calls the destructors of the keys and values in the sub-tree
+     *
+     * The memory itself is released along with the pool blocks.
+     */
+    void destroy_objects(Node* node) {
+        if (node->leaf) {
+            Leaf* leaf = static_cast<Leaf*>(node);
+            for (std::size_t i = 0; i < leaf->count; i++) {
+                leaf->key(i).~Key();
+                leaf->value(i).~Value();
+            }
+            return;
+        }
+        Inner* inner = static_cast<Inner*>(node);
+        for (std::size_t i = 0; i <= inner->count; i++)
+            destroy_objects(inner->children[i]);
+        for (std::size_t i = 0; i < inner->count; i++)
+            inner->key(i).~Key();
+    }
+
+    /**
+     * \brief Calls the destructors of all the keys and values, unless they are trivial
+     */
+    void destroy_nodes() {
+        if (root_ && !(std::is_trivially_destructible<Key>::value &&
+                       std::is_trivially_destructible<Value>::value))
+            destroy_objects(root_);
+    }
+
+    template<class Func, template<class> class Policy, class Direction>
+        void traverse_leaves(const Func& func, Policy<Direction>*) {
+            traverse_leaves(func, static_cast<Direction*>(nullptr));
+        }
+
+    template<class Func>
+        void traverse_leaves(const Func& func, traversal::Forward*) {
+            for (Leaf* leaf = first_; leaf; leaf = leaf->next)
+                for (std::size_t i = 0; i < leaf->count; i++)
+                    func(leaf->key(i), leaf->value(i));
+        }
+
+    template<class Func>
+        void traverse_leaves(const Func& func, traversal::Reverse*) {
+            for (Leaf* leaf = last_; leaf; leaf = leaf->previous)
+                for (std::size_t i = leaf->count; i-- > 0; )
+                    func(leaf->key(i), leaf->value(i));
+        }
+
+    void print_structure_recursive(const Node* node, int depth) const {
+        std::cout << std::string(depth, '.') << (node->leaf ? " [" : " (");
+        if (node->leaf) {
+            const Leaf* leaf = static_cast<const Leaf*>(node);
+            for (std::size_t i = 0; i < leaf->count; i++)
+                std::cout << (i ? " " : "") << leaf->key(i) << ':' << leaf->value(i);
+            std::cout << "]\n";
+            return;
+        }
+        const Inner* inner = static_cast<const Inner*>(node);
+        for (std::size_t i = 0; i < inner->count; i++)
+            std::cout << (i ? " " : "") << inner->key(i);
+        std::cout << ")\n";
+        for (std::size_t i = 0; i <= inner->count; i++)
+            print_structure_recursive(inner->children[i], depth + 1);
+    }
+
+    Node* root_ = nullptr;
+    Leaf* first_ = nullptr;
+    Leaf* last_ = nullptr;
+    int size_ = 0;
+    pool_type leaf_pool_;
+    pool_type inner_pool_;
+};
+
+template<class Key, class Value, class Comparator, class Allocator, std::size_t NodeBytes>
+    const std::size_t BPlusTree<Key, Value, Comparator, Allocator, NodeBytes>::leaf_capacity;
+template<class Key, class Value, class Comparator, class Allocator, std::size_t NodeBytes>
+    const std::size_t BPlusTree<Key, Value, Comparator, Allocator, NodeBytes>::inner_capacity;
+template<class Key, class Value, class Comparator, class Allocator, std::size_t NodeBytes>
+    const std::size_t BPlusTree<Key, Value, Comparator, Allocator, NodeBytes>::leaf_minimum;
+template<class Key, class Value, class Comparator, class Allocator, std::size_t NodeBytes>
+    const std::size_t BPlusTree<Key, Value, Comparator, Allocator, NodeBytes>::inner_minimum;
+template<class Key, class Value, class Comparator, class Allocator, std::size_t NodeBytes>
+    const std::size_t BPlusTree<Key, Value, Comparator, Allocator, NodeBytes>::max_height;
+
+#endif // B_PLUS_TREE_HPP
@@ -0,0 +1,95 @@
+/**
+ * \file
+ * \brief ConcurrentHashTable throughput against the number of threads,
+ * compared to a std::unordered_map behind a std::mutex
+ */
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "concurrent_hash_table.hpp"
+#include "workload.hpp"
+
+namespace {
+
+const std::size_t size = 1000000;
+const std::size_t lookup_count = 1 << 18;
+
+/**
+ * \brief std::unordered_map with one lock around everything
+ */
+class LockedUnorderedMap {
+public:
+    bool contains(int key) const {
+        std::lock_guard<std::mutex> guard(mutex);
+        return map.find(key) != map.end();
+    }
+
+    void insert_or_assign(int key, int value) {
+        std::lock_guard<std::mutex> guard(mutex);
+        map[key] = value;
+    }
+
+    void erase(int key) {
+        std::lock_guard<std::mutex> guard(mutex);
+        map.erase(key);
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<int,int> map;
+};
+
+typedef ConcurrentHashTable<int,int> IntConcurrentHashTable;
+
+template<class Map>
+    std::unique_ptr<Map> build() {
+        std::unique_ptr<Map> map(new Map);
+        for (int key : workload::keys<int>(size))
+            map->insert_or_assign(key, key);
+        return map;
+    }
+
+/**
+ * \brief Every thread runs lookups (half hits) and state.range(0) percent of writes,
+ * split between inserts and erases, on the same table
+ */
+template<class Map>
+    void BM_Throughput(benchmark::State& state) {
+        static std::unique_ptr<Map> map;
+        if (state.thread_index() == 0)
+            map = build<Map>();
+        std::vector<int> keys = workload::lookups<int>(lookup_count, size, 0.5);
+        int writes = state.range(0);
+        // Threads start at different offsets so they don't touch the same keys in lockstep
+        std::size_t i = state.thread_index() * 7919 % keys.size();
+        std::size_t found = 0;
+        for (auto _ : state) {
+            int key = keys[i];
+            int roll = i % 100;
+            if (roll < writes / 2)
+                map->insert_or_assign(key, roll);
+            else if (roll < writes)
+                map->erase(key);
+            else
+                found += map->contains(key);
+            i = (i + 1) % keys.size();
+        }
+        benchmark::DoNotOptimize(found);
+        state.SetItemsProcessed(state.iterations());
+        if (state.thread_index() == 0)
+            map.reset();
+    }
+
+void write_ratios(benchmark::internal::Benchmark* bench) {
+    for (int writes : {0, 5, 50})
+        bench->Arg(writes);
+}
+
+} // namespace
+
+BENCHMARK_TEMPLATE(BM_Throughput, IntConcurrentHashTable)->Apply(write_ratios)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Throughput, LockedUnorderedMap)->Apply(write_ratios)->ThreadRange(1, 64)->UseRealTime();
@@ -0,0 +1,180 @@
+/**
+ * \file
+ * \brief HashTable and FlatHashTable against std::unordered_map
+ */
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "flat_hash_table.hpp"
+#include "hash_table.hpp"
+#include "workload.hpp"
+
+namespace {
+
+typedef HashTable<int,int>                         IntHashTable;
+typedef FlatHashTable<int,int>                     IntFlatHashTable;
+typedef std::unordered_map<int,int>                IntUnorderedMap;
+typedef HashTable<std::string,int>                 StringHashTable;
+typedef FlatHashTable<std::string,int>             StringFlatHashTable;
+typedef std::unordered_map<std::string,int>        StringUnorderedMap;
+/// Same as IntHashTable, recording HashTableStats, to measure what they cost
+typedef HashTable<int,int,std::hash<int>,std::equal_to<int>,std::allocator<std::pair<int,int>>,true>
+    IntHashTableWithStats;
+
+/// Number of precomputed keys each lookup benchmark cycles through
+const std::size_t lookup_count = 1 << 18;
+
+template<class Map, class Key>
+    Map build(std::size_t size) {
+        Map map;
+        std::vector<Key> keys = workload::keys<Key>(size);
+        for (std::size_t i = 0; i < size; i++)
+            map[keys[i]] = i;
+        return map;
+    }
+
+/**
+ * \brief Inserting \p size distinct keys in an empty table
+ */
+template<class Map, class Key>
+    void BM_Insert(benchmark::State& state) {
+        std::vector<Key> keys = workload::keys<Key>(state.range(0));
+        for (auto _ : state) {
+            Map map;
+            for (std::size_t i = 0; i < keys.size(); i++)
+                map[keys[i]] = i;
+            benchmark::DoNotOptimize(map);
+        }
+        state.SetItemsProcessed(state.iterations() * keys.size());
+    }
+
+/**
+ * \brief Looking up keys with state.range(1) percent of hits
+ */
+template<class Map, class Key>
+    void BM_Find(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        const Map& map = workload::cached<Map>(size, &build<Map, Key>);
+        std::vector<Key> keys = workload::lookups<Key>(lookup_count, size, state.range(1) / 100.0);
+        std::size_t i = 0;
+        std::size_t found = 0;
+        for (auto _ : state) {
+            found += map.find(keys[i]) != map.end();
+            i = (i + 1) % keys.size();
+        }
+        benchmark::DoNotOptimize(found);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+/**
+ * \brief Lookups through find_batch(), 256 keys per call, all hits
+ */
+template<class Map, class Key>
+    void BM_FindBatch(benchmark::State& state) {
+        const std::size_t batch = 256;
+        std::size_t size = state.range(0);
+        Map& map = workload::cached<Map>(size, &build<Map, Key>);
+        std::vector<Key> keys = workload::lookups<Key>(lookup_count, size, 1);
+        std::vector<typename Map::iterator> results(batch);
+        std::size_t i = 0;
+        for (auto _ : state) {
+            map.find_batch(keys.begin() + i, keys.begin() + i + batch, results.begin());
+            benchmark::DoNotOptimize(results.data());
+            i = (i + batch) % keys.size();
+        }
+        state.SetItemsProcessed(state.iterations() * batch);
+    }
+
+/**
+ * \brief Steady state churn: 80% lookups (half hits), 10% inserts, 10% erases
+ */
+template<class Map, class Key>
+    void BM_Mixed(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        Map map = build<Map, Key>(size);
+        std::vector<Key> keys = workload::lookups<Key>(lookup_count, size, 0.5);
+        std::size_t i = 0;
+        std::size_t found = 0;
+        for (auto _ : state) {
+            const Key& key = keys[i];
+            switch (i % 10) {
+                case 0:
+                    map[key] = i;
+                    break;
+                case 5:
+                    map.erase(key);
+                    break;
+                default:
+                    found += map.find(key) != map.end();
+            }
+            i = (i + 1) % keys.size();
+        }
+        benchmark::DoNotOptimize(found);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+/**
+ * \brief Iterating over all the items
+ */
+template<class Map, class Key>
+    void BM_Iterate(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        const Map& map = workload::cached<Map>(size, &build<Map, Key>);
+        for (auto _ : state) {
+            long sum = 0;
+            for (const auto& item : map)
+                sum += item.second;
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * size);
+    }
+
+/**
+ * \brief Copying the whole table, then destroying the copy
+ */
+template<class Map, class Key>
+    void BM_CopyDestroy(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        const Map& map = workload::cached<Map>(size, &build<Map, Key>);
+        for (auto _ : state) {
+            Map copy(map);
+            benchmark::DoNotOptimize(copy);
+        }
+        state.SetItemsProcessed(state.iterations() * size);
+    }
+
+void hit_ratios(benchmark::internal::Benchmark* bench) {
+    for (std::int64_t size = 1000; size <= BENCHMARK_MAX_SIZE; size *= 10)
+        for (int hits : {100, 50, 0})
+            bench->Args({size, hits});
+}
+
+} // namespace
+
+#define HASH_TABLE_BENCHMARKS(Map, Key) \
+    BENCHMARK_TEMPLATE(BM_Insert, Map, Key)->Apply(workload::sizes)->Unit(benchmark::kMillisecond); \
+    BENCHMARK_TEMPLATE(BM_Find, Map, Key)->Apply(hit_ratios); \
+    BENCHMARK_TEMPLATE(BM_Mixed, Map, Key)->Apply(workload::sizes); \
+    BENCHMARK_TEMPLATE(BM_Iterate, Map, Key)->Apply(workload::sizes)->Unit(benchmark::kMicrosecond);
+
+HASH_TABLE_BENCHMARKS(IntHashTable, int)
+HASH_TABLE_BENCHMARKS(IntFlatHashTable, int)
+HASH_TABLE_BENCHMARKS(IntUnorderedMap, int)
+HASH_TABLE_BENCHMARKS(StringHashTable, std::string)
+HASH_TABLE_BENCHMARKS(StringFlatHashTable, std::string)
+HASH_TABLE_BENCHMARKS(StringUnorderedMap, std::string)
+
+BENCHMARK_TEMPLATE(BM_CopyDestroy, IntHashTable, int)->Apply(workload::sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_CopyDestroy, IntUnorderedMap, int)->Apply(workload::sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_CopyDestroy, StringHashTable, std::string)->Apply(workload::sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_CopyDestroy, StringUnorderedMap, std::string)->Apply(workload::sizes)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(BM_Find, IntHashTableWithStats, int)->Apply(hit_ratios);
+
+BENCHMARK_TEMPLATE(BM_FindBatch, IntHashTable, int)->Apply(workload::sizes);
+BENCHMARK_TEMPLATE(BM_FindBatch, IntFlatHashTable, int)->Apply(workload::sizes);
+BENCHMARK_TEMPLATE(BM_FindBatch, StringHashTable, std::string)->Apply(workload::sizes);
+BENCHMARK_TEMPLATE(BM_FindBatch, StringFlatHashTable, std::string)->Apply(workload::sizes);
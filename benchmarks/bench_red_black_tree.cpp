@@ -0,0 +1,426 @@
+/**
+ * \file
+ * \brief RedBlackTree, PersistentRedBlackTree and BPlusTree against std::map
+ */
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "b_plus_tree.hpp"
+#include "concurrent_hash_table.hpp"
+#include "persistent_red_black_tree.hpp"
+#include "red_black_tree.hpp"
+#include "workload.hpp"
+
+namespace {
+
+typedef RedBlackTree<int,int>           IntRedBlackTree;
+typedef std::map<int,int>               IntMap;
+typedef BPlusTree<int,int>              IntBPlusTree;
+typedef RedBlackTree<int,int,std::less<int>,std::allocator<std::pair<const int,int>>,true>
+                                        IntOrderStatisticsTree;
+typedef RedBlackTree<std::string,int>   StringRedBlackTree;
+typedef std::map<std::string,int>       StringMap;
+typedef BPlusTree<std::string,int>      StringBPlusTree;
+typedef PersistentRedBlackTree<int,int> IntPersistentTree;
+/// Same as IntRedBlackTree, recording RedBlackTreeStats, to measure what they cost
+typedef RedBlackTree<int,int,std::less<int>,std::allocator<std::pair<const int,int>>,false,true>
+                                        IntRedBlackTreeWithStats;
+
+const std::size_t lookup_count = 1 << 18;
+
+template<class Map, class Key>
+    Map build(std::size_t size) {
+        Map map;
+        std::vector<Key> keys = workload::keys<Key>(size);
+        for (std::size_t i = 0; i < size; i++)
+            map[keys[i]] = i;
+        return map;
+    }
+
+/**
+ * \brief Inserting \p size distinct keys in random order
+ */
+template<class Map, class Key>
+    void BM_Insert(benchmark::State& state) {
+        std::vector<Key> keys = workload::keys<Key>(state.range(0));
+        for (auto _ : state) {
+            Map map;
+            for (std::size_t i = 0; i < keys.size(); i++)
+                map[keys[i]] = i;
+            benchmark::DoNotOptimize(map);
+        }
+        state.SetItemsProcessed(state.iterations() * keys.size());
+    }
+
+/**
+ * \brief Inserting \p size keys in ascending order, the worst case for rebalancing
+ */
+template<class Map>
+    void BM_InsertSorted(benchmark::State& state) {
+        int size = state.range(0);
+        for (auto _ : state) {
+            Map map;
+            for (int i = 0; i < size; i++)
+                map[i] = i;
+            benchmark::DoNotOptimize(map);
+        }
+        state.SetItemsProcessed(state.iterations() * size);
+    }
+
+/**
+ * \brief Looking up keys with state.range(1) percent of hits
+ */
+template<class Map, class Key>
+    void BM_Find(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        const Map& map = workload::cached<Map>(size, &build<Map, Key>);
+        std::vector<Key> keys = workload::lookups<Key>(lookup_count, size, state.range(1) / 100.0);
+        std::size_t i = 0;
+        std::size_t found = 0;
+        for (auto _ : state) {
+            found += map.find(keys[i]) != map.end();
+            i = (i + 1) % keys.size();
+        }
+        benchmark::DoNotOptimize(found);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+/**
+ * \brief Steady state churn: 80% lookups (half hits), 10% inserts, 10% erases
+ */
+template<class Map, class Key>
+    void BM_Mixed(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        Map map = build<Map, Key>(size);
+        std::vector<Key> keys = workload::lookups<Key>(lookup_count, size, 0.5);
+        std::size_t i = 0;
+        std::size_t found = 0;
+        for (auto _ : state) {
+            const Key& key = keys[i];
+            switch (i % 10) {
+                case 0:
+                    map[key] = i;
+                    break;
+                case 5:
+                    map.erase(key);
+                    break;
+                default:
+                    found += map.find(key) != map.end();
+            }
+            i = (i + 1) % keys.size();
+        }
+        benchmark::DoNotOptimize(found);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+/**
+ * \brief In-order iteration over all the items
+ */
+template<class Map, class Key>
+    void BM_Iterate(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        const Map& map = workload::cached<Map>(size, &build<Map, Key>);
+        for (auto _ : state) {
+            std::size_t count = 0;
+            for (auto it = map.begin(); it != map.end(); ++it)
+                count++;
+            benchmark::DoNotOptimize(count);
+        }
+        state.SetItemsProcessed(state.iterations() * size);
+    }
+
+/**
+ * \brief Copying the whole container, then destroying the copy
+ */
+template<class Map, class Key>
+    void BM_CopyDestroy(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        const Map& map = workload::cached<Map>(size, &build<Map, Key>);
+        for (auto _ : state) {
+            Map copy(map);
+            benchmark::DoNotOptimize(copy);
+        }
+        state.SetItemsProcessed(state.iterations() * size);
+    }
+
+/**
+ * \brief traverse() over all the items with the policy \p Order
+ */
+template<class Map, class Key, class Order>
+    void BM_Traverse(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        Map& map = workload::cached<Map>(size, &build<Map, Key>);
+        for (auto _ : state) {
+            long sum = 0;
+            map.template traverse<Order>([&sum](const Key&, int value) { sum += value; });
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * size);
+    }
+
+/**
+ * \brief Visiting the state.range(1) items following a random key
+ */
+template<class Map, class Key>
+    void BM_RangeScan(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        std::size_t length = state.range(1);
+        const Map& map = workload::cached<Map>(size, &build<Map, Key>);
+        std::vector<Key> keys = workload::lookups<Key>(lookup_count, size, 1);
+        std::size_t i = 0;
+        long sum = 0;
+        for (auto _ : state) {
+            auto it = map.lower_bound(keys[i]);
+            for (std::size_t j = 0; j < length && it != map.end(); j++, ++it)
+                sum += workload::value(*it);
+            i = (i + 1) % keys.size();
+        }
+        benchmark::DoNotOptimize(sum);
+        state.SetItemsProcessed(state.iterations() * length);
+    }
+
+/**
+ * \brief Percentile queries: key at a random rank, then the rank of a random key
+ */
+template<class Map>
+    void BM_SelectRank(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        const Map& map = workload::cached<Map>(size, &build<Map, int>);
+        std::vector<int> keys = workload::lookups<int>(lookup_count, size, 1);
+        std::size_t i = 0;
+        long sum = 0;
+        for (auto _ : state) {
+            sum += map.select(keys[i] % size).key();
+            sum += map.rank(keys[i]);
+            i = (i + 1) % keys.size();
+        }
+        benchmark::DoNotOptimize(sum);
+        state.SetItemsProcessed(state.iterations() * 2);
+    }
+
+/**
+ * \brief Building a tree from \p size sorted keys in one go, to compare with BM_InsertSorted
+ */
+template<class Map>
+    void BM_AssignSorted(benchmark::State& state) {
+        std::vector<std::pair<int,int>> items;
+        for (int i = 0; i < state.range(0); i++)
+            items.emplace_back(i, i);
+        for (auto _ : state) {
+            Map map;
+            map.assign_sorted(items.begin(), items.end());
+            benchmark::DoNotOptimize(map);
+        }
+        state.SetItemsProcessed(state.iterations() * items.size());
+    }
+
+/**
+ * \brief Merging a tree state.range(1) times smaller into one of \p size keys,
+ * with state.range(2) threads, or with an insert loop if it's 0
+ */
+template<class Map>
+    void BM_Unite(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        std::size_t other_size = size / state.range(1);
+        int threads = state.range(2);
+        const Map& built = workload::cached<Map>(size, &build<Map, int>);
+        // Half of the keys are already in the larger tree
+        Map other_built;
+        for (std::size_t i = 0; i < other_size; i++)
+            other_built[workload::key<int>(i % 2 ? i : size + i)] = i;
+        for (auto _ : state) {
+            state.PauseTiming();
+            Map map(built);
+            Map other(other_built);
+            state.ResumeTiming();
+            if (threads) {
+                map.unite(std::move(other), threads);
+            } else {
+                for (auto it = other.begin(); it != other.end(); ++it)
+                    if (map.find(it.key()) == map.end())
+                        map.insert(it.key(), *it);
+            }
+            benchmark::DoNotOptimize(map);
+        }
+        state.SetItemsProcessed(state.iterations() * other_size);
+    }
+
+void unite_ratios(benchmark::internal::Benchmark* bench) {
+    for (std::int64_t size = 10000; size <= BENCHMARK_MAX_SIZE; size *= 10)
+        for (int ratio : {1, 100})
+            for (int threads : {0, 1, 4})
+                bench->Args({size, ratio, threads});
+}
+
+/**
+ * \brief Publishing a snapshot after every update, the previous one being still
+ * in use until the next: copying RedBlackTree against sharing PersistentRedBlackTree
+ */
+template<class Map>
+    void BM_SnapshotUpdate(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        std::vector<int> keys = workload::keys<int>(size);
+        Map map;
+        for (std::size_t i = 0; i < size; i++)
+            map.insert(keys[i], i);
+        std::vector<int> updates = workload::lookups<int>(lookup_count, size, 0.5);
+        Map snapshot;
+        std::size_t i = 0;
+        for (auto _ : state) {
+            if (i % 2)
+                map.insert(updates[i], i);
+            else
+                map.erase(updates[i]);
+            snapshot = map;
+            i = (i + 1) % updates.size();
+        }
+        benchmark::DoNotOptimize(snapshot);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+/**
+ * \brief Index shared by one writer and many readers: snapshots published
+ * through AtomicSnapshot
+ */
+class PublishedIndex {
+public:
+    void insert(int key, int value) {
+        tree_.insert(key, value);
+        published_.publish(tree_);
+    }
+
+    void erase(int key) {
+        tree_.erase(key);
+        published_.publish(tree_);
+    }
+
+    bool contains(int key) const {
+        return published_.load().contains(key);
+    }
+
+private:
+    IntPersistentTree tree_;
+    AtomicSnapshot<IntPersistentTree> published_;
+};
+
+/**
+ * \brief Index shared by one writer and many readers: a RedBlackTree behind a reader-writer lock
+ */
+class LockedIndex {
+public:
+    void insert(int key, int value) {
+        std::lock_guard<SharedSpinLock> guard(lock_);
+        tree_.insert(key, value);
+    }
+
+    void erase(int key) {
+        std::lock_guard<SharedSpinLock> guard(lock_);
+        tree_.erase(key);
+    }
+
+    bool contains(int key) const {
+        SharedSpinLock::SharedGuard guard(lock_);
+        return tree_.find(key) != tree_.end();
+    }
+
+private:
+    mutable SharedSpinLock lock_;
+    IntRedBlackTree tree_;
+};
+
+/**
+ * \brief Lookups (half hits) on all threads but the first, which keeps
+ * updating the index with state.range(0) writes per 100 of its iterations
+ */
+template<class Index>
+    void BM_ReadersOneWriter(benchmark::State& state) {
+        const std::size_t size = 100000;
+        static std::unique_ptr<Index> index;
+        if (state.thread_index() == 0) {
+            index.reset(new Index);
+            for (int key : workload::keys<int>(size))
+                index->insert(key, key);
+        }
+        std::vector<int> keys = workload::lookups<int>(lookup_count, size, 0.5);
+        std::size_t i = state.thread_index() * 7919 % keys.size();
+        bool writer = state.thread_index() == 0 && state.threads() > 1;
+        std::size_t found = 0;
+        for (auto _ : state) {
+            int key = keys[i];
+            if (!writer)
+                found += index->contains(key);
+            else if (int(i % 100) < state.range(0))
+                i % 2 ? index->insert(key, i) : index->erase(key);
+            i = (i + 1) % keys.size();
+        }
+        benchmark::DoNotOptimize(found);
+        if (!writer)
+            state.SetItemsProcessed(state.iterations());
+        if (state.thread_index() == 0)
+            index.reset();
+    }
+
+void range_lengths(benchmark::internal::Benchmark* bench) {
+    for (std::int64_t size = 1000; size <= BENCHMARK_MAX_SIZE; size *= 10)
+        for (int length : {10, 1000})
+            bench->Args({size, length});
+}
+
+void hit_ratios(benchmark::internal::Benchmark* bench) {
+    for (std::int64_t size = 1000; size <= BENCHMARK_MAX_SIZE; size *= 10)
+        for (int hits : {100, 0})
+            bench->Args({size, hits});
+}
+
+} // namespace
+
+#define ORDERED_MAP_BENCHMARKS(Map, Key) \
+    BENCHMARK_TEMPLATE(BM_Insert, Map, Key)->Apply(workload::sizes)->Unit(benchmark::kMillisecond); \
+    BENCHMARK_TEMPLATE(BM_Find, Map, Key)->Apply(hit_ratios); \
+    BENCHMARK_TEMPLATE(BM_Mixed, Map, Key)->Apply(workload::sizes); \
+    BENCHMARK_TEMPLATE(BM_Iterate, Map, Key)->Apply(workload::sizes)->Unit(benchmark::kMicrosecond);
+
+ORDERED_MAP_BENCHMARKS(IntRedBlackTree, int)
+ORDERED_MAP_BENCHMARKS(IntMap, int)
+ORDERED_MAP_BENCHMARKS(IntBPlusTree, int)
+ORDERED_MAP_BENCHMARKS(StringRedBlackTree, std::string)
+ORDERED_MAP_BENCHMARKS(StringMap, std::string)
+ORDERED_MAP_BENCHMARKS(StringBPlusTree, std::string)
+
+BENCHMARK_TEMPLATE(BM_CopyDestroy, IntRedBlackTree, int)->Apply(workload::sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_CopyDestroy, IntMap, int)->Apply(workload::sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_CopyDestroy, StringRedBlackTree, std::string)->Apply(workload::sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_CopyDestroy, StringMap, std::string)->Apply(workload::sizes)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(BM_Traverse, IntRedBlackTree, int, traversal::InOrder<>)->Apply(workload::sizes)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_Traverse, IntRedBlackTree, int, traversal::PreOrder<>)->Apply(workload::sizes)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_Traverse, IntRedBlackTree, int, traversal::PostOrder<>)->Apply(workload::sizes)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_TEMPLATE(BM_Insert, IntRedBlackTreeWithStats, int)->Apply(workload::sizes)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(BM_InsertSorted, IntRedBlackTree)->Apply(workload::sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_InsertSorted, IntMap)->Apply(workload::sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_InsertSorted, IntBPlusTree)->Apply(workload::sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_AssignSorted, IntRedBlackTree)->Apply(workload::sizes)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(BM_Unite, IntRedBlackTree)->Apply(unite_ratios)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_TEMPLATE(BM_SnapshotUpdate, IntRedBlackTree)->Apply([](benchmark::internal::Benchmark* bench) {
+    workload::sizes(bench, 100000);
+});
+BENCHMARK_TEMPLATE(BM_SnapshotUpdate, IntPersistentTree)->Apply(workload::sizes);
+BENCHMARK_TEMPLATE(BM_ReadersOneWriter, PublishedIndex)->Arg(10)->Arg(100)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ReadersOneWriter, LockedIndex)->Arg(10)->Arg(100)->ThreadRange(1, 8)->UseRealTime();
+
+BENCHMARK_TEMPLATE(BM_RangeScan, IntMap, int)->Apply(range_lengths);
+BENCHMARK_TEMPLATE(BM_RangeScan, IntRedBlackTree, int)->Apply(range_lengths);
+BENCHMARK_TEMPLATE(BM_RangeScan, IntOrderStatisticsTree, int)->Apply(range_lengths);
+BENCHMARK_TEMPLATE(BM_RangeScan, IntBPlusTree, int)->Apply(range_lengths);
+
+BENCHMARK_TEMPLATE(BM_Mixed, IntOrderStatisticsTree, int)->Apply(workload::sizes);
+BENCHMARK_TEMPLATE(BM_SelectRank, IntOrderStatisticsTree)->Apply(workload::sizes);
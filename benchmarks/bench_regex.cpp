@@ -0,0 +1,214 @@
+/**
+ * \file
+ * \brief RegEx, RegexSet and Matcher against std::regex on log lines
+ */
+#include <algorithm>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "regex.hpp"
+#include "workload.hpp"
+
+namespace {
+
+const std::size_t line_count = 10000;
+
+const std::vector<std::string>& lines() {
+    static std::vector<std::string> lines = workload::log_lines(line_count);
+    return lines;
+}
+
+std::size_t total_bytes() {
+    std::size_t bytes = 0;
+    for (const std::string& line : lines())
+        bytes += line.size();
+    return bytes;
+}
+
+/**
+ * \brief All the log lines as a single buffer, one per line
+ */
+const std::string& log() {
+    static std::string log;
+    if (log.empty()) {
+        for (const std::string& line : lines()) {
+            log += line;
+            log += '\n';
+        }
+    }
+    return log;
+}
+
+void patterns(benchmark::internal::Benchmark* bench) {
+    for (std::size_t i = 0; i < workload::log_patterns().size(); i++)
+        bench->Arg(i);
+}
+
+void BM_Compile(benchmark::State& state) {
+    std::string expression = workload::log_patterns()[state.range(0)];
+    for (auto _ : state) {
+        regex::Pattern pattern(expression);
+        benchmark::DoNotOptimize(&pattern);
+    }
+    state.SetLabel(expression);
+}
+
+void BM_StdCompile(benchmark::State& state) {
+    std::string expression = workload::log_patterns()[state.range(0)];
+    for (auto _ : state) {
+        std::regex pattern(expression);
+        benchmark::DoNotOptimize(&pattern);
+    }
+    state.SetLabel(expression);
+}
+
+/**
+ * \brief Matching whole lines, one pattern per run
+ */
+void BM_FullMatch(benchmark::State& state) {
+    std::string expression = workload::log_patterns()[state.range(0)];
+    regex::MatchContext context(std::make_shared<regex::Pattern>(expression));
+    std::size_t matched = 0;
+    for (auto _ : state)
+        for (const std::string& line : lines())
+            matched += context.full_match(line);
+    benchmark::DoNotOptimize(matched);
+    state.SetBytesProcessed(state.iterations() * total_bytes());
+    state.SetLabel(expression);
+}
+
+void BM_StdFullMatch(benchmark::State& state) {
+    std::string expression = workload::log_patterns()[state.range(0)];
+    std::regex pattern(expression);
+    std::size_t matched = 0;
+    for (auto _ : state)
+        for (const std::string& line : lines())
+            matched += std::regex_match(line, pattern);
+    benchmark::DoNotOptimize(matched);
+    state.SetBytesProcessed(state.iterations() * total_bytes());
+    state.SetLabel(expression);
+}
+
+/**
+ * \brief Finding the first occurrence in each line
+ */
+void BM_Search(benchmark::State& state) {
+    std::string expression = workload::search_patterns()[state.range(0)];
+    regex::MatchContext context(std::make_shared<regex::Pattern>(expression));
+    std::size_t matched = 0;
+    for (auto _ : state)
+        for (const std::string& line : lines())
+            matched += context.search(line);
+    benchmark::DoNotOptimize(matched);
+    state.SetBytesProcessed(state.iterations() * total_bytes());
+    state.SetLabel(expression);
+}
+
+void BM_StdSearch(benchmark::State& state) {
+    std::string expression = workload::search_patterns()[state.range(0)];
+    std::regex pattern(expression);
+    std::size_t matched = 0;
+    for (auto _ : state)
+        for (const std::string& line : lines())
+            matched += std::regex_search(line, pattern);
+    benchmark::DoNotOptimize(matched);
+    state.SetBytesProcessed(state.iterations() * total_bytes());
+    state.SetLabel(expression);
+}
+
+/**
+ * \brief Finding all the occurrences in the log fed in 4 KiB chunks
+ */
+void BM_StreamFindAll(benchmark::State& state) {
+    std::string expression = workload::search_patterns()[state.range(0)];
+    regex::Matcher matcher = regex::RegEx(expression).matcher();
+    const std::string& data = log();
+    const std::size_t chunk = 4096;
+    std::vector<regex::Match> matches;
+    for (auto _ : state) {
+        matches.clear();
+        matcher.reset();
+        for (std::size_t i = 0; i < data.size(); i += chunk)
+            matcher.feed(data.data() + i, std::min(chunk, data.size() - i), matches);
+        matcher.finish(matches);
+        benchmark::DoNotOptimize(matches.data());
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    state.SetLabel(expression);
+}
+
+void BM_StdFindAll(benchmark::State& state) {
+    std::string expression = workload::search_patterns()[state.range(0)];
+    std::regex pattern(expression);
+    const std::string& data = log();
+    std::size_t count = 0;
+    for (auto _ : state)
+        for (std::sregex_iterator it(data.begin(), data.end(), pattern), end; it != end; ++it)
+            count++;
+    benchmark::DoNotOptimize(count);
+    state.SetBytesProcessed(state.iterations() * data.size());
+    state.SetLabel(expression);
+}
+
+/**
+ * \brief find_all when a longer match stays possible until the end of the input
+ *
+ * Every "a" is a match, but each one could also be the start of a match
+ * up to a "z" which never comes, so the whole rest of the input is
+ * buffered after each match. The fitted complexity must stay O(N).
+ */
+void BM_FindAllPendingLonger(benchmark::State& state) {
+    regex::RegEx expression("a|a.*z");
+    std::string data(state.range(0), 'a');
+    for (auto _ : state) {
+        std::vector<regex::Match> matches = expression.find_all(data);
+        benchmark::DoNotOptimize(matches.data());
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    state.SetComplexityN(state.range(0));
+}
+
+/**
+ * \brief Which of all the patterns occur in each line, in a single pass
+ */
+void BM_SetSearch(benchmark::State& state) {
+    regex::RegexSet set(workload::search_patterns());
+    std::size_t matched = 0;
+    for (auto _ : state)
+        for (const std::string& line : lines())
+            matched += set.search(line).size();
+    benchmark::DoNotOptimize(matched);
+    state.SetBytesProcessed(state.iterations() * total_bytes());
+}
+
+void BM_StdSetSearch(benchmark::State& state) {
+    std::vector<std::regex> set;
+    for (const std::string& expression : workload::search_patterns())
+        set.emplace_back(expression);
+    std::size_t matched = 0;
+    for (auto _ : state)
+        for (const std::string& line : lines())
+            for (const std::regex& pattern : set)
+                matched += std::regex_search(line, pattern);
+    benchmark::DoNotOptimize(matched);
+    state.SetBytesProcessed(state.iterations() * total_bytes());
+}
+
+} // namespace
+
+BENCHMARK(BM_Compile)->Apply(patterns);
+BENCHMARK(BM_StdCompile)->Apply(patterns);
+BENCHMARK(BM_FullMatch)->Apply(patterns)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_StdFullMatch)->Apply(patterns)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Search)->Apply(patterns)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_StdSearch)->Apply(patterns)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_StreamFindAll)->Apply(patterns)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_StdFindAll)->Apply(patterns)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_FindAllPendingLonger)->RangeMultiplier(4)->Range(1 << 12, 1 << 20)
+    ->Complexity(benchmark::oN)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_SetSearch)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_StdSetSearch)->Unit(benchmark::kMicrosecond);
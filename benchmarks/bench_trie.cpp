@@ -0,0 +1,341 @@
+/**
+ * \file
+ * \brief Trie, CompactTrie, RadixTrie and frozen Trie snapshots against std::set
+ * and std::unordered_set, on dictionary words and on URLs
+ */
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "compact_trie.hpp"
+#include "radix_trie.hpp"
+#include "trie.hpp"
+#include "trie_snapshot.hpp"
+#include "workload.hpp"
+
+namespace {
+
+typedef std::set<std::string>           StringSet;
+typedef std::unordered_set<std::string> StringUnorderedSet;
+
+const std::size_t lookup_count = 1 << 16;
+
+/// Generator of the keys
+typedef std::vector<std::string> (*Keys)(std::size_t);
+
+template<class Set, Keys keys>
+    struct Builder {
+        static Set build(std::size_t size) {
+            Set set;
+            for (const std::string& word : keys(size))
+                set.insert(word);
+            return set;
+        }
+    };
+
+const char* const snapshot_path = "bench_trie.snapshot";
+
+/**
+ * \brief Views are built by freezing a Trie into a file and mapping it,
+ * the file is removed right away as the mapping keeps it alive
+ */
+template<Keys keys>
+    struct Builder<TrieView, keys> {
+        static TrieView build(std::size_t size) {
+            TrieView view;
+            if (!write_snapshot(Builder<Trie, keys>::build(size), snapshot_path) || !view.map(snapshot_path))
+                std::fprintf(stderr, "Can't write or map %s\n", snapshot_path);
+            std::remove(snapshot_path);
+            return view;
+        }
+    };
+
+bool contains(const Trie& trie, const std::string& word) {
+    return trie.contains(word);
+}
+
+bool contains(const CompactTrie& trie, const std::string& word) {
+    return trie.contains(word);
+}
+
+bool contains(const RadixTrie& trie, const std::string& word) {
+    return trie.contains(word);
+}
+
+bool contains(const TrieView& view, const std::string& word) {
+    return view.contains(word);
+}
+
+template<class Set>
+    bool contains(const Set& set, const std::string& word) {
+        return set.find(word) != set.end();
+    }
+
+bool contains_prefix(const Trie& trie, const std::string& prefix) {
+    return trie.contains_prefix(prefix);
+}
+
+bool contains_prefix(const CompactTrie& trie, const std::string& prefix) {
+    return trie.contains_prefix(prefix);
+}
+
+bool contains_prefix(const RadixTrie& trie, const std::string& prefix) {
+    return trie.contains_prefix(prefix);
+}
+
+bool contains_prefix(const TrieView& view, const std::string& prefix) {
+    return view.contains_prefix(prefix);
+}
+
+bool contains_prefix(const StringSet& set, const std::string& prefix) {
+    auto it = set.lower_bound(prefix);
+    return it != set.end() && it->compare(0, prefix.size(), prefix) == 0;
+}
+
+/**
+ * \brief Words to look up: half from the dictionary, half with a changed letter
+ */
+template<Keys keys>
+    std::vector<std::string> queries(std::size_t size) {
+        std::vector<std::string> words = keys(size);
+        std::vector<std::string> result;
+        result.reserve(lookup_count);
+        for (std::size_t i = 0; i < lookup_count; i++) {
+            std::string word = words[i * 7919 % words.size()];
+            if (i % 2)
+                word[word.size() / 2] = 'z';
+            result.push_back(word);
+        }
+        return result;
+    }
+
+/**
+ * \brief Loading a dictionary of \p size words
+ */
+template<class Set, Keys keys>
+    void BM_Load(benchmark::State& state) {
+        std::vector<std::string> words = keys(state.range(0));
+        for (auto _ : state) {
+            Set set;
+            for (const std::string& word : words)
+                set.insert(word);
+            benchmark::DoNotOptimize(set);
+        }
+        state.SetItemsProcessed(state.iterations() * words.size());
+    }
+
+/**
+ * \brief Startup from a frozen Trie: mapping its snapshot and a first lookup,
+ * to be compared with BM_Load
+ */
+template<Keys keys>
+    void BM_MapSnapshot(benchmark::State& state) {
+        std::vector<std::string> words = keys(state.range(0));
+        Trie trie;
+        for (const std::string& word : words)
+            trie.insert(word);
+        if (!write_snapshot(trie, snapshot_path)) {
+            state.SkipWithError("Can't write the snapshot");
+            return;
+        }
+        std::size_t i = 0;
+        std::size_t found = 0;
+        std::size_t edges = 0;
+        for (auto _ : state) {
+            TrieView view;
+            view.map(snapshot_path);
+            found += view.contains(words[i]);
+            edges = view.edge_count();
+            i = (i + 1) % words.size();
+        }
+        std::remove(snapshot_path);
+        benchmark::DoNotOptimize(found);
+        state.counters["bytes_per_word"] = double(edges * 5) / words.size();
+    }
+
+template<class Set, Keys keys>
+    void BM_Contains(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        const Set& set = workload::cached<Set>(size, &Builder<Set, keys>::build);
+        std::vector<std::string> words = queries<keys>(size);
+        std::size_t i = 0;
+        std::size_t found = 0;
+        for (auto _ : state) {
+            found += contains(set, words[i]);
+            i = (i + 1) % words.size();
+        }
+        benchmark::DoNotOptimize(found);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+/**
+ * \brief Prefixes to look up: the first 1 to 6 characters of the query words,
+ * 1 to 6 eighths of the query URLs
+ */
+template<Keys keys>
+    std::vector<std::string> prefixes(std::size_t size) {
+        std::vector<std::string> result;
+        for (const std::string& word : queries<keys>(size)) {
+            std::size_t length = 1 + result.size() % 6;
+            if (keys == &workload::urls)
+                length = word.size() * length / 8;
+            result.push_back(word.substr(0, length));
+        }
+        return result;
+    }
+
+template<class Set, Keys keys>
+    void BM_ContainsPrefix(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        const Set& set = workload::cached<Set>(size, &Builder<Set, keys>::build);
+        std::vector<std::string> prefixes = ::prefixes<keys>(size);
+        std::size_t i = 0;
+        std::size_t found = 0;
+        for (auto _ : state) {
+            found += contains_prefix(set, prefixes[i]);
+            i = (i + 1) % prefixes.size();
+        }
+        benchmark::DoNotOptimize(found);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+/**
+ * \brief Batches of lookup_count words checked by Trie::contains_many,
+ * to be compared with BM_Contains
+ */
+template<Keys keys>
+    void BM_ContainsMany(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        const Trie& trie = workload::cached<Trie>(size, &Builder<Trie, keys>::build);
+        std::vector<std::string> words = queries<keys>(size);
+        std::vector<char> found(words.size());
+        for (auto _ : state) {
+            trie.contains_many(words.begin(), words.end(), found.begin());
+            benchmark::DoNotOptimize(found.data());
+        }
+        state.SetItemsProcessed(state.iterations() * words.size());
+    }
+
+const std::size_t completion_count = 10;
+
+/**
+ * \brief Trie whose words have random weights, from a long tailed distribution
+ */
+template<Keys keys>
+    Trie build_weighted(std::size_t size) {
+        std::mt19937_64 random(5);
+        std::exponential_distribution<double> weight(1e-4);
+        Trie trie;
+        for (const std::string& word : keys(size))
+            trie.insert(word, std::uint64_t(weight(random)));
+        return trie;
+    }
+
+/**
+ * \brief Trie::top_completions for the query prefixes
+ */
+template<Keys keys>
+    void BM_TopCompletions(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        const Trie& trie = workload::cached<Trie>(size, &build_weighted<keys>);
+        std::vector<std::string> prefixes = ::prefixes<keys>(size);
+        std::size_t i = 0;
+        std::size_t found = 0;
+        for (auto _ : state) {
+            found += trie.top_completions(prefixes[i], completion_count).size();
+            i = (i + 1) % prefixes.size();
+        }
+        benchmark::DoNotOptimize(found);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+/**
+ * \brief The same completions by visiting all the words under the prefix
+ * and keeping the heaviest ones
+ */
+template<Keys keys>
+    void BM_TopCompletionsScan(benchmark::State& state) {
+        std::size_t size = state.range(0);
+        const Trie& trie = workload::cached<Trie>(size, &build_weighted<keys>);
+        std::vector<std::string> prefixes = ::prefixes<keys>(size);
+        std::vector<Trie::completion_type> completions;
+        std::size_t i = 0;
+        std::size_t found = 0;
+        for (auto _ : state) {
+            completions.clear();
+            trie.for_each_completion(prefixes[i], [&](const std::string& word) {
+                completions.emplace_back(word, trie.weight(word));
+            });
+            std::size_t count = std::min(completion_count, completions.size());
+            std::partial_sort(completions.begin(), completions.begin() + count, completions.end(),
+                              [](const Trie::completion_type& a, const Trie::completion_type& b) {
+                return a.second > b.second;
+            });
+            found += count;
+            i = (i + 1) % prefixes.size();
+        }
+        benchmark::DoNotOptimize(found);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+void dictionary_sizes(benchmark::internal::Benchmark* bench) {
+    workload::sizes(bench, 10000000);
+}
+
+void url_sizes(benchmark::internal::Benchmark* bench) {
+    workload::sizes(bench, 1000000);
+}
+
+/// Trie has a node per character past the shared prefixes, a few GB for a million URLs
+void trie_url_sizes(benchmark::internal::Benchmark* bench) {
+    workload::sizes(bench, 100000);
+}
+
+} // namespace
+
+#define TRIE_BENCHMARKS(Set, keys, sizes) \
+    BENCHMARK_TEMPLATE(BM_Load, Set, keys)->Apply(sizes)->Unit(benchmark::kMillisecond); \
+    BENCHMARK_TEMPLATE(BM_Contains, Set, keys)->Apply(sizes);
+
+TRIE_BENCHMARKS(Trie, workload::words, dictionary_sizes)
+TRIE_BENCHMARKS(CompactTrie, workload::words, dictionary_sizes)
+TRIE_BENCHMARKS(RadixTrie, workload::words, dictionary_sizes)
+BENCHMARK_TEMPLATE(BM_Contains, TrieView, workload::words)->Apply(dictionary_sizes);
+TRIE_BENCHMARKS(StringSet, workload::words, dictionary_sizes)
+TRIE_BENCHMARKS(StringUnorderedSet, workload::words, dictionary_sizes)
+
+TRIE_BENCHMARKS(Trie, workload::urls, trie_url_sizes)
+TRIE_BENCHMARKS(CompactTrie, workload::urls, url_sizes)
+TRIE_BENCHMARKS(RadixTrie, workload::urls, url_sizes)
+BENCHMARK_TEMPLATE(BM_Contains, TrieView, workload::urls)->Apply(trie_url_sizes);
+TRIE_BENCHMARKS(StringSet, workload::urls, url_sizes)
+TRIE_BENCHMARKS(StringUnorderedSet, workload::urls, url_sizes)
+
+BENCHMARK_TEMPLATE(BM_ContainsPrefix, Trie, workload::words)->Apply(dictionary_sizes);
+BENCHMARK_TEMPLATE(BM_ContainsPrefix, CompactTrie, workload::words)->Apply(dictionary_sizes);
+BENCHMARK_TEMPLATE(BM_ContainsPrefix, RadixTrie, workload::words)->Apply(dictionary_sizes);
+BENCHMARK_TEMPLATE(BM_ContainsPrefix, TrieView, workload::words)->Apply(dictionary_sizes);
+BENCHMARK_TEMPLATE(BM_ContainsPrefix, StringSet, workload::words)->Apply(dictionary_sizes);
+
+BENCHMARK_TEMPLATE(BM_ContainsPrefix, Trie, workload::urls)->Apply(trie_url_sizes);
+BENCHMARK_TEMPLATE(BM_ContainsPrefix, CompactTrie, workload::urls)->Apply(url_sizes);
+BENCHMARK_TEMPLATE(BM_ContainsPrefix, RadixTrie, workload::urls)->Apply(url_sizes);
+BENCHMARK_TEMPLATE(BM_ContainsPrefix, TrieView, workload::urls)->Apply(trie_url_sizes);
+BENCHMARK_TEMPLATE(BM_ContainsPrefix, StringSet, workload::urls)->Apply(url_sizes);
+
+BENCHMARK_TEMPLATE(BM_MapSnapshot, workload::words)->Apply(dictionary_sizes)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_MapSnapshot, workload::urls)->Apply(trie_url_sizes)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_TEMPLATE(BM_ContainsMany, workload::words)->Apply(dictionary_sizes);
+BENCHMARK_TEMPLATE(BM_ContainsMany, workload::urls)->Apply(trie_url_sizes);
+
+BENCHMARK_TEMPLATE(BM_TopCompletions, workload::words)->Apply(dictionary_sizes);
+BENCHMARK_TEMPLATE(BM_TopCompletionsScan, workload::words)->Apply(dictionary_sizes);
+BENCHMARK_TEMPLATE(BM_TopCompletions, workload::urls)->Apply(trie_url_sizes);
+BENCHMARK_TEMPLATE(BM_TopCompletionsScan, workload::urls)->Apply(trie_url_sizes);
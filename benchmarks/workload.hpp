@@ -0,0 +1,247 @@
+#ifndef BENCHMARKS_WORKLOAD_HPP
+#define BENCHMARKS_WORKLOAD_HPP
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+/**
+ * \brief Deterministic inputs shared by the benchmarks
+ *
+ * Everything is generated from fixed seeds, so results stay comparable
+ * across runs and machines.
+ */
+namespace workload {
+
+/**
+ * \brief Registers container sizes 1000, 10000, ... up to \p limit and BENCHMARK_MAX_SIZE
+ */
+inline void sizes(benchmark::internal::Benchmark* bench, std::int64_t limit) {
+    for (std::int64_t size = 1000; size <= limit && size <= BENCHMARK_MAX_SIZE; size *= 10)
+        bench->Arg(size);
+}
+
+inline void sizes(benchmark::internal::Benchmark* bench) {
+    sizes(bench, BENCHMARK_MAX_SIZE);
+}
+
+/**
+ * \brief The \p index-th distinct key of a random looking sequence
+ *
+ * Multiplying by an odd constant is a bijection on 32 bits, so different
+ * indices give different keys. Misses use indices past the stored keys.
+ */
+template<class Key>
+    Key key(std::uint64_t index);
+
+template<>
+    inline int key<int>(std::uint64_t index) {
+        return int(std::uint32_t(index * UINT64_C(2654435761)));
+    }
+
+template<>
+    inline std::string key<std::string>(std::uint64_t index) {
+        // 14 to 23 characters, like session identifiers
+        return "user:" + std::to_string(std::uint32_t(index * UINT64_C(2654435761))) + ":session";
+    }
+
+template<class Key>
+    std::vector<Key> keys(std::size_t count, std::uint64_t first = 0) {
+        std::vector<Key> result;
+        result.reserve(count);
+        for (std::size_t i = 0; i < count; i++)
+            result.push_back(key<Key>(first + i));
+        return result;
+    }
+
+/**
+ * \brief Lookup sequence of \p count keys, a \p hit_ratio of which are
+ * among the first \p size keys, in random order
+ */
+template<class Key>
+    std::vector<Key> lookups(std::size_t count, std::size_t size, double hit_ratio) {
+        std::mt19937_64 random(42);
+        std::uniform_int_distribution<std::uint64_t> stored(0, size - 1);
+        std::bernoulli_distribution hit(hit_ratio);
+        std::vector<Key> result;
+        result.reserve(count);
+        for (std::size_t i = 0; i < count; i++)
+            result.push_back(key<Key>(hit(random) ? stored(random) : size + stored(random)));
+        return result;
+    }
+
+/**
+ * \brief Mapped value of an element, whether iterators give pairs (standard
+ * containers) or values (RedBlackTree, BPlusTree)
+ */
+template<class Key, class Value>
+    const Value& value(const std::pair<Key, Value>& item) {
+        return item.second;
+    }
+
+template<class Value>
+    const Value& value(const Value& item) {
+        return item;
+    }
+
+/**
+ * \brief Container built by cached() and how it was built
+ */
+struct Cache {
+    std::shared_ptr<void> container;
+    std::size_t size = 0;
+    void (*builder)() = nullptr;
+};
+
+inline Cache& cache() {
+    static Cache cache;
+    return cache;
+}
+
+/**
+ * \brief Keeps the last built container, so the benchmark runs used by
+ * Google Benchmark to pick the iteration count don't rebuild it
+ *
+ * Only one container is kept at a time, even across types, to bound
+ * the memory used by the largest sizes.
+ */
+template<class Container>
+    Container& cached(std::size_t size, Container (*build)(std::size_t)) {
+        typedef void (*Builder)();
+        Cache& cache = workload::cache();
+        Builder builder = reinterpret_cast<Builder>(build);
+        if (!cache.container || cache.size != size || cache.builder != builder) {
+            cache.container.reset();
+            cache.container = std::make_shared<Container>(build(size));
+            cache.size = size;
+            cache.builder = builder;
+        }
+        return *static_cast<Container*>(cache.container.get());
+    }
+
+/**
+ * \brief Dictionary-like words: pronounceable, with shared prefixes and
+ * a realistic length distribution
+ */
+inline std::vector<std::string> words(std::size_t count) {
+    static const char* const syllables[] = {
+        "an", "be", "con", "de", "ex", "for", "ing", "in", "ly", "ment",
+        "na", "or", "pre", "pro", "re", "sta", "ter", "tion", "un", "ver",
+        "a", "e", "i", "o", "u", "st", "th", "ch", "qu", "er",
+    };
+    const std::size_t syllable_count = sizeof(syllables) / sizeof(syllables[0]);
+    std::mt19937 random(7);
+    std::uniform_int_distribution<int> length(1, 5);
+    std::vector<std::string> result;
+    result.reserve(count);
+    for (std::size_t i = 0; i < count; i++) {
+        std::string word;
+        for (int j = length(random); j > 0; j--)
+            word += syllables[random() % syllable_count];
+        // Keeps words distinct once the syllable combinations run out
+        word += std::to_string(i % 97);
+        if (i >= 97)
+            word += std::to_string(i / 97);
+        result.push_back(word);
+    }
+    return result;
+}
+
+/**
+ * \brief URLs of a web service: a few hosts and routes, so long shared
+ * prefixes, each ending with its own identifiers
+ */
+inline std::vector<std::string> urls(std::size_t count) {
+    static const char* const hosts[] = {
+        "https://api.example.com", "https://static.example.com",
+        "https://www.example.org", "http://internal.service.local:8080",
+    };
+    static const char* const routes[] = {
+        "/api/v1/users/", "/api/v2/orders/", "/static/assets/js/",
+        "/docs/reference/containers/", "/api/v1/search/results/",
+    };
+    static const char* const suffixes[] = {"", "/details", "/history/2016", "/settings/notifications"};
+    std::mt19937 random(13);
+    std::vector<std::string> result;
+    result.reserve(count);
+    for (std::size_t i = 0; i < count; i++) {
+        std::string url = hosts[random() % 4];
+        url += routes[random() % 5];
+        url += std::to_string(i * 7919 % (count * 4 + 1));
+        url += suffixes[random() % 4];
+        result.push_back(url);
+    }
+    return result;
+}
+
+/**
+ * \brief Lines looking like the ones of an HTTP service log
+ */
+inline std::vector<std::string> log_lines(std::size_t count) {
+    static const char* const levels[] = {"INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR"};
+    static const char* const components[] = {"http", "db_pool", "auth", "cache", "scheduler"};
+    static const char* const paths[] = {
+        "/api/v1/users/", "/api/v2/orders/", "/static/js/app.", "/health", "/api/v1/search?q=",
+    };
+    static const char* const messages[] = {
+        "request completed", "connection timeout after retry", "cache miss", "slow query",
+        "invalid token for user@example.com", "upstream returned 503",
+    };
+    std::mt19937 random(11);
+    std::vector<std::string> result;
+    result.reserve(count);
+    for (std::size_t i = 0; i < count; i++) {
+        std::string line = "2016-03-" + std::to_string(10 + random() % 20) + "T12:" +
+            std::to_string(10 + random() % 50) + ":" + std::to_string(10 + random() % 50) + " ";
+        line += levels[random() % 6];
+        line += " ";
+        line += components[random() % 5];
+        line += ": ";
+        line += messages[random() % 6];
+        line += " client=10.0." + std::to_string(random() % 256) + "." + std::to_string(random() % 256);
+        line += " GET ";
+        line += paths[random() % 5];
+        line += std::to_string(random() % 100000);
+        line += " latency=" + std::to_string(random() % 5000) + "ms user_id=" + std::to_string(random() % 1000000);
+        result.push_back(line);
+    }
+    return result;
+}
+
+/**
+ * \brief Patterns typical of log filtering rules, written in the syntax
+ * shared by SimpleParser and ECMAScript std::regex
+ */
+inline std::vector<std::string> log_patterns() {
+    return {
+        ".*ERROR.*timeout.*",
+        ".*client=10\\.0\\.[0-9]+\\.[0-9]+ .*",
+        ".*GET /api/v[0-9]+/users/[0-9]+ .*",
+        ".*(WARN|ERROR) [a-z_]+: .*",
+        ".*[a-z]+@[a-z]+\\.(com|org|net).*",
+        ".*latency=[0-9][0-9][0-9][0-9]ms.*",
+    };
+}
+
+/**
+ * \brief Same patterns as log_patterns() without the .* around them, for searching
+ */
+inline std::vector<std::string> search_patterns() {
+    return {
+        "ERROR.*timeout",
+        "client=10\\.0\\.[0-9]+\\.[0-9]+ ",
+        "GET /api/v[0-9]+/users/[0-9]+ ",
+        "(WARN|ERROR) [a-z_]+: ",
+        "[a-z]+@[a-z]+\\.(com|org|net)",
+        "latency=[0-9][0-9][0-9][0-9]ms",
+    };
+}
+
+} // namespace workload
+
+#endif // BENCHMARKS_WORKLOAD_HPP
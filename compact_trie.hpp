@@ -0,0 +1,485 @@
+#ifndef COMPACT_TRIE_HPP
+#define COMPACT_TRIE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Trie storing its nodes in flat arrays
+ *
+ * Same interface as Trie, laid out for memory use and lookup speed:
+ * nodes are 8 bytes in a single vector and refer to each other with 32-bit
+ * indices, without parent pointers. A single child, as in the long chains
+ * of suffixes, is stored in the node itself. Otherwise the children
+ * of a node are a block in a second array of 32-bit words:
+ *  - up to 16 children: their labels, sorted, then their indices
+ *  - more: a 256-bit bitmap of the labels, the number of children before
+ *    each 32-bit word of the bitmap, then the indices in label order,
+ *    so a child is found with a popcount.
+ *
+ * Blocks have power of two capacities and freed ones are reused for blocks
+ * of the same capacity, as are freed nodes.
+ */
+class CompactTrie {
+public:
+    typedef std::uint32_t index_type;
+
+    CompactTrie() {
+        clear();
+    }
+
+    /**
+     * \brief Removes all the words and releases the memory
+     */
+    void clear() {
+        std::vector<Node>().swap(nodes_);
+        std::vector<index_type>().swap(edges_);
+        nodes_.push_back(Node());
+        // Offset 0 is never handed out, it means "none" in the free lists
+        edges_.push_back(0);
+        for (index_type& head : free_blocks_)
+            head = 0;
+        free_nodes_ = 0;
+        node_count_ = 1;
+        size_ = 0;
+    }
+
+    /**
+     * \brief Add a new word to the trie
+     * \complexity O(word.size)
+     */
+    void insert(const std::string& word) {
+        index_type node = root;
+        for (unsigned char c : word) {
+            index_type child = find_child(nodes_[node], c);
+            if (!child) {
+                child = create_node();
+                add_child(node, c, child);
+            }
+            node = child;
+        }
+        if (!nodes_[node].marks_end) {
+            nodes_[node].marks_end = true;
+            size_++;
+        }
+    }
+
+    /**
+     * \brief Remove a word from the trie
+     * \complexity O(word.size)
+     */
+    void erase(const std::string& word) {
+        // Last edge on the path leaving a node needed by other words,
+        // what follows it only leads to this word
+        index_type cut_parent = root;
+        unsigned char cut_label = 0;
+        index_type node = root;
+        for (unsigned char c : word) {
+            const Node& current = nodes_[node];
+            if (node == root || current.marks_end || current.count > 1) {
+                cut_parent = node;
+                cut_label = c;
+            }
+            node = find_child(current, c);
+            if (!node)
+                return;
+        }
+
+        Node& target = nodes_[node];
+        if (!target.marks_end)
+            return;
+        target.marks_end = false;
+        size_--;
+        if (target.count || node == root)
+            return;
+
+        index_type chain = find_child(nodes_[cut_parent], cut_label);
+        remove_child(cut_parent, cut_label);
+        while (chain) {
+            Node& dangling = nodes_[chain];
+            index_type next = dangling.count ? child_at(dangling, 0) : 0;
+            destroy_node(chain);
+            chain = next;
+        }
+    }
+
+    /**
+     * \brief Check if a word exists
+     * \complexity O(word.size)
+     */
+    bool contains(const std::string& word) const {
+        index_type node = find(word);
+        return node != npos && nodes_[node].marks_end;
+    }
+
+    /**
+     * \brief Check if a prefix exists
+     * \complexity O(word.size)
+     */
+    bool contains_prefix(const std::string& word) const {
+        return find(word) != npos;
+    }
+
+    /**
+     * \brief Prints the tree tructure to stdout, children in label order
+     * \complexity O(n)
+     */
+    void print_structure() const {
+        print_structure_recursive(root, "");
+    }
+
+    /**
+     * \brief Number of words
+     * \complexity O(1)
+     */
+    int size() const {
+        return size_;
+    }
+
+    /**
+     * \brief Whether there are no words
+     * \complexity O(1)
+     */
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    /**
+     * \brief Number of nodes in use, including the root
+     * \complexity O(1)
+     */
+    std::size_t node_count() const {
+        return node_count_;
+    }
+
+    /**
+     * \brief Number of bytes reserved by the node and child arrays
+     * \complexity O(1)
+     */
+    std::size_t bytes_reserved() const {
+        return nodes_.capacity() * sizeof(Node) + edges_.capacity() * sizeof(index_type);
+    }
+
+private:
+    struct Node {
+        Node() : block(0), count(0), marks_end(false), block_class(no_block), label(0) {}
+
+        /**
+         * \brief Offset of the children block in edges_, the only child
+         * with a single_child block class, the next free node once destroyed
+         */
+        index_type block;
+        std::uint16_t count : 9;
+        std::uint16_t marks_end : 1;
+        std::uint8_t block_class;
+        /// Label of the only child with a single_child block class
+        unsigned char label;
+    };
+
+    static const index_type root = 0;
+    static const index_type npos = 0xFFFFFFFF;
+    static const std::uint8_t no_block = 0xFF;
+    static const std::uint8_t single_child = 0xFE;
+    /// Block classes 1 to 4 hold up to 1 << class sorted children, 0 is unused
+    static const unsigned max_sparse = 16;
+    /// Block classes 5 to 8 hold up to 32 << (class - 5) children behind a bitmap
+    static const unsigned dense_class = 5;
+    static const unsigned class_count = 9;
+    /// Bitmap words and the 8 bytes counting the children before each of them
+    static const unsigned dense_header = 10;
+    /// Dense nodes shrinking to this many children become sparse again
+    static const unsigned shrink_count = 8;
+
+    static bool has_block(unsigned block_class) {
+        return block_class < class_count;
+    }
+
+    static bool is_dense(unsigned block_class) {
+        return block_class >= dense_class && block_class < class_count;
+    }
+
+    static unsigned capacity(unsigned block_class) {
+        return block_class < dense_class ? 1u << block_class : 32u << (block_class - dense_class);
+    }
+
+    static unsigned label_words(unsigned capacity) {
+        return (capacity + 3) / 4;
+    }
+
+    static unsigned block_words(unsigned block_class) {
+        unsigned size = capacity(block_class);
+        return block_class < dense_class ? label_words(size) + size : dense_header + size;
+    }
+
+    /**
+     * \brief Smallest class holding \p count children
+     */
+    static unsigned class_for(unsigned count) {
+        if (count == 1)
+            return single_child;
+        unsigned block_class = count <= max_sparse ? 1 : dense_class;
+        while (capacity(block_class) < count)
+            block_class++;
+        return block_class;
+    }
+
+    static unsigned popcount(std::uint32_t bits) {
+#ifdef __GNUC__
+        return __builtin_popcount(bits);
+#else
+        unsigned count = 0;
+        for (; bits; bits &= bits - 1)
+            count++;
+        return count;
+#endif
+    }
+
+    /**
+     * \brief Node reached by following \p word from the root, npos if none
+     */
+    index_type find(const std::string& word) const {
+        index_type node = root;
+        for (unsigned char c : word) {
+            node = find_child(nodes_[node], c);
+            if (!node)
+                return npos;
+        }
+        return node;
+    }
+
+    /**
+     * \brief Child of \p node labeled \p c, 0 (the root) if none
+     * \complexity O(1) for dense nodes, O(children) otherwise
+     */
+    index_type find_child(const Node& node, unsigned char c) const {
+        if (node.block_class == single_child)
+            return node.label == c ? node.block : 0;
+        const index_type* block = edges_.data() + node.block;
+        if (is_dense(node.block_class)) {
+            index_type bits = block[c >> 5];
+            index_type bit = index_type(1) << (c & 31);
+            if (!(bits & bit))
+                return 0;
+            unsigned before = reinterpret_cast<const unsigned char*>(block + 8)[c >> 5];
+            return block[dense_header + before + popcount(bits & (bit - 1))];
+        }
+        const unsigned char* labels = reinterpret_cast<const unsigned char*>(block);
+        for (unsigned i = 0; i < node.count; i++) {
+            if (labels[i] == c)
+                return block[label_words(capacity(node.block_class)) + i];
+            if (labels[i] > c)
+                break;
+        }
+        return 0;
+    }
+
+    /**
+     * \brief Index of the \p i-th child of \p node in label order
+     */
+    index_type child_at(const Node& node, unsigned i) const {
+        if (node.block_class == single_child)
+            return node.block;
+        unsigned offset = is_dense(node.block_class) ? dense_header
+                                                     : label_words(capacity(node.block_class));
+        return edges_[node.block + offset + i];
+    }
+
+    /**
+     * \brief Copies the labels and children of \p node, in label order
+     */
+    void gather(const Node& node, unsigned char* labels, index_type* children) const {
+        if (!node.count)
+            return;
+        if (node.block_class == single_child) {
+            labels[0] = node.label;
+            children[0] = node.block;
+            return;
+        }
+        const index_type* block = edges_.data() + node.block;
+        if (is_dense(node.block_class)) {
+            unsigned count = 0;
+            for (unsigned c = 0; c < 256; c++)
+                if (block[c >> 5] & (index_type(1) << (c & 31)))
+                    labels[count++] = c;
+        } else {
+            const unsigned char* sorted = reinterpret_cast<const unsigned char*>(block);
+            std::copy(sorted, sorted + node.count, labels);
+        }
+        for (unsigned i = 0; i < node.count; i++)
+            children[i] = child_at(node, i);
+    }
+
+    /**
+     * \brief Stores sorted labels and their children as the children of \p node,
+     * moving them to a block of class \p block_class
+     * \pre \p block_class is no_block without children and single_child with one
+     */
+    void scatter(index_type node, unsigned block_class,
+                 const unsigned char* labels, const index_type* children, unsigned count) {
+        if (nodes_[node].block_class != block_class) {
+            // Allocated first: growing edges_ doesn't touch nodes_
+            index_type block = has_block(block_class) ? allocate_block(block_class) : 0;
+            Node& changed = nodes_[node];
+            if (has_block(changed.block_class))
+                free_block(changed.block, changed.block_class);
+            changed.block = block;
+            changed.block_class = block_class;
+        }
+        Node& target = nodes_[node];
+        target.count = count;
+        if (block_class == single_child) {
+            target.label = labels[0];
+            target.block = children[0];
+            return;
+        }
+        if (!count)
+            return;
+
+        index_type* block = edges_.data() + target.block;
+        if (is_dense(block_class)) {
+            std::fill(block, block + dense_header, 0);
+            for (unsigned i = 0; i < count; i++)
+                block[labels[i] >> 5] |= index_type(1) << (labels[i] & 31);
+            unsigned char* before = reinterpret_cast<unsigned char*>(block + 8);
+            for (unsigned word = 1; word < 8; word++)
+                before[word] = before[word - 1] + popcount(block[word - 1]);
+            std::copy(children, children + count, block + dense_header);
+        } else {
+            std::copy(labels, labels + count, reinterpret_cast<unsigned char*>(block));
+            std::copy(children, children + count, block + label_words(capacity(block_class)));
+        }
+    }
+
+    /**
+     * \brief Adds \p child as the child of \p node with label \p c
+     * \pre \p node has no child labeled \p c
+     * \complexity O(children)
+     */
+    void add_child(index_type node, unsigned char c, index_type child) {
+        Node& parent = nodes_[node];
+        unsigned count = parent.count;
+
+        // Sparse blocks with room left are updated in place
+        if (has_block(parent.block_class) && !is_dense(parent.block_class) &&
+                count < capacity(parent.block_class)) {
+            index_type* block = edges_.data() + parent.block;
+            unsigned char* labels = reinterpret_cast<unsigned char*>(block);
+            index_type* children = block + label_words(capacity(parent.block_class));
+            unsigned i = count;
+            for (; i > 0 && labels[i - 1] > c; i--) {
+                labels[i] = labels[i - 1];
+                children[i] = children[i - 1];
+            }
+            labels[i] = c;
+            children[i] = child;
+            parent.count++;
+            return;
+        }
+
+        unsigned char labels[256];
+        index_type children[256];
+        gather(parent, labels, children);
+        unsigned i = count;
+        for (; i > 0 && labels[i - 1] > c; i--) {
+            labels[i] = labels[i - 1];
+            children[i] = children[i - 1];
+        }
+        labels[i] = c;
+        children[i] = child;
+        unsigned block_class = has_block(parent.block_class) && count < capacity(parent.block_class)
+            ? parent.block_class : class_for(count + 1);
+        scatter(node, block_class, labels, children, count + 1);
+    }
+
+    /**
+     * \brief Removes the child of \p node labeled \p c, without destroying it
+     * \complexity O(children)
+     */
+    void remove_child(index_type node, unsigned char c) {
+        Node& parent = nodes_[node];
+        unsigned char labels[256];
+        index_type children[256];
+        gather(parent, labels, children);
+        unsigned count = parent.count;
+        unsigned i = 0;
+        while (labels[i] != c)
+            i++;
+        for (count--; i < count; i++) {
+            labels[i] = labels[i + 1];
+            children[i] = children[i + 1];
+        }
+        unsigned block_class = parent.block_class;
+        if (count <= 1 || (is_dense(block_class) && count <= shrink_count))
+            block_class = count ? class_for(count) : no_block;
+        scatter(node, block_class, labels, children, count);
+    }
+
+    index_type allocate_block(unsigned block_class) {
+        index_type block = free_blocks_[block_class];
+        if (block) {
+            free_blocks_[block_class] = edges_[block];
+            return block;
+        }
+        block = edges_.size();
+        edges_.resize(edges_.size() + block_words(block_class));
+        return block;
+    }
+
+    void free_block(index_type block, unsigned block_class) {
+        edges_[block] = free_blocks_[block_class];
+        free_blocks_[block_class] = block;
+    }
+
+    index_type create_node() {
+        node_count_++;
+        if (free_nodes_) {
+            index_type node = free_nodes_;
+            free_nodes_ = nodes_[node].block;
+            nodes_[node] = Node();
+            return node;
+        }
+        nodes_.push_back(Node());
+        return nodes_.size() - 1;
+    }
+
+    /**
+     * \brief Recycles \p node and its children block, but not its children
+     */
+    void destroy_node(index_type node) {
+        Node& dead = nodes_[node];
+        if (has_block(dead.block_class))
+            free_block(dead.block, dead.block_class);
+        dead = Node();
+        dead.block = free_nodes_;
+        free_nodes_ = node;
+        node_count_--;
+    }
+
+    /**
+     * \brief Recursively prints a sub-tree
+     * \complexity O(n)
+     */
+    void print_structure_recursive(index_type node, const std::string& prefix) const {
+        const Node& current = nodes_[node];
+        std::cout << prefix << (current.marks_end ? " *" : "") << '\n';
+        unsigned char labels[256];
+        index_type children[256];
+        gather(current, labels, children);
+        for (unsigned i = 0; i < current.count; i++)
+            print_structure_recursive(children[i], prefix + char(labels[i]));
+    }
+
+    std::vector<Node> nodes_;
+    std::vector<index_type> edges_;
+    index_type free_blocks_[class_count];
+    /// Head of the list of destroyed nodes, 0 if empty
+    index_type free_nodes_;
+    std::size_t node_count_;
+    int size_;
+};
+
+#endif // COMPACT_TRIE_HPP
@@ -0,0 +1,338 @@
+#ifndef CONCURRENT_HASH_TABLE_HPP
+#define CONCURRENT_HASH_TABLE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "hash_table.hpp"
+
+/**
+ * \brief Reader-writer spin lock, waiting writers keep out new readers
+ *
+ * Meant for short critical sections, it can be used with std::lock_guard
+ * (exclusive) and SharedSpinLock::SharedGuard.
+ */
+class SharedSpinLock {
+public:
+    /**
+     * \brief Locks the shared part for the lifetime of the object
+     */
+    class SharedGuard {
+    public:
+        explicit SharedGuard(SharedSpinLock& lock) : lock_(lock) { lock_.lock_shared(); }
+        SharedGuard(const SharedGuard&) = delete;
+        SharedGuard& operator=(const SharedGuard&) = delete;
+        ~SharedGuard() { lock_.unlock_shared(); }
+    private:
+        SharedSpinLock& lock_;
+    };
+
+    SharedSpinLock() : state(0) {}
+    SharedSpinLock(const SharedSpinLock&) = delete;
+    SharedSpinLock& operator=(const SharedSpinLock&) = delete;
+
+    void lock() {
+        // Claims the writer bit, then waits for the readers to leave
+        for (int spins = 0; ; spins++) {
+            unsigned current = state.load(std::memory_order_relaxed);
+            if (!(current & writer) &&
+                    state.compare_exchange_weak(current, current | writer, std::memory_order_acquire))
+                break;
+            pause(spins);
+        }
+        for (int spins = 0; state.load(std::memory_order_acquire) != writer; spins++)
+            pause(spins);
+    }
+
+    void unlock() {
+        state.store(0, std::memory_order_release);
+    }
+
+    void lock_shared() {
+        for (int spins = 0; ; spins++) {
+            unsigned current = state.load(std::memory_order_relaxed);
+            if (!(current & writer) &&
+                    state.compare_exchange_weak(current, current + 1, std::memory_order_acquire))
+                break;
+            pause(spins);
+        }
+    }
+
+    void unlock_shared() {
+        state.fetch_sub(1, std::memory_order_release);
+    }
+
+private:
+    static const unsigned writer = 1u << 31;
+
+    static void pause(int spins) {
+        if (spins > 64)
+            std::this_thread::yield();
+    }
+
+    /// Writer bit and number of readers
+    std::atomic<unsigned> state;
+};
+
+/**
+ * \brief Thread-safe hash table made of independently locked HashTable shards
+ *
+ * Each key belongs to a single shard, so operations on different shards
+ * don't contend and lookups on the same shard can run in parallel.
+ * As references can't outlive the lock, values are returned by copy or
+ * passed to a function while the shard is locked.
+ */
+template <class Key, class Value, class Hash = std::hash<Key>, class KeyEqual = std::equal_to<Key>>
+class ConcurrentHashTable {
+public:
+    typedef Key                                 key_type;
+    typedef Value                               value_type;
+    typedef std::pair<Key,Value>                item_type;
+    typedef HashTable<Key,Value,Hash,KeyEqual>  table_type;
+    typedef std::size_t                         hash_type;
+
+    /**
+     * \param shards Number of shards, rounded up to a power of 2
+     * \param buckets Initial number of buckets of each shard
+     */
+    explicit ConcurrentHashTable(int shards = 16, int buckets = 16,
+                                 const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual())
+        : hasher_(hash) {
+        int count = 1;
+        shift_ = 64;
+        while (count < shards) {
+            count *= 2;
+            shift_--;
+        }
+        shards_.reserve(count);
+        for (int i = 0; i < count; i++)
+            shards_.push_back(std::unique_ptr<Shard>(new Shard(buckets, hash, equal)));
+    }
+
+    ConcurrentHashTable(const ConcurrentHashTable&) = delete;
+    ConcurrentHashTable& operator=(const ConcurrentHashTable&) = delete;
+
+    /**
+     * \brief Copies the value for \p key into \p value
+     * \return Whether the key has been found
+     * \complexity Shared lock on a shard. Average: O(1)
+     */
+    bool find(const Key& key, Value& value) const {
+        return visit(key, [&value](const Value& found) { value = found; });
+    }
+
+    /**
+     * \brief Whether \p key is in the table
+     * \complexity Shared lock on a shard. Average: O(1)
+     */
+    bool contains(const Key& key) const {
+        return visit(key, [](const Value&) {});
+    }
+
+    /**
+     * \brief Calls \p func with the value for \p key, under a shared lock
+     * \return Whether the key has been found
+     * \complexity Shared lock on a shard. Average: O(1)
+     */
+    template<class Func>
+        bool visit(const Key& key, const Func& func) const {
+            const Shard& shard = shard_for(key);
+            SharedSpinLock::SharedGuard guard(shard.lock);
+            auto iter = shard.table.find(key);
+            if (iter == shard.table.end())
+                return false;
+            func(iter->second);
+            return true;
+        }
+
+    /**
+     * \brief Insert a new item or assign if the key exists
+     * \return Whether the key has been inserted
+     * \complexity Exclusive lock on a shard. Average: O(1)
+     */
+    template<class V>
+        bool insert_or_assign(const Key& key, V&& value) {
+            Shard& shard = shard_for(key);
+            std::lock_guard<SharedSpinLock> guard(shard.lock);
+            int size = shard.table.size();
+            shard.table.insert_or_assign(key, std::forward<V>(value));
+            return shard.table.size() != size;
+        }
+
+    /**
+     * \brief Insert an item unless the key exists
+     * \return Whether the key has been inserted
+     * \complexity Exclusive lock on a shard. Average: O(1)
+     */
+    template<class... Args>
+        bool try_emplace(const Key& key, Args&&... args) {
+            Shard& shard = shard_for(key);
+            std::lock_guard<SharedSpinLock> guard(shard.lock);
+            return shard.table.try_emplace(key, std::forward<Args>(args)...).second;
+        }
+
+    /**
+     * \brief Returns the value for \p key, inserting the result of \p compute if absent
+     *
+     * \p compute is called at most once per key, while the shard is locked,
+     * so it must not access the table.
+     * \complexity Shared lock on a shard if the key exists, exclusive lock otherwise. Average: O(1)
+     */
+    template<class Func>
+        Value compute_if_absent(const Key& key, const Func& compute) {
+            Shard& shard = shard_for(key);
+            {
+                SharedSpinLock::SharedGuard guard(shard.lock);
+                auto iter = shard.table.find(key);
+                if (iter != shard.table.end())
+                    return iter->second;
+            }
+
+            std::lock_guard<SharedSpinLock> guard(shard.lock);
+            // Another thread might have inserted it in the meantime
+            auto iter = shard.table.find(key);
+            if (iter == shard.table.end())
+                iter = shard.table.insert(key, compute());
+            return iter->second;
+        }
+
+    /**
+     * \brief Calls \p func on the value for \p key, under an exclusive lock
+     * \return Whether the key has been found
+     * \complexity Exclusive lock on a shard. Average: O(1)
+     */
+    template<class Func>
+        bool update(const Key& key, const Func& func) {
+            Shard& shard = shard_for(key);
+            std::lock_guard<SharedSpinLock> guard(shard.lock);
+            auto iter = shard.table.find(key);
+            if (iter == shard.table.end())
+                return false;
+            func(iter->second);
+            return true;
+        }
+
+    /**
+     * \brief Erase the item with the given key
+     * \return Whether the key has been found
+     * \complexity Exclusive lock on a shard. Average: O(1)
+     */
+    bool erase(const Key& key) {
+        Shard& shard = shard_for(key);
+        std::lock_guard<SharedSpinLock> guard(shard.lock);
+        int size = shard.table.size();
+        shard.table.erase(key);
+        return shard.table.size() != size;
+    }
+
+    /**
+     * \brief Copies all the items
+     *
+     * Each shard is copied atomically, but other threads can modify
+     * a shard after it has been copied and before the next one is.
+     * \complexity Shared lock on each shard in turn. O(n+m)
+     */
+    std::vector<item_type> snapshot() const {
+        std::vector<item_type> items;
+        for (const auto& shard : shards_) {
+            SharedSpinLock::SharedGuard guard(shard->lock);
+            for (const item_type& item : shard->table)
+                items.push_back(item);
+        }
+        return items;
+    }
+
+    /**
+     * \brief Calls \p func on every item, with the same consistency as snapshot()
+     * \note \p func must not access the table
+     * \complexity Shared lock on each shard in turn. O(n+m)
+     */
+    template<class Func>
+        void for_each(const Func& func) const {
+            for (const auto& shard : shards_) {
+                SharedSpinLock::SharedGuard guard(shard->lock);
+                for (const item_type& item : shard->table)
+                    func(item);
+            }
+        }
+
+    /**
+     * \brief Removes all the items
+     * \complexity Exclusive lock on each shard in turn. O(n+m)
+     */
+    void clear() {
+        for (const auto& shard : shards_) {
+            std::lock_guard<SharedSpinLock> guard(shard->lock);
+            shard->table = table_type(shard->table.bucket_count(),
+                                      shard->table.hash_function(), shard->table.key_eq());
+        }
+    }
+
+    /**
+     * \brief Makes room for \p count elements, spread across the shards
+     * \complexity Exclusive lock on each shard in turn
+     */
+    void reserve(int count) {
+        int per_shard = (count + shard_count() - 1) / shard_count();
+        for (const auto& shard : shards_) {
+            std::lock_guard<SharedSpinLock> guard(shard->lock);
+            shard->table.reserve(per_shard);
+        }
+    }
+
+    /**
+     * \brief Number of elements (only exact if no other thread modifies the table)
+     * \complexity Shared lock on each shard in turn. O(shards)
+     */
+    int size() const {
+        int size = 0;
+        for (const auto& shard : shards_) {
+            SharedSpinLock::SharedGuard guard(shard->lock);
+            size += shard->table.size();
+        }
+        return size;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    int shard_count() const {
+        return shards_.size();
+    }
+
+private:
+    struct Shard {
+        Shard(int buckets, const Hash& hash, const KeyEqual& equal)
+            : table(buckets, hash, equal) {}
+
+        mutable SharedSpinLock lock;
+        table_type table;
+        /// Keeps shards on different cache lines
+        char padding[64];
+    };
+
+    /**
+     * \brief Shard owning \p key
+     *
+     * Uses the high bits of a multiplicative hash, so the choice doesn't
+     * correlate with the bucket index within the shard.
+     */
+    Shard& shard_for(const Key& key) const {
+        std::uint64_t mixed = std::uint64_t(hasher_(key)) * UINT64_C(0xC2B2AE3D27D4EB4F);
+        return *shards_[shift_ == 64 ? 0 : mixed >> shift_];
+    }
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    /// 64 - log2(number of shards)
+    int shift_;
+    Hash hasher_;
+};
+
+#endif // CONCURRENT_HASH_TABLE_HPP
@@ -0,0 +1,909 @@
+#ifndef FLAT_HASH_TABLE_HPP
+#define FLAT_HASH_TABLE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+
+/**
+ * \brief Open-addressing hash table with the same interface as HashTable
+ *
+ * Items are stored in a flat array of slots, each slot has a control byte
+ * which tells whether it's empty, deleted or full and in the latter case
+ * it holds 7 bits of the hash. Lookups compare the control bytes of a group
+ * of slots at once and only look at the keys whose bits match.
+ *
+ * Inserting might move all the items, invalidating iterators and references.
+ */
+template <class Key, class Value, class Hash = std::hash<Key>, class KeyEqual = std::equal_to<Key>>
+class FlatHashTable {
+public:
+    typedef Key                  key_type;
+    typedef Value                value_type;
+    typedef std::pair<Key,Value> item_type;
+    typedef std::size_t          hash_type;
+    typedef Hash                 hasher;
+    typedef KeyEqual             key_equal;
+
+    template<bool Const>
+    class iterator_base {
+    public:
+        typedef typename std::conditional<Const,const FlatHashTable*,FlatHashTable*>::type
+            table_pointer;
+        typedef typename std::conditional<Const,const item_type&,item_type&>::type
+            reference_type;
+        typedef typename std::conditional<Const,const item_type*,item_type*>::type
+            pointer_type;
+
+        iterator_base() : table(nullptr), index(0) {}
+
+        /**
+         * \brief Move the iterator to the next element
+         */
+        iterator_base& operator++() {
+            if (table && index < table->capacity_)
+                index = table->next_full(index + 1);
+            return *this;
+        }
+
+        /**
+         * \brief Move the iterator to the previous element
+         */
+        iterator_base& operator--() {
+            if (table) {
+                std::size_t previous = index;
+                while (previous > 0) {
+                    --previous;
+                    if (is_full(table->control_[previous])) {
+                        index = previous;
+                        break;
+                    }
+                }
+            }
+            return *this;
+        }
+        iterator_base operator++ (int) {
+            iterator_base copy = *this;
+            ++*this;
+            return copy;
+        }
+        iterator_base operator-- (int) {
+            iterator_base copy = *this;
+            --*this;
+            return copy;
+        }
+
+        /**
+         * \brief Get reference to the pair
+         */
+        reference_type operator* () const {
+            return *operator->();
+        }
+
+        /**
+         * \brief Get pointer to the pair
+         */
+        pointer_type operator-> () const {
+            if (table && index < table->capacity_)
+                return &table->slot(index);
+            return nullptr;
+        }
+
+        bool operator== (const iterator_base& other) const {
+            return table == other.table && index == other.index;
+        }
+
+        bool operator!= (const iterator_base& other) const {
+            return ! (*this == other);
+        }
+
+    private:
+        iterator_base(table_pointer table, std::size_t index)
+            : table(table), index(index) {}
+
+        table_pointer table;
+        std::size_t   index;
+
+        friend class FlatHashTable;
+    };
+    typedef iterator_base<false> iterator;
+    typedef iterator_base<true>  const_iterator;
+
+    /**
+     * \param capacity Initial number of slots, rounded up to a power of 2
+     */
+    explicit FlatHashTable(int capacity=16, const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual())
+        : hasher_(hash), key_equal_(equal) {
+        std::size_t slots = group_width;
+        while (slots < std::size_t(capacity))
+            slots *= 2;
+        allocate(slots);
+    }
+
+    /**
+     * \brief Builds the table from a range of items, sizing it only once
+     *
+     * The order of the items doesn't matter, for duplicate keys the last
+     * value is kept.
+     * \complexity O(n)
+     */
+    template<class ForwardIterator,
+             class = typename std::iterator_traits<ForwardIterator>::iterator_category>
+        FlatHashTable(ForwardIterator first, ForwardIterator last,
+                      const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual())
+            : hasher_(hash), key_equal_(equal) {
+            insert_batch(first, last);
+        }
+
+    FlatHashTable(const FlatHashTable& other)
+        : hasher_(other.hasher_), key_equal_(other.key_equal_) {
+        max_load_factor_ = other.max_load_factor_;
+        allocate(other.capacity_);
+        for (std::size_t i = 0; i < other.capacity_; i++)
+            if (is_full(other.control_[i]))
+                new (&slots_[i]) item_type(other.slot(i));
+        // Keeps the tombstones, as probe sequences go through them
+        control_ = other.control_;
+        size_ = other.size_;
+        growth_left_ = other.growth_left_;
+    }
+
+    FlatHashTable(FlatHashTable&& other) {
+        swap(other);
+    }
+
+    FlatHashTable& operator= (FlatHashTable other) {
+        swap(other);
+        return *this;
+    }
+
+    ~FlatHashTable() {
+        clear_slots();
+    }
+
+    void swap(FlatHashTable& other) {
+        std::swap(control_, other.control_);
+        std::swap(slots_, other.slots_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(size_, other.size_);
+        std::swap(growth_left_, other.growth_left_);
+        std::swap(max_load_factor_, other.max_load_factor_);
+        std::swap(hasher_, other.hasher_);
+        std::swap(key_equal_, other.key_equal_);
+    }
+
+    /**
+     * \brief Insert a new item or assign if the key exists
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    template<class V>
+        iterator insert_or_assign (const Key& key, V&& value) {
+            return assign(key, std::forward<V>(value));
+        }
+
+    /**
+     * \brief Insert a new item or assign if the key exists, moving the key
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    template<class V>
+        iterator insert_or_assign (Key&& key, V&& value) {
+            return assign(std::move(key), std::forward<V>(value));
+        }
+
+    /**
+     * \brief Insert a new item (might cause duplicate entries)
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    template<class V>
+        iterator insert (const Key& key, V&& value) {
+            std::size_t index = prepare_insert(hash_key(key));
+            construct(index, key, std::forward<V>(value));
+            return iterator(this, index);
+        }
+
+    /**
+     * \brief Insert a new item (might cause duplicate entries), moving the key
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    template<class V>
+        iterator insert (Key&& key, V&& value) {
+            std::size_t index = prepare_insert(hash_key(key));
+            construct(index, std::move(key), std::forward<V>(value));
+            return iterator(this, index);
+        }
+
+    /**
+     * \brief Insert an item constructed from \p args unless its key exists
+     * \return The item with that key and whether it has been inserted
+     * \note The item is always constructed, to find out its key
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    template<class... Args>
+        std::pair<iterator, bool> emplace(Args&&... args) {
+            item_type item(std::forward<Args>(args)...);
+            hash_type hash = hash_key(item.first);
+            std::size_t index = find_index(item.first, hash);
+            if (index != capacity_)
+                return std::make_pair(iterator(this, index), false);
+            index = prepare_insert(hash);
+            construct(index, std::move(item));
+            return std::make_pair(iterator(this, index), true);
+        }
+
+    /**
+     * \brief If \p key doesn't exist, insert it with a value constructed from \p args
+     * \return The item with that key and whether it has been inserted
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    template<class... Args>
+        std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+            return emplace_key(key, std::forward<Args>(args)...);
+        }
+
+    /**
+     * \brief If \p key doesn't exist, insert it with a value constructed from \p args
+     * \return The item with that key and whether it has been inserted
+     * \note \p key is only moved from if it gets inserted
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    template<class... Args>
+        std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args) {
+            return emplace_key(std::move(key), std::forward<Args>(args)...);
+        }
+
+    /**
+     * \brief Erase an existing item (one of them if multiple items with the same key exist)
+     * \return Iterator to the element following the erased one
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    iterator erase (const Key& key) {
+        return erase(find(key));
+    }
+
+    /**
+     * \brief Erase an existing item with a key comparable to key_type
+     * \note Only available when Hash and KeyEqual define is_transparent
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    template<class K, class H = Hash, class = typename H::is_transparent,
+             class E = KeyEqual, class = typename E::is_transparent>
+        iterator erase (const K& key) {
+            return erase(find(key));
+        }
+
+    /**
+     * \brief Erase by iterator
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    iterator erase (iterator it) {
+        if (it == end() || it.table != this)
+            return end();
+        erase_slot(it.index);
+        return iterator(this, next_full(it.index + 1));
+    }
+
+    /**
+     * \brief Find an element
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    iterator find(const Key& key) {
+        return iterator(this, find_index(key, hash_key(key)));
+    }
+
+    /**
+     * \brief Find an element
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    const_iterator find(const Key& key) const {
+        return const_iterator(this, find_index(key, hash_key(key)));
+    }
+
+    /**
+     * \brief Find an element with a key comparable to key_type, without converting it
+     * \note Only available when Hash and KeyEqual define is_transparent
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    template<class K, class H = Hash, class = typename H::is_transparent,
+             class E = KeyEqual, class = typename E::is_transparent>
+        iterator find(const K& key) {
+            return iterator(this, find_index(key, hash_key(key)));
+        }
+
+    /**
+     * \brief Find an element with a key comparable to key_type, without converting it
+     * \note Only available when Hash and KeyEqual define is_transparent
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    template<class K, class H = Hash, class = typename H::is_transparent,
+             class E = KeyEqual, class = typename E::is_transparent>
+        const_iterator find(const K& key) const {
+            return const_iterator(this, find_index(key, hash_key(key)));
+        }
+
+    /**
+     * \brief Get reference to given value (inserted with default-constructed value if not present)
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    value_type& operator[] (const Key& key) {
+        return try_emplace(key).first->second;
+    }
+
+    /**
+     * \brief Get reference to given value (inserted with default-constructed value if not present)
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    value_type& operator[] (Key&& key) {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    /**
+     * \brief Finds all the keys in [first, last), writing an iterator for
+     * each of them to \p out (end() for the missing ones)
+     *
+     * The slots where the probes of the following keys start are prefetched
+     * while looking up a key, so the cache misses of many lookups overlap
+     * instead of happening one after the other.
+     * \return The output iterator past the last written value
+     * \complexity Average: O(k) where k is the number of keys
+     */
+    template<class KeyIterator, class OutputIterator>
+        OutputIterator find_batch(KeyIterator first, KeyIterator last, OutputIterator out) {
+            typedef typename std::iterator_traits<KeyIterator>::reference reference;
+            pipeline(first, last,
+                [this](reference key) { return hash_key(key); },
+                [this, &out](reference key, hash_type hash) { *out++ = iterator(this, find_index(key, hash)); });
+            return out;
+        }
+
+    /**
+     * \brief Calls insert_or_assign() for all the items in [first, last)
+     *
+     * The table is grown once upfront, then items are inserted prefetching
+     * their slots like find_batch().
+     * \complexity Average: O(k) where k is the number of items
+     */
+    template<class ForwardIterator>
+        void insert_batch(ForwardIterator first, ForwardIterator last) {
+            typedef typename std::iterator_traits<ForwardIterator>::reference reference;
+            reserve(size_ + std::distance(first, last));
+            pipeline(first, last,
+                [this](reference item) { return hash_key(item.first); },
+                [this](reference item, hash_type hash) { assign_hashed(hash, item.first, item.second); });
+        }
+
+    /**
+     * \brief Print the slots to stdout
+     * \complexity O(m) (m = # of slots)
+     */
+    void print_structure() const {
+        for (std::size_t i = 0; i < capacity_; i++) {
+            std::cout << i << ":";
+            if (is_full(control_[i]))
+                std::cout << " (" << slot(i).first << "," << slot(i).second << ")";
+            else if (control_[i] == deleted_control)
+                std::cout << " deleted";
+            std::cout << "\n";
+        }
+    }
+
+    /**
+     * \brief Get iterator to the first element
+     * \complexity Worst: O(m) (m = # of slots) Best: O(1)
+     */
+    iterator begin() {
+        return iterator(this, next_full(0));
+    }
+    /**
+     * \brief Get iterator to past-the-last element
+     * \complexity O(1)
+     */
+    iterator end() {
+        return iterator(this, capacity_);
+    }
+
+    /**
+     * \brief Get iterator to the first element
+     * \complexity Worst: O(m) (m = # of slots) Best: O(1)
+     */
+    const_iterator begin() const {
+        return const_iterator(this, next_full(0));
+    }
+    /**
+     * \brief Get iterator to past-the-last element
+     * \complexity O(1)
+     */
+    const_iterator end() const {
+        return const_iterator(this, capacity_);
+    }
+
+    /**
+     * \brief Get iterator to the first element
+     * \complexity Worst: O(m) (m = # of slots) Best: O(1)
+     */
+    const_iterator cbegin() const {
+        return begin();
+    }
+    /**
+     * \brief Get iterator to past-the-last element
+     * \complexity O(1)
+     */
+    const_iterator cend() const {
+        return end();
+    }
+
+    /**
+     * \brief Number of elements
+     * \complexity O(1)
+     */
+    int size() const {
+        return size_;
+    }
+
+    /**
+     * \brief Whether the table is empty
+     * \complexity O(1)
+     */
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    /**
+     * \brief Number of slots
+     * \complexity O(1)
+     */
+    int bucket_count() const {
+        return capacity_;
+    }
+
+    /**
+     * \brief Fraction of the slots which are full
+     * \complexity O(1)
+     */
+    float load_factor() const {
+        return capacity_ ? float(size_) / capacity_ : 0;
+    }
+
+    /**
+     * \brief Load factor above which the number of slots is doubled
+     * \complexity O(1)
+     */
+    float max_load_factor() const {
+        return max_load_factor_;
+    }
+
+    /**
+     * \brief Sets the maximum load factor and rehashes
+     *
+     * Values above 7/8 are lowered to 7/8, as probing relies on empty slots,
+     * and values below 1/16 are raised to 1/16, which bounds the number of
+     * slots. A factor which isn't positive, or NaN, is ignored.
+     * \pre factor > 0
+     * \complexity O(m) (m = # of slots)
+     */
+    void max_load_factor(float factor) {
+        if (!(factor > 0))
+            return;
+        max_load_factor_ = std::max(std::min(factor, default_max_load_factor), lowest_max_load_factor);
+        resize(std::max(capacity_, capacity_for(size_)));
+    }
+
+    /**
+     * \brief Sets the number of slots to \p slots (rounded up to a power of 2)
+     * or to the minimum which respects max_load_factor(), whichever is greater
+     *
+     * Also clears all the tombstones left by erased items.
+     * \complexity O(m) (m = # of slots)
+     */
+    void rehash(int slots) {
+        std::size_t capacity = capacity_for(size_);
+        while (capacity < std::size_t(slots))
+            capacity *= 2;
+        resize(capacity);
+    }
+
+    /**
+     * \brief Makes room for \p count elements without exceeding max_load_factor()
+     * \complexity O(m) if rehashing, O(1) otherwise
+     */
+    void reserve(int count) {
+        std::size_t capacity = capacity_for(count);
+        if (capacity > capacity_)
+            resize(capacity);
+    }
+
+    hasher hash_function() const {
+        return hasher_;
+    }
+
+    key_equal key_eq() const {
+        return key_equal_;
+    }
+
+private:
+    typedef typename std::aligned_storage<sizeof(item_type), alignof(item_type)>::type
+        slot_type;
+
+    /// Prefetch distance of the batch functions, in keys
+    static const std::size_t batch_size = 16;
+    /// Number of control bytes compared at once
+    static const std::size_t group_width = 16;
+    static constexpr float default_max_load_factor = 0.875;
+    /// Lower bound of max_load_factor()
+    static constexpr float lowest_max_load_factor = 0.0625;
+    /// Control bytes of the slots which aren't full, they have the high bit set
+    static const signed char empty_control = -128;
+    static const signed char deleted_control = -2;
+
+    /**
+     * \brief Bit masks of the slots in a group with a given control byte
+     *
+     * Bit i corresponds to the i-th slot of the group.
+     */
+    class Group {
+    public:
+        explicit Group(const signed char* control) {
+#ifdef __SSE2__
+            bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(control));
+#else
+            for (std::size_t i = 0; i < group_width; i++)
+                bytes[i] = control[i];
+#endif
+        }
+
+        /**
+         * \brief Slots whose control byte is \p control
+         */
+        unsigned match(signed char control) const {
+#ifdef __SSE2__
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(control)));
+#else
+            unsigned mask = 0;
+            for (std::size_t i = 0; i < group_width; i++)
+                if (bytes[i] == control)
+                    mask |= 1u << i;
+            return mask;
+#endif
+        }
+
+        /**
+         * \brief Slots which are empty or deleted
+         */
+        unsigned match_free() const {
+#ifdef __SSE2__
+            return _mm_movemask_epi8(bytes);
+#else
+            unsigned mask = 0;
+            for (std::size_t i = 0; i < group_width; i++)
+                if (!is_full(bytes[i]))
+                    mask |= 1u << i;
+            return mask;
+#endif
+        }
+
+    private:
+#ifdef __SSE2__
+        __m128i bytes;
+#else
+        signed char bytes[group_width];
+#endif
+    };
+
+    static bool is_full(signed char control) {
+        return control >= 0;
+    }
+
+    /**
+     * \brief Index of the lowest bit set in \p mask
+     * \pre mask != 0
+     */
+    static std::size_t lowest_bit(unsigned mask) {
+#ifdef __GNUC__
+        return __builtin_ctz(mask);
+#else
+        std::size_t bit = 0;
+        while (!(mask & 1)) {
+            mask >>= 1;
+            bit++;
+        }
+        return bit;
+#endif
+    }
+
+    /**
+     * \brief Hash of the key, with the bits spread out
+     *
+     * The probe position comes from the high bits and the control byte from
+     * the low 7 bits, while std::hash of integers is often the identity.
+     */
+    template<class K>
+        hash_type hash_key(const K& key) const {
+            return mix_hash(hasher_(key));
+        }
+
+    static hash_type mix_hash(hash_type hash) {
+        std::uint64_t mixed = std::uint64_t(hash) * UINT64_C(0x9E3779B97F4A7C15);
+        return mixed ^ (mixed >> 32);
+    }
+
+    /**
+     * \brief Calls visit(*it, hash) on each element of [first, last)
+     *
+     * Software pipeline: elements are hashed batch_size elements in advance,
+     * prefetching the first group of control bytes and slots they probe.
+     */
+    template<class Iterator, class HashOf, class Visit>
+        void pipeline(Iterator first, Iterator last, const HashOf& hash_of, const Visit& visit) {
+            hash_type hashes[batch_size];
+            Iterator ahead = first;
+            std::size_t hashed = 0;
+            for (std::size_t done = 0; first != last; ++first, ++done) {
+                for (; ahead != last && hashed < done + batch_size; ++ahead, ++hashed) {
+                    hash_type hash = hash_of(*ahead);
+                    hashes[hashed % batch_size] = hash;
+                    if (capacity_) {
+                        std::size_t offset = (hash >> 7) & (capacity_ - 1);
+                        prefetch(&control_[offset]);
+                        prefetch(&slots_[offset]);
+                    }
+                }
+                visit(*first, hashes[done % batch_size]);
+            }
+        }
+
+    static void prefetch(const void* address) {
+#ifdef __GNUC__
+        __builtin_prefetch(address);
+#else
+        (void)address;
+#endif
+    }
+
+    static signed char hash_control(hash_type hash) {
+        return hash & 0x7F;
+    }
+
+    item_type& slot(std::size_t index) {
+        return *reinterpret_cast<item_type*>(&slots_[index]);
+    }
+
+    const item_type& slot(std::size_t index) const {
+        return *reinterpret_cast<const item_type*>(&slots_[index]);
+    }
+
+    FlatHashTable(std::size_t capacity, const FlatHashTable& settings)
+        : max_load_factor_(settings.max_load_factor_),
+          hasher_(settings.hasher_), key_equal_(settings.key_equal_) {
+        allocate(capacity);
+    }
+
+    /**
+     * \brief Sets up empty storage for \p capacity slots
+     * \pre \p capacity is a power of 2, no less than group_width
+     */
+    void allocate(std::size_t capacity) {
+        capacity_ = capacity;
+        // The first group is repeated at the end, so any group can be loaded at once
+        control_.assign(capacity + group_width - 1, empty_control);
+        slots_.resize(capacity);
+        size_ = 0;
+        growth_left_ = max_items(capacity);
+    }
+
+    /**
+     * \brief Number of items fitting in \p capacity slots under max_load_factor()
+     */
+    std::size_t max_items(std::size_t capacity) const {
+        return capacity * max_load_factor_;
+    }
+
+    /**
+     * \brief Smallest valid number of slots able to hold \p count items
+     */
+    std::size_t capacity_for(std::size_t count) const {
+        std::size_t capacity = group_width;
+        while (max_items(capacity) < count)
+            capacity *= 2;
+        return capacity;
+    }
+
+    void set_control(std::size_t index, signed char control) {
+        control_[index] = control;
+        if (index < group_width - 1)
+            control_[capacity_ + index] = control;
+    }
+
+    /**
+     * \brief Index of the first full slot starting from \p index (capacity_ if none)
+     */
+    std::size_t next_full(std::size_t index) const {
+        while (index < capacity_ && !is_full(control_[index]))
+            index++;
+        return index;
+    }
+
+    /**
+     * \brief Index of the slot holding \p key or capacity_ if not found
+     */
+    template<class K>
+        std::size_t find_index(const K& key, hash_type hash) const {
+            return probe(control_.data(), reinterpret_cast<const item_type*>(slots_.data()),
+                         capacity_, key, hash, key_equal_);
+        }
+
+    /**
+     * \brief Index of the slot holding \p key or \p capacity if not found
+     *
+     * Works on the raw layout, so the same lookup can run on a snapshot.
+     */
+    template<class K>
+        static std::size_t probe(const signed char* control, const item_type* slots, std::size_t capacity,
+                                 const K& key, hash_type hash, const KeyEqual& equal) {
+            if (capacity == 0)
+                return capacity;
+
+            std::size_t mask = capacity - 1;
+            signed char full = hash_control(hash);
+            std::size_t offset = (hash >> 7) & mask;
+            // Triangular steps over groups, which visit all of them
+            for (std::size_t step = group_width; ; step += group_width) {
+                Group group(control + offset);
+                for (unsigned bits = group.match(full); bits; bits &= bits - 1) {
+                    std::size_t index = (offset + lowest_bit(bits)) & mask;
+                    if (equal(slots[index].first, key))
+                        return index;
+                }
+                if (group.match(empty_control))
+                    return capacity;
+                offset = (offset + step) & mask;
+            }
+        }
+
+    /**
+     * \brief Index of the first empty or deleted slot along the probe sequence
+     * \pre capacity_ > 0
+     */
+    std::size_t find_free(hash_type hash) const {
+        std::size_t mask = capacity_ - 1;
+        std::size_t offset = (hash >> 7) & mask;
+        for (std::size_t step = group_width; ; step += group_width) {
+            unsigned bits = Group(&control_[offset]).match_free();
+            if (bits)
+                return (offset + lowest_bit(bits)) & mask;
+            offset = (offset + step) & mask;
+        }
+    }
+
+    /**
+     * \brief Marks a free slot as full, growing the table if needed
+     * \return The index of the slot, which must then be constructed
+     */
+    std::size_t prepare_insert(hash_type hash) {
+        if (capacity_ == 0)
+            allocate(capacity_for(1));
+
+        std::size_t index = find_free(hash);
+        if (growth_left_ == 0 && control_[index] != deleted_control) {
+            // With lots of tombstones this cleans them up without growing
+            resize(std::max(capacity_, capacity_for(std::size_t(size_) * 2 + 1)));
+            index = find_free(hash);
+        }
+
+        if (control_[index] == empty_control)
+            growth_left_--;
+        set_control(index, hash_control(hash));
+        size_++;
+        return index;
+    }
+
+    /**
+     * \brief Constructs the item in a slot returned by prepare_insert()
+     */
+    template<class... Args>
+        void construct(std::size_t index, Args&&... args) {
+            try {
+                new (&slots_[index]) item_type(std::forward<Args>(args)...);
+            } catch (...) {
+                set_control(index, deleted_control);
+                size_--;
+                throw;
+            }
+        }
+
+    template<class K, class V>
+        iterator assign(K&& key, V&& value) {
+            hash_type hash = hash_key(key);
+            return assign_hashed(hash, std::forward<K>(key), std::forward<V>(value));
+        }
+
+    template<class K, class V>
+        iterator assign_hashed(hash_type hash, K&& key, V&& value) {
+            std::size_t index = find_index(key, hash);
+            if (index != capacity_) {
+                slot(index).second = std::forward<V>(value);
+                return iterator(this, index);
+            }
+            index = prepare_insert(hash);
+            construct(index, std::forward<K>(key), std::forward<V>(value));
+            return iterator(this, index);
+        }
+
+    template<class K, class... Args>
+        std::pair<iterator, bool> emplace_key(K&& key, Args&&... args) {
+            hash_type hash = hash_key(key);
+            std::size_t index = find_index(key, hash);
+            if (index != capacity_)
+                return std::make_pair(iterator(this, index), false);
+            index = prepare_insert(hash);
+            construct(index, std::piecewise_construct,
+                      std::forward_as_tuple(std::forward<K>(key)),
+                      std::forward_as_tuple(std::forward<Args>(args)...));
+            return std::make_pair(iterator(this, index), true);
+        }
+
+    void erase_slot(std::size_t index) {
+        slot(index).~item_type();
+        set_control(index, deleted_control);
+        size_--;
+    }
+
+    /**
+     * \brief Moves all the items into \p capacity slots
+     */
+    void resize(std::size_t capacity) {
+        FlatHashTable resized(capacity, *this);
+        for (std::size_t i = 0; i < capacity_; i++) {
+            if (is_full(control_[i])) {
+                std::size_t index = resized.prepare_insert(hash_key(slot(i).first));
+                resized.construct(index, std::move(slot(i)));
+            }
+        }
+        swap(resized);
+    }
+
+    /**
+     * \brief Destroys all the items
+     */
+    void clear_slots() {
+        for (std::size_t i = 0; i < capacity_; i++)
+            if (is_full(control_[i]))
+                slot(i).~item_type();
+    }
+
+    std::vector<signed char> control_;
+    std::vector<slot_type> slots_;
+    std::size_t capacity_ = 0;
+    int size_ = 0;
+    /// Number of empty slots which can be filled before rehashing
+    std::size_t growth_left_ = 0;
+    float max_load_factor_ = default_max_load_factor;
+    Hash hasher_;
+    KeyEqual key_equal_;
+
+    template<class, class, class, class> friend class HashTableView;
+};
+
+template <class Key, class Value, class Hash, class KeyEqual>
+    const std::size_t FlatHashTable<Key, Value, Hash, KeyEqual>::batch_size;
+template <class Key, class Value, class Hash, class KeyEqual>
+    const std::size_t FlatHashTable<Key, Value, Hash, KeyEqual>::group_width;
+template <class Key, class Value, class Hash, class KeyEqual>
+    constexpr float FlatHashTable<Key, Value, Hash, KeyEqual>::default_max_load_factor;
+template <class Key, class Value, class Hash, class KeyEqual>
+    constexpr float FlatHashTable<Key, Value, Hash, KeyEqual>::lowest_max_load_factor;
+template <class Key, class Value, class Hash, class KeyEqual>
+    const signed char FlatHashTable<Key, Value, Hash, KeyEqual>::empty_control;
+template <class Key, class Value, class Hash, class KeyEqual>
+    const signed char FlatHashTable<Key, Value, Hash, KeyEqual>::deleted_control;
+
+#endif // FLAT_HASH_TABLE_HPP
@@ -4,17 +4,192 @@
 #include <functional>
 #include <utility>
 #include <vector>
-#include <list>
+#include <memory>
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
 
-template <class Key, class Value>
-class HashTable {
+#include "node_pool.hpp"
+#include "stats.hpp"
+
+/**
+ * \brief Statistics of a HashTable, collected when its CollectStats parameter is true
+ */
+struct HashTableStats {
+    /// Entries looked at by each search of a key in its bucket, until found or the end
+    Histogram probes;
+    /// Length of the bucket of each search
+    Histogram chain_length;
+    /// Number of times the buckets have been reallocated
+    std::uint64_t rehashes = 0;
+};
+
+/**
+ * \brief Hash table with a linked list for each bucket
+ *
+ * The entries of a table are allocated from its own NodePool, which
+ * gets its blocks from \p Allocator, and linked in their bucket.
+ *
+ * If \p CollectStats is true, stats() gives the HashTableStats of the
+ * searches and rehashes done so far.
+ */
+template <class Key, class Value, class Hash = std::hash<Key>, class KeyEqual = std::equal_to<Key>,
+          class Allocator = std::allocator<std::pair<Key,Value>>, bool CollectStats = false>
+class HashTable : public StatsRecorder<HashTableStats, CollectStats> {
 public:
     typedef Key                  key_type;
     typedef Value                value_type;
     typedef std::pair<Key,Value> item_type;
-    typedef std::list<item_type> bucket_type;
     typedef std::size_t          hash_type;
+    typedef Hash                 hasher;
+    typedef KeyEqual             key_equal;
+    typedef Allocator            allocator_type;
+    typedef NodePool<Allocator>  pool_type;
+
+    /**
+     * \brief Item stored along with the hash of its key
+     */
+    struct entry_type {
+        template<class... Args>
+            explicit entry_type(hash_type hash, Args&&... args)
+                : item(std::forward<Args>(args)...), hash(hash) {}
+
+        item_type item;
+        hash_type hash;
+        /// Following entry in the bucket, null for the last one
+        entry_type* next = nullptr;
+        /// Preceding entry in the bucket, the last one for the first
+        entry_type* previous = nullptr;
+    };
+
+    /**
+     * \brief Doubly linked list of the entries of a bucket
+     *
+     * Only links the entries, the table creates and destroys them in its pool.
+     */
+    class bucket_type {
+    public:
+        template<class Entry>
+        class link_iterator {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef Entry                     value_type;
+            typedef std::ptrdiff_t            difference_type;
+            typedef Entry*                    pointer;
+            typedef Entry&                    reference;
+
+            link_iterator() : entry(nullptr) {}
+            explicit link_iterator(Entry* entry) : entry(entry) {}
+
+            Entry& operator*() const {
+                return *entry;
+            }
+            Entry* operator->() const {
+                return entry;
+            }
+            link_iterator& operator++() {
+                entry = entry->next;
+                return *this;
+            }
+            /**
+             * \pre Not at the beginning of the bucket
+             */
+            link_iterator& operator--() {
+                entry = entry->previous;
+                return *this;
+            }
+            bool operator==(const link_iterator& other) const {
+                return entry == other.entry;
+            }
+            bool operator!=(const link_iterator& other) const {
+                return entry != other.entry;
+            }
+
+            Entry* entry;
+        };
+        typedef link_iterator<entry_type>       iterator;
+        typedef link_iterator<const entry_type> const_iterator;
+
+        bool empty() const {
+            return !head_;
+        }
+        iterator begin() {
+            return iterator(head_);
+        }
+        iterator end() {
+            return iterator();
+        }
+        const_iterator begin() const {
+            return const_iterator(head_);
+        }
+        const_iterator end() const {
+            return const_iterator();
+        }
+        /**
+         * \brief Iterator to the last entry
+         * \pre The bucket isn't empty
+         */
+        iterator last() {
+            return iterator(head_->previous);
+        }
+        const entry_type& front() const {
+            return *head_;
+        }
+
+        void push_front(entry_type* entry) {
+            entry->next = head_;
+            entry->previous = head_ ? head_->previous : entry;
+            if (head_)
+                head_->previous = entry;
+            head_ = entry;
+        }
+
+        void push_back(entry_type* entry) {
+            entry->next = nullptr;
+            if (!head_) {
+                entry->previous = head_ = entry;
+                return;
+            }
+            entry->previous = head_->previous;
+            head_->previous->next = entry;
+            head_->previous = entry;
+        }
+
+        /**
+         * \brief Unlinks the first entry
+         * \pre The bucket isn't empty
+         */
+        entry_type* pop_front() {
+            entry_type* entry = head_;
+            unlink(begin());
+            return entry;
+        }
+
+        /**
+         * \brief Unlinks the entry at \p it, without destroying it
+         * \return Iterator to the following entry
+         */
+        iterator unlink(iterator it) {
+            entry_type* entry = it.entry;
+            entry_type* next = entry->next;
+            if (entry == head_)
+                head_ = next;
+            else
+                entry->previous->next = next;
+            if (next)
+                next->previous = entry->previous;
+            else if (head_)
+                head_->previous = entry->previous;
+            return iterator(next);
+        }
+
+    private:
+        entry_type* head_ = nullptr;
+    };
 
     template<bool Const>
     class iterator_base {
@@ -34,6 +209,7 @@ public:
 
         /**
          * \brief Move the iterator to the next element
+         * \complexity Amortized O(1), empty buckets are skipped 64 at a time
          */
         iterator_base& operator++() {
             if (table && bucket_index >= 0 && bucket_index < table->bucket_count()) {
@@ -45,26 +221,21 @@ public:
 
         /**
          * \brief Move the iterator to the previous element
+         * \complexity Amortized O(1), empty buckets are skipped 64 at a time
          */
         iterator_base& operator--() {
-            if (table) {
-                if (bucket_index == -1) {
-                    bucket_index = table->bucket_count() - 1;
-                    iterator = bucket().end();
-                }
+            if (!table)
+                return *this;
 
-                if (iterator == bucket().begin()) {
-                    while (bucket_index >= 0 && bucket().empty()) {
-                        --bucket_index;
-                    }
-
-                    if (bucket_index >= 0) {
-                        iterator = bucket().end();
-                        --iterator;
-                    }
-                } else {
-                    --iterator;
-                }
+            if (bucket_index >= 0 && iterator != bucket().begin()) {
+                --iterator;
+                return *this;
+            }
+
+            int previous = table->previous_occupied(bucket_index >= 0 ? bucket_index : table->bucket_count());
+            if (previous >= 0) {
+                bucket_index = previous;
+                iterator = bucket().last();
             }
             return *this;
         }
@@ -75,7 +246,7 @@ public:
         }
         iterator_base operator-- (int) {
             iterator_base copy = *this;
-            --this;
+            --*this;
             return copy;
         }
 
@@ -91,7 +262,7 @@ public:
          */
         pointer_type operator-> () const {
             if (table && bucket_index >= 0 && iterator != bucket().end())
-                return &*iterator;
+                return &iterator->item;
             return nullptr;
         }
 
@@ -119,7 +290,7 @@ public:
 
         /**
          * \brief If the iterator is pointing to the end of a bucket, move it
-         *  forward until we find a non-empty element
+         *  forward to the next non-empty bucket
          */
         void normalize() {
             if (!table || bucket_index < 0 || bucket_index >= table->bucket_count()) {
@@ -127,10 +298,9 @@ public:
                 return;
             }
             if (iterator == bucket().end()) {
-                bucket_index++;
-                if (bucket_index < table->bucket_count())
-                    iterator =  bucket().begin();
-                normalize();
+                bucket_index = table->next_occupied(bucket_index + 1);
+                if (bucket_index >= 0)
+                    iterator = bucket().begin();
             }
         }
 
@@ -143,61 +313,197 @@ public:
     typedef iterator_base<false> iterator;
     typedef iterator_base<true>  const_iterator;
 
-    explicit HashTable(int buckets=16) : bucket_list(std::max(1,buckets)) {}
+    /**
+     * \param buckets Initial number of buckets, rounded up to a power of 2
+     */
+    explicit HashTable(int buckets=16, const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual(),
+                       const Allocator& allocator = Allocator())
+        : pool_(sizeof(entry_type), alignof(entry_type), allocator),
+          bucket_list(round_buckets(buckets)),
+          occupied_(bitmap_words(bucket_list.size())),
+          first_occupied_(bucket_list.size()),
+          hasher_(hash), key_equal_(equal) {}
+
+    /**
+     * \brief Builds the table from a range of items, sizing it only once
+     *
+     * The order of the items doesn't matter, for duplicate keys the last
+     * value is kept.
+     * \complexity O(n)
+     */
+    template<class ForwardIterator,
+             class = typename std::iterator_traits<ForwardIterator>::iterator_category>
+        HashTable(ForwardIterator first, ForwardIterator last,
+                  const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual(),
+                  const Allocator& allocator = Allocator())
+            : HashTable(1, hash, equal, allocator) {
+            insert_batch(first, last);
+        }
+
+    /**
+     * \brief Copies the items into nodes from a new pool
+     * \complexity O(n+m)
+     */
+    HashTable(const HashTable& other)
+        : HashTable(other.bucket_count(), other.hasher_, other.key_equal_, other.get_allocator()) {
+        max_load_factor_ = other.max_load_factor_;
+        for (std::size_t i = 0; i < bucket_list.size(); i++) {
+            for (const entry_type& entry : other.bucket_list[i])
+                bucket_list[i].push_back(pool_.template create<entry_type>(entry));
+        }
+        occupied_ = other.occupied_;
+        first_occupied_ = other.first_occupied_;
+        size_ = other.size_;
+    }
+
+    /**
+     * \brief Takes the nodes of \p other along with its pool
+     * \note \p other can only be assigned to or destroyed afterwards
+     */
+    HashTable(HashTable&& other) = default;
+
+    HashTable& operator= (HashTable other) {
+        swap(other);
+        return *this;
+    }
+
+    /**
+     * \complexity O(blocks) if the keys and values are trivially destructible, O(n+m) otherwise
+     */
+    ~HashTable() {
+        destroy_entries();
+    }
+
+    void swap(HashTable& other) {
+        pool_.swap(other.pool_);
+        std::swap(bucket_list, other.bucket_list);
+        std::swap(occupied_, other.occupied_);
+        std::swap(first_occupied_, other.first_occupied_);
+        std::swap(hasher_, other.hasher_);
+        std::swap(key_equal_, other.key_equal_);
+        std::swap(size_, other.size_);
+        std::swap(max_load_factor_, other.max_load_factor_);
+    }
 
     /**
      * \brief Insert a new item or assign if the key exists
      * \complexity Best: O(1) Worst: O(n) Always: O(m) where m is the # of items in the bucket
      */
-    iterator insert_or_assign (const Key& key, const Value& value) {
-        hash_type hash = KeyToBucket(key);
-        bucket_type& bucket = bucket_list[hash];
-        auto iter = find_key(bucket, key);
-        if (iter != bucket.end()) {
-            *iter = value;
-            return iterator(this, hash, iter);
-        } else {
-            bucket.push_front(std::make_pair(key, value));
-            size_++;
-            return iterator(this, hash, bucket.begin());
+    template<class V>
+        iterator insert_or_assign (const Key& key, V&& value) {
+            return assign(key, std::forward<V>(value));
+        }
+
+    /**
+     * \brief Insert a new item or assign if the key exists, moving the key
+     * \complexity Best: O(1) Worst: O(n) Always: O(m) where m is the # of items in the bucket
+     */
+    template<class V>
+        iterator insert_or_assign (Key&& key, V&& value) {
+            return assign(std::move(key), std::forward<V>(value));
         }
-    }
 
     /**
      * \brief Insert a new item (might cause duplicate entries)
-     * \complexity O(1)
+     * \complexity Amortized O(1)
      */
-    iterator insert (const Key& key, const Value& value) {
-        hash_type hash = KeyToBucket(key);
-        bucket_type& bucket = bucket_list[hash];
-        bucket.push_front(std::make_pair(key, value));
-        size_++;
-        return iterator(this, hash, bucket.begin());
-    }
+    template<class V>
+        iterator insert (const Key& key, V&& value) {
+            return insert_hashed(hasher_(key), key, std::forward<V>(value));
+        }
+
+    /**
+     * \brief Insert a new item (might cause duplicate entries), moving the key
+     * \complexity Amortized O(1)
+     */
+    template<class V>
+        iterator insert (Key&& key, V&& value) {
+            hash_type hash = hasher_(key);
+            return insert_hashed(hash, std::move(key), std::forward<V>(value));
+        }
+
+    /**
+     * \brief Insert an item constructed from \p args unless its key exists
+     * \return The item with that key and whether it has been inserted
+     * \note The item is always constructed, to find out its key
+     * \complexity Best: O(1) Worst: O(n) Always: O(m) where m is the # of items in the bucket
+     */
+    template<class... Args>
+        std::pair<iterator, bool> emplace(Args&&... args) {
+            entry_type* entry = pool_.template create<entry_type>(0, std::forward<Args>(args)...);
+            try {
+                entry->hash = hasher_(entry->item.first);
+                iterator found = find_hashed(entry->item.first, entry->hash);
+                if (found != end()) {
+                    pool_.destroy(entry);
+                    return std::make_pair(found, false);
+                }
+                grow();
+            } catch (...) {
+                pool_.destroy(entry);
+                throw;
+            }
+
+            hash_type index = KeyToBucket(entry->hash);
+            bucket_type& bucket = bucket_list[index];
+            bucket.push_front(entry);
+            mark_occupied(index);
+            size_++;
+            return std::make_pair(iterator(this, index, bucket.begin()), true);
+        }
+
+    /**
+     * \brief If \p key doesn't exist, insert it with a value constructed from \p args
+     * \return The item with that key and whether it has been inserted
+     * \complexity Best: O(1) Worst: O(n) Always: O(m) where m is the # of items in the bucket
+     */
+    template<class... Args>
+        std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+            return emplace_key(key, std::forward<Args>(args)...);
+        }
+
+    /**
+     * \brief If \p key doesn't exist, insert it with a value constructed from \p args
+     * \return The item with that key and whether it has been inserted
+     * \note \p key is only moved from if it gets inserted
+     * \complexity Best: O(1) Worst: O(n) Always: O(m) where m is the # of items in the bucket
+     */
+    template<class... Args>
+        std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args) {
+            return emplace_key(std::move(key), std::forward<Args>(args)...);
+        }
 
     /**
      * \brief Erase an existing item (the first one if multiple items with the same key exist)
      * \complexity Best: O(1) Worst: O(n) Always: O(m) where m is the # of items in the bucket
      */
     iterator erase (const Key& key) {
-        hash_type hash = KeyToBucket(key);
-        bucket_type& bucket = bucket_list[hash];
-        auto iter = find_key(bucket, key);
-        if (iter == bucket.end())
-            return end();
-        size_--;
-        return iterator(this, hash, bucket.erase(iter));
+        return erase(find(key));
     }
 
+    /**
+     * \brief Erase an existing item with a key comparable to key_type
+     * \note Only available when Hash and KeyEqual define is_transparent
+     * \complexity Best: O(1) Worst: O(n) Always: O(m) where m is the # of items in the bucket
+     */
+    template<class K, class H = Hash, class = typename H::is_transparent,
+             class E = KeyEqual, class = typename E::is_transparent>
+        iterator erase (const K& key) {
+            return erase(find(key));
+        }
+
     /**
      * \brief Erase by iterator
      */
     iterator erase (iterator it) {
         if (it == end() || it.table != this)
             return end();
-        it.iterator = it.bucket().erase(it.iterator);
-        if (it.iterator != it.bucket().end())
-            size_--;
+        entry_type* entry = it.iterator.entry;
+        it.iterator = it.bucket().unlink(it.iterator);
+        pool_.destroy(entry);
+        if (it.bucket().empty())
+            mark_empty(it.bucket_index);
+        size_--;
         it.normalize();
         return it;
     }
@@ -207,30 +513,90 @@ public:
      * \complexity Best: O(1) Worst: O(n) Always: O(m) where m is the # of items in the bucket
      */
     iterator find(const Key& key) {
-        hash_type hash = KeyToBucket(key);
-        bucket_type& bucket = bucket_list[hash];
-        auto iter = find_key(bucket, key);
-        if (iter == bucket.end())
-            return end();
-        return iterator(this, hash, iter);
+        return find_hashed(key, hasher_(key));
+    }
+
+    /**
+     * \brief Find an element
+     * \complexity Best: O(1) Worst: O(n) Always: O(m) where m is the # of items in the bucket
+     */
+    const_iterator find(const Key& key) const {
+        return find_hashed(key, hasher_(key));
     }
 
+    /**
+     * \brief Find an element with a key comparable to key_type, without converting it
+     * \note Only available when Hash and KeyEqual define is_transparent
+     * \complexity Best: O(1) Worst: O(n) Always: O(m) where m is the # of items in the bucket
+     */
+    template<class K, class H = Hash, class = typename H::is_transparent,
+             class E = KeyEqual, class = typename E::is_transparent>
+        iterator find(const K& key) {
+            return find_hashed(key, hasher_(key));
+        }
+
+    /**
+     * \brief Find an element with a key comparable to key_type, without converting it
+     * \note Only available when Hash and KeyEqual define is_transparent
+     * \complexity Best: O(1) Worst: O(n) Always: O(m) where m is the # of items in the bucket
+     */
+    template<class K, class H = Hash, class = typename H::is_transparent,
+             class E = KeyEqual, class = typename E::is_transparent>
+        const_iterator find(const K& key) const {
+            return find_hashed(key, hasher_(key));
+        }
+
     /**
      * \brief Get reference to given value (inserted with default-constructed value if not present)
      * \complexity Best: O(1) Worst: O(n) Always: O(m) where m is the # of items in the bucket
      */
     value_type& operator[] (const Key& key) {
-        hash_type hash = KeyToBucket(key);
-        bucket_type& bucket = bucket_list[hash];
-        auto iter = find_key(bucket, key);
-        if (iter == bucket.end()) {
-            bucket.push_front(std::make_pair(key, value_type()));
-            size_++;
-            return bucket.front().second;
-        }
-        return iter->second;
+        return try_emplace(key).first->second;
     }
 
+    /**
+     * \brief Get reference to given value (inserted with default-constructed value if not present)
+     * \complexity Best: O(1) Worst: O(n) Always: O(m) where m is the # of items in the bucket
+     */
+    value_type& operator[] (Key&& key) {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    /**
+     * \brief Finds all the keys in [first, last), writing an iterator for
+     * each of them to \p out (end() for the missing ones)
+     *
+     * The buckets and nodes of the following keys are prefetched while
+     * looking up a key, so the cache misses of many lookups overlap instead
+     * of happening one after the other.
+     * \return The output iterator past the last written value
+     * \complexity Average: O(k) where k is the number of keys
+     */
+    template<class KeyIterator, class OutputIterator>
+        OutputIterator find_batch(KeyIterator first, KeyIterator last, OutputIterator out) {
+            typedef typename std::iterator_traits<KeyIterator>::reference reference;
+            pipeline(first, last,
+                [this](reference key) { return hasher_(key); },
+                [this, &out](reference key, hash_type hash) { *out++ = find_hashed(key, hash); });
+            return out;
+        }
+
+    /**
+     * \brief Calls insert_or_assign() for all the items in [first, last)
+     *
+     * The table is grown once upfront, then items are inserted prefetching
+     * their buckets like find_batch().
+     * \complexity Average: O(k) where k is the number of items
+     */
+    template<class ForwardIterator>
+        void insert_batch(ForwardIterator first, ForwardIterator last) {
+            typedef typename std::iterator_traits<ForwardIterator>::reference reference;
+            reserve(size_ + std::distance(first, last));
+            pipeline(first, last,
+                [this](reference item) { return hasher_(item.first); },
+                [this](reference item, hash_type hash) { assign_hashed(hash, item.first, item.second); });
+        }
+
     /**
      * \brief Print the tree tructure to stdout
      * \complexity O(n)
@@ -238,19 +604,19 @@ public:
     void print_structure() const {
         for (hash_type i = 0; i < bucket_list.size(); i++) {
             std::cout << i << ":";
-            for (const auto& item : bucket_list[i])
-                std::cout << " (" << item.first << "," << item.second << ")";
+            for (const auto& entry : bucket_list[i])
+                std::cout << " (" << entry.item.first << "," << entry.item.second << ")";
             std::cout << "\n";
         }
     }
     /**
      * \brief Get iterator to the first element
-     * \complexity Worst: O(m) (m = # of buckets) Best: O(1)
+     * \complexity O(1)
      */
     iterator begin() {
         if (empty())
             return end();
-        return iterator(this,0,bucket_list[0].begin());
+        return iterator(this,first_occupied_,bucket_list[first_occupied_].begin());
     }
     /**
      * \brief Get iterator to past-the-last element
@@ -262,12 +628,12 @@ public:
 
     /**
      * \brief Get iterator to the first element
-     * \complexity Worst: O(m) (m = # of buckets) Best: O(1)
+     * \complexity O(1)
      */
     const_iterator begin() const {
         if (empty())
             return end();
-        return const_iterator(this,0,bucket_list[0].begin());
+        return const_iterator(this,first_occupied_,bucket_list[first_occupied_].begin());
     }
     /**
      * \brief Get iterator to past-the-last element
@@ -279,7 +645,7 @@ public:
 
     /**
      * \brief Get iterator to the first element
-     * \complexity Worst: O(m) (m = # of buckets) Best: O(1)
+     * \complexity O(1)
      */
     const_iterator cbegin() const {
         return begin();
@@ -316,35 +682,409 @@ public:
         return bucket_list.size();
     }
 
+    /**
+     * \brief Average number of elements per bucket
+     * \complexity O(1)
+     */
+    float load_factor() const {
+        return float(size_) / bucket_count();
+    }
+
+    /**
+     * \brief Load factor above which the number of buckets is doubled
+     * \complexity O(1)
+     */
+    float max_load_factor() const {
+        return max_load_factor_;
+    }
+
+    /**
+     * \brief Sets the maximum load factor, rehashing if it's already exceeded
+     *
+     * Values below 1/16 are raised to 1/16, which bounds the number of
+     * buckets. A factor which isn't positive, or NaN, is ignored.
+     * \pre factor > 0
+     * \complexity O(1), O(n+m) if rehashing
+     */
+    void max_load_factor(float factor) {
+        if (!(factor > 0))
+            return;
+        max_load_factor_ = std::max(factor, lowest_max_load_factor);
+        if (load_factor() > max_load_factor_)
+            rehash(0);
+    }
+
+    /**
+     * \brief Sets the number of buckets to \p buckets or to the minimum
+     * which respects max_load_factor(), whichever is greater
+     *
+     * The nodes are moved to their new buckets without being reallocated
+     * nor hashed again, but iterators are invalidated.
+     * \complexity O(n+m) (m = # of buckets)
+     */
+    void rehash(int buckets) {
+        this->record_stats([](HashTableStats& stats) { stats.rehashes++; });
+        buckets = round_buckets(std::max(buckets, int(std::ceil(size_ / max_load_factor_))));
+        std::vector<bucket_type> rehashed(buckets);
+        bucket_list.swap(rehashed);
+        occupied_.assign(bitmap_words(buckets), 0);
+        first_occupied_ = buckets;
+        for (bucket_type& bucket : rehashed) {
+            // Moving from the front to the back preserves the order of duplicates
+            while (!bucket.empty()) {
+                entry_type* entry = bucket.pop_front();
+                hash_type index = KeyToBucket(entry->hash);
+                bucket_list[index].push_back(entry);
+                mark_occupied(index);
+            }
+        }
+    }
+
+    /**
+     * \brief Makes room for \p count elements without exceeding max_load_factor()
+     * \complexity O(n+m) if rehashing, O(1) otherwise
+     */
+    void reserve(int count) {
+        int buckets = std::ceil(count / max_load_factor_);
+        if (buckets > bucket_count())
+            rehash(buckets);
+    }
+
+    hasher hash_function() const {
+        return hasher_;
+    }
+
+    key_equal key_eq() const {
+        return key_equal_;
+    }
+
+    allocator_type get_allocator() const {
+        return allocator_type(pool_.get_allocator());
+    }
+
+    /**
+     * \brief Number of nodes taken from the pool, in use or free for reuse
+     * \complexity O(1)
+     */
+    std::size_t node_count() const {
+        return pool_.node_count();
+    }
+
+    /**
+     * \brief Number of bytes reserved by the pool blocks
+     * \complexity O(1)
+     */
+    std::size_t bytes_reserved() const {
+        return pool_.bytes_reserved();
+    }
+
 private:
     /**
-     * \brief Get bucket index (hash value) from a key
-     * \brief O(1)
+     * \brief Adds an entry constructed from \p args to the bucket for \p hash
+     * \complexity Amortized O(1)
      */
-    hash_type KeyToBucket(const key_type& key) const{
-        return std::hash<key_type>()(key) % bucket_list.size();
+    template<class... Args>
+        iterator insert_hashed(hash_type hash, Args&&... args) {
+            grow();
+            hash_type index = KeyToBucket(hash);
+            bucket_type& bucket = bucket_list[index];
+            bucket.push_front(pool_.template create<entry_type>(hash, std::forward<Args>(args)...));
+            mark_occupied(index);
+            size_++;
+            return iterator(this, index, bucket.begin());
+        }
+
+    template<class K, class V>
+        iterator assign(K&& key, V&& value) {
+            hash_type hash = hasher_(key);
+            return assign_hashed(hash, std::forward<K>(key), std::forward<V>(value));
+        }
+
+    template<class K, class V>
+        iterator assign_hashed(hash_type hash, K&& key, V&& value) {
+            iterator found = find_hashed(key, hash);
+            if (found != end()) {
+                found->second = std::forward<V>(value);
+                return found;
+            }
+            return insert_hashed(hash, std::forward<K>(key), std::forward<V>(value));
+        }
+
+    template<class K, class... Args>
+        std::pair<iterator, bool> emplace_key(K&& key, Args&&... args) {
+            hash_type hash = hasher_(key);
+            iterator found = find_hashed(key, hash);
+            if (found != end())
+                return std::make_pair(found, false);
+            iterator inserted = insert_hashed(hash, std::piecewise_construct,
+                std::forward_as_tuple(std::forward<K>(key)),
+                std::forward_as_tuple(std::forward<Args>(args)...));
+            return std::make_pair(inserted, true);
+        }
+
+    template<class K>
+        iterator find_hashed(const K& key, hash_type hash) {
+            hash_type index = KeyToBucket(hash);
+            bucket_type& bucket = bucket_list[index];
+            auto iter = find_key(bucket, key, hash);
+            if (iter == bucket.end())
+                return end();
+            return iterator(this, index, iter);
+        }
+
+    template<class K>
+        const_iterator find_hashed(const K& key, hash_type hash) const {
+            hash_type index = KeyToBucket(hash);
+            const bucket_type& bucket = bucket_list[index];
+            auto iter = find_key(bucket, key, hash);
+            if (iter == bucket.end())
+                return end();
+            return const_iterator(this, index, iter);
+        }
+
+    /**
+     * \brief Doubles the number of buckets if an insertion would exceed max_load_factor()
+     * \complexity O(n+m) if rehashing, O(1) otherwise
+     */
+    void grow() {
+        if (size_ + 1 > bucket_count() * max_load_factor_)
+            rehash(bucket_count() * 2);
+    }
+
+    /**
+     * \brief Calls visit(*it, hash) on each element of [first, last)
+     *
+     * Software pipeline: elements are hashed and their bucket prefetched
+     * 2 * batch_size elements in advance, the first node of the bucket
+     * batch_size elements in advance.
+     */
+    template<class Iterator, class HashOf, class Visit>
+        void pipeline(Iterator first, Iterator last, const HashOf& hash_of, const Visit& visit) {
+            const std::size_t ring = 2 * batch_size;
+            hash_type hashes[ring];
+            Iterator ahead = first;
+            std::size_t hashed = 0;
+            std::size_t prefetched = 0;
+            for (std::size_t done = 0; first != last; ++first, ++done) {
+                for (; ahead != last && hashed < done + ring; ++ahead, ++hashed) {
+                    hashes[hashed % ring] = hash_of(*ahead);
+                    prefetch(&bucket_list[KeyToBucket(hashes[hashed % ring])]);
+                }
+                for (; prefetched < hashed && prefetched < done + batch_size; ++prefetched) {
+                    const bucket_type& bucket = bucket_list[KeyToBucket(hashes[prefetched % ring])];
+                    if (!bucket.empty())
+                        prefetch(&bucket.front());
+                }
+                visit(*first, hashes[done % ring]);
+            }
+        }
+
+    /**
+     * \brief Calls the destructors of all the entries, unless they are trivial
+     *
+     * The memory itself is released along with the pool blocks.
+     */
+    void destroy_entries() {
+        if (std::is_trivially_destructible<entry_type>::value)
+            return;
+        for (int index = next_occupied(0); index >= 0; index = next_occupied(index + 1)) {
+            bucket_type& bucket = bucket_list[index];
+            while (!bucket.empty())
+                pool_.destroy(bucket.pop_front());
+        }
+    }
+
+    static std::size_t bitmap_words(std::size_t buckets) {
+        return (buckets + 63) / 64;
+    }
+
+    /**
+     * \brief Records that the bucket at \p index has items
+     * \complexity O(1)
+     */
+    void mark_occupied(hash_type index) {
+        occupied_[index / 64] |= std::uint64_t(1) << (index % 64);
+        if (int(index) < first_occupied_)
+            first_occupied_ = index;
+    }
+
+    /**
+     * \brief Records that the bucket at \p index has become empty
+     * \complexity O(1), O(m/64) if it was the first non-empty bucket
+     */
+    void mark_empty(int index) {
+        occupied_[index / 64] &= ~(std::uint64_t(1) << (index % 64));
+        if (index == first_occupied_) {
+            int next = next_occupied(index + 1);
+            first_occupied_ = next >= 0 ? next : bucket_count();
+        }
+    }
+
+    /**
+     * \brief Index of the first non-empty bucket from \p index, -1 if none
+     * \complexity O(1) per 64 buckets skipped
+     */
+    int next_occupied(int index) const {
+        std::size_t word = index / 64;
+        if (index >= bucket_count())
+            return -1;
+        std::uint64_t bits = occupied_[word] & (~std::uint64_t(0) << (index % 64));
+        while (!bits) {
+            if (++word == occupied_.size())
+                return -1;
+            bits = occupied_[word];
+        }
+        return word * 64 + lowest_bit(bits);
+    }
+
+    /**
+     * \brief Index of the last non-empty bucket before \p index, -1 if none
+     * \complexity O(1) per 64 buckets skipped
+     */
+    int previous_occupied(int index) const {
+        if (index <= 0)
+            return -1;
+        std::size_t word = (index - 1) / 64;
+        std::uint64_t bits = occupied_[word] & (~std::uint64_t(0) >> (63 - (index - 1) % 64));
+        while (!bits) {
+            if (word == 0)
+                return -1;
+            bits = occupied_[--word];
+        }
+        return word * 64 + highest_bit(bits);
+    }
+
+    /**
+     * \brief Index of the lowest bit set in \p bits
+     * \pre bits != 0
+     */
+    static int lowest_bit(std::uint64_t bits) {
+#ifdef __GNUC__
+        return __builtin_ctzll(bits);
+#else
+        int bit = 0;
+        while (!(bits & 1)) {
+            bits >>= 1;
+            bit++;
+        }
+        return bit;
+#endif
+    }
+
+    /**
+     * \brief Index of the highest bit set in \p bits
+     * \pre bits != 0
+     */
+    static int highest_bit(std::uint64_t bits) {
+#ifdef __GNUC__
+        return 63 - __builtin_clzll(bits);
+#else
+        int bit = 63;
+        while (!(bits >> 63)) {
+            bits <<= 1;
+            bit--;
+        }
+        return bit;
+#endif
+    }
+
+    static void prefetch(const void* address) {
+#ifdef __GNUC__
+        __builtin_prefetch(address);
+#else
+        (void)address;
+#endif
+    }
+
+    /**
+     * \brief Smallest power of 2 no less than \p buckets
+     */
+    static int round_buckets(int buckets) {
+        int result = 1;
+        while (result < buckets)
+            result *= 2;
+        return result;
+    }
+
+    /**
+     * \brief Get bucket index from the hash of a key
+     *
+     * The hash is mixed before masking as std::hash of integers is often
+     * the identity, which would leave only its low bits.
+     * \complexity O(1)
+     */
+    hash_type KeyToBucket(hash_type hash) const{
+        std::uint64_t mixed = std::uint64_t(hash) * UINT64_C(0x9E3779B97F4A7C15);
+        return (mixed ^ (mixed >> 32)) & (bucket_list.size() - 1);
     }
 
     /**
      * \brief Find an iterator matching the key for the given bucket
+     *
+     * Keys are only compared when the stored hash matches \p hash.
      * \complexity Best: O(1) Worst: O(n) Always: O(m) where m is the # of items in the bucket
      */
-    typename bucket_type::iterator find_key(bucket_type& bucket, const key_type& key) {
-        return std::find_if(bucket.begin(),bucket.end(),
-            [key](const item_type& item) { return item.first == key; } );
-    }
+    template<class K>
+        typename bucket_type::iterator find_key(bucket_type& bucket, const K& key, hash_type hash) {
+            std::size_t probes = 0;
+            auto found = std::find_if(bucket.begin(),bucket.end(),
+                [this, &key, hash, &probes](const entry_type& entry) {
+                    probes++;
+                    return entry.hash == hash && key_equal_(entry.item.first, key);
+                });
+            record_search(bucket, probes);
+            return found;
+        }
 
     /**
      * \brief Find an iterator matching the key for the given bucket
+     *
+     * Keys are only compared when the stored hash matches \p hash.
      * \complexity Best: O(1) Worst: O(n) Always: O(m) where m is the # of items in the bucket
      */
-    typename bucket_type::const_iterator find_key(const bucket_type& bucket, const key_type& key) const {
-        return std::find_if(bucket.begin(),bucket.end(),
-            [key](const item_type& item) { return item.first == key; } );
+    template<class K>
+        typename bucket_type::const_iterator find_key(const bucket_type& bucket, const K& key, hash_type hash) const {
+            std::size_t probes = 0;
+            auto found = std::find_if(bucket.begin(),bucket.end(),
+                [this, &key, hash, &probes](const entry_type& entry) {
+                    probes++;
+                    return entry.hash == hash && key_equal_(entry.item.first, key);
+                });
+            record_search(bucket, probes);
+            return found;
+        }
+
+    /**
+     * \brief Records the search of a key in \p bucket which compared \p probes entries
+     * \complexity O(m) with statistics, nothing without
+     */
+    void record_search(const bucket_type& bucket, std::size_t probes) const {
+        this->record_stats([&bucket, probes](HashTableStats& stats) {
+            stats.probes.record(probes);
+            stats.chain_length.record(std::distance(bucket.begin(), bucket.end()));
+        });
     }
 
+    /// Prefetch distance of the batch functions, in keys
+    static const std::size_t batch_size = 16;
+    /// Lower bound of max_load_factor()
+    static constexpr float lowest_max_load_factor = 0.0625;
+
+    pool_type pool_;
     std::vector<bucket_type> bucket_list;
+    /// One bit per bucket, set for the non-empty ones
+    std::vector<std::uint64_t> occupied_;
+    /// Index of the first non-empty bucket, bucket_count() if none
+    int first_occupied_;
+    Hash hasher_;
+    KeyEqual key_equal_;
     int size_ = 0;
+    float max_load_factor_ = 1;
 };
 
+template <class Key, class Value, class Hash, class KeyEqual, class Allocator, bool CollectStats>
+    const std::size_t HashTable<Key, Value, Hash, KeyEqual, Allocator, CollectStats>::batch_size;
+template <class Key, class Value, class Hash, class KeyEqual, class Allocator, bool CollectStats>
+    constexpr float HashTable<Key, Value, Hash, KeyEqual, Allocator, CollectStats>::lowest_max_load_factor;
+
 #endif // HASH_TABLE_HPP
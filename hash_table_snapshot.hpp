@@ -0,0 +1,306 @@
+#ifndef HASH_TABLE_SNAPSHOT_HPP
+#define HASH_TABLE_SNAPSHOT_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#   define HASH_TABLE_SNAPSHOT_MMAP
+#endif
+
+#include "flat_hash_table.hpp"
+#include "hash_table.hpp"
+
+/**
+ * \brief Read-only table over a snapshot written by write_snapshot()
+ *
+ * A snapshot is the layout of a FlatHashTable dumped as is: a header,
+ * the control bytes and the slots. The view looks keys up directly in that
+ * memory, so a mapped file is usable without deserializing anything and
+ * its pages can be shared by all the processes mapping it.
+ *
+ * Keys are only found if \p Hash and \p KeyEqual behave like the ones of the
+ * table that was written, and the file uses the native byte order and
+ * struct layout.
+ */
+template<class Key, class Value, class Hash = std::hash<Key>, class KeyEqual = std::equal_to<Key>>
+class HashTableView {
+public:
+    typedef Key                                     key_type;
+    typedef Value                                   value_type;
+    typedef std::pair<Key,Value>                    item_type;
+    typedef std::size_t                             hash_type;
+    typedef FlatHashTable<Key,Value,Hash,KeyEqual>  table_type;
+
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "Snapshots only support trivially copyable keys and values");
+
+    explicit HashTableView(const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual())
+        : hasher_(hash), key_equal_(equal) {}
+
+    /**
+     * \brief Uses the snapshot at \p data, which must outlive the view
+     * \return Whether \p data holds a valid snapshot for this view,
+     *         if not the view is left empty
+     * \complexity O(1)
+     */
+    bool assign(const void* data, std::size_t size) {
+        reset();
+        const char* bytes = static_cast<const char*>(data);
+        Header header;
+        if (size < sizeof(header))
+            return false;
+        std::memcpy(&header, bytes, sizeof(header));
+        if (!header.valid(size) ||
+                reinterpret_cast<std::uintptr_t>(bytes + header.slots_offset) % alignof(item_type))
+            return false;
+
+        control_ = reinterpret_cast<const signed char*>(bytes + header.control_offset);
+        slots_ = reinterpret_cast<const item_type*>(bytes + header.slots_offset);
+        capacity_ = header.capacity;
+        size_ = header.size;
+        return true;
+    }
+
+    /**
+     * \brief Maps the snapshot file at \p path read-only
+     * \return Whether the file has been mapped and holds a valid snapshot
+     * \note Only supported on POSIX systems, elsewhere it always fails
+     * \complexity O(1), pages are loaded by the lookups touching them
+     */
+    bool map(const std::string& path) {
+        reset();
+#ifdef HASH_TABLE_SNAPSHOT_MMAP
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0)
+            return false;
+        struct stat status;
+        void* address = MAP_FAILED;
+        if (::fstat(file, &status) == 0 && status.st_size > 0)
+            address = ::mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, file, 0);
+        ::close(file);
+        if (address == MAP_FAILED)
+            return false;
+
+        std::size_t size = status.st_size;
+        std::shared_ptr<const void> mapping(address, [size](const void* address) {
+            ::munmap(const_cast<void*>(address), size);
+        });
+        if (!assign(address, size))
+            return false;
+        mapping_ = mapping;
+        return true;
+#else
+        (void)path;
+        return false;
+#endif
+    }
+
+    /**
+     * \brief Detaches the view from its snapshot, unmapping it if it was
+     * the last view on a mapped file
+     */
+    void reset() {
+        mapping_.reset();
+        control_ = nullptr;
+        slots_ = nullptr;
+        capacity_ = 0;
+        size_ = 0;
+    }
+
+    /**
+     * \brief Find an element
+     * \return Pointer to the item in the snapshot or null if not found
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    const item_type* find(const Key& key) const {
+        std::size_t index = table_type::probe(control_, slots_, capacity_, key,
+                                              table_type::mix_hash(hasher_(key)), key_equal_);
+        return index == capacity_ ? nullptr : slots_ + index;
+    }
+
+    /**
+     * \brief Whether \p key is in the snapshot
+     * \complexity Average: O(1) Worst: O(n)
+     */
+    bool contains(const Key& key) const {
+        return find(key);
+    }
+
+    /**
+     * \brief Calls \p func on every item
+     * \complexity O(capacity)
+     */
+    template<class Func>
+        void for_each(const Func& func) const {
+            for (std::size_t i = 0; i < capacity_; i++)
+                if (table_type::is_full(control_[i]))
+                    func(slots_[i]);
+        }
+
+    /**
+     * \brief Number of elements
+     * \complexity O(1)
+     */
+    int size() const {
+        return size_;
+    }
+
+    /**
+     * \brief Whether the view has no elements (or no snapshot)
+     * \complexity O(1)
+     */
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    /**
+     * \brief Number of slots in the snapshot
+     * \complexity O(1)
+     */
+    std::size_t capacity() const {
+        return capacity_;
+    }
+
+    /**
+     * \brief Writes \p table as a snapshot
+     * \return Whether the stream is still good afterwards
+     * \complexity O(capacity)
+     */
+    static bool write(const table_type& table, std::ostream& out) {
+        Header header = Header::make(table.capacity_, table.size_);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(table.control_.data()), table.control_.size());
+        std::size_t written = sizeof(header) + table.control_.size();
+        out.write(std::vector<char>(header.slots_offset - written, 0).data(), header.slots_offset - written);
+
+        // Copied into zeroed storage, so neither free slots nor padding leak memory contents
+        std::vector<typename table_type::slot_type> buffer(write_buffer_slots);
+        for (std::size_t done = 0; done < table.capacity_; ) {
+            std::size_t count = std::min(buffer.size(), table.capacity_ - done);
+            std::memset(static_cast<void*>(buffer.data()), 0, count * sizeof(buffer[0]));
+            for (std::size_t i = 0; i < count; i++)
+                if (table_type::is_full(table.control_[done + i]))
+                    new (&buffer[i]) item_type(table.slot(done + i));
+            out.write(reinterpret_cast<const char*>(buffer.data()), count * sizeof(buffer[0]));
+            done += count;
+        }
+        return bool(out);
+    }
+
+private:
+    /**
+     * \brief Start of the snapshot, followed by the control bytes and,
+     * at slots_offset, by the slots
+     */
+    struct Header {
+        static Header make(std::size_t capacity, std::size_t size) {
+            Header header;
+            std::memcpy(header.magic, expected_magic, sizeof(header.magic));
+            header.item_size = sizeof(item_type);
+            header.item_alignment = alignof(item_type);
+            header.capacity = capacity;
+            header.size = size;
+            header.control_offset = sizeof(Header);
+            std::uint64_t control_end = header.control_offset + control_size(capacity);
+            header.slots_offset = (control_end + slot_alignment - 1) / slot_alignment * slot_alignment;
+            return header;
+        }
+
+        /**
+         * \brief Whether the header describes a snapshot of \p file_size bytes for this view
+         */
+        bool valid(std::size_t file_size) const {
+            return std::memcmp(magic, expected_magic, sizeof(magic)) == 0 &&
+                item_size == sizeof(item_type) && item_alignment == alignof(item_type) &&
+                (capacity == 0 || (capacity >= table_type::group_width && !(capacity & (capacity - 1)))) &&
+                size <= capacity && capacity <= file_size &&
+                control_offset == sizeof(Header) &&
+                slots_offset >= control_offset + control_size(capacity) &&
+                slots_offset <= file_size &&
+                capacity <= (file_size - slots_offset) / sizeof(item_type);
+        }
+
+        static std::uint64_t control_size(std::uint64_t capacity) {
+            return capacity ? capacity + table_type::group_width - 1 : 0;
+        }
+
+        char magic[8];
+        std::uint32_t item_size;
+        std::uint32_t item_alignment;
+        std::uint64_t capacity;
+        std::uint64_t size;
+        std::uint64_t control_offset;
+        std::uint64_t slots_offset;
+    };
+
+    /// Also starts the control bytes and slots on their own cache lines
+    static const std::size_t slot_alignment = 64;
+    static constexpr const char* expected_magic = "FHTSNAP1";
+    static const std::size_t write_buffer_slots = 1024;
+
+    std::shared_ptr<const void> mapping_;
+    const signed char* control_ = nullptr;
+    const item_type* slots_ = nullptr;
+    std::size_t capacity_ = 0;
+    int size_ = 0;
+    Hash hasher_;
+    KeyEqual key_equal_;
+};
+
+template<class Key, class Value, class Hash, class KeyEqual>
+    const std::size_t HashTableView<Key, Value, Hash, KeyEqual>::slot_alignment;
+template<class Key, class Value, class Hash, class KeyEqual>
+    constexpr const char* HashTableView<Key, Value, Hash, KeyEqual>::expected_magic;
+template<class Key, class Value, class Hash, class KeyEqual>
+    const std::size_t HashTableView<Key, Value, Hash, KeyEqual>::write_buffer_slots;
+
+/**
+ * \brief Writes a snapshot of \p table, to be read back with HashTableView
+ * \return Whether the stream is still good afterwards
+ * \complexity O(capacity)
+ */
+template<class Key, class Value, class Hash, class KeyEqual>
+    bool write_snapshot(const FlatHashTable<Key,Value,Hash,KeyEqual>& table, std::ostream& out) {
+        return HashTableView<Key,Value,Hash,KeyEqual>::write(table, out);
+    }
+
+/**
+ * \brief Writes a snapshot of \p table, to be read back with HashTableView
+ *
+ * The items are first copied into a FlatHashTable, as the snapshot has its layout.
+ * \return Whether the stream is still good afterwards
+ * \complexity O(n+m)
+ */
+template<class Key, class Value, class Hash, class KeyEqual, class Allocator, bool CollectStats>
+    bool write_snapshot(const HashTable<Key,Value,Hash,KeyEqual,Allocator,CollectStats>& table, std::ostream& out) {
+        FlatHashTable<Key,Value,Hash,KeyEqual> flat(16, table.hash_function(), table.key_eq());
+        flat.reserve(table.size());
+        for (const auto& item : table)
+            flat.insert_or_assign(item.first, item.second);
+        return write_snapshot(flat, out);
+    }
+
+/**
+ * \brief Writes a snapshot of \p table to the file at \p path
+ * \return Whether the file has been written successfully
+ */
+template<class Table>
+    bool write_snapshot(const Table& table, const std::string& path) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        return write_snapshot(table, out) && out.flush();
+    }
+
+#endif // HASH_TABLE_SNAPSHOT_HPP
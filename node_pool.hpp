@@ -0,0 +1,347 @@
+#ifndef NODE_POOL_HPP
+#define NODE_POOL_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+/**
+ * \brief Allocator for nodes of a single size
+ *
+ * Nodes are carved out of large blocks obtained from \p Allocator, the
+ * block size doubles up to a limit as the pool grows. Deallocated nodes
+ * go to a free list and are reused by the following allocations, blocks
+ * are only given back all at once by clear() or the destructor.
+ */
+template<class Allocator = std::allocator<char>>
+class NodePool {
+public:
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<char>
+        allocator_type;
+
+    /**
+     * \param node_size Size of the nodes, if 0 it's taken from the first allocation
+     * \param alignment Alignment of the nodes
+     */
+    explicit NodePool(std::size_t node_size = 0, std::size_t alignment = 1,
+                      const Allocator& allocator = Allocator())
+        : allocator_(allocator) {
+        if (node_size)
+            set_node_size(node_size, alignment);
+    }
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    NodePool(NodePool&& other) : allocator_(other.allocator_) {
+        swap(other);
+    }
+
+    NodePool& operator=(NodePool&& other) {
+        NodePool moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+
+    /**
+     * \note Doesn't call the destructors of the nodes still in use
+     */
+    ~NodePool() {
+        clear();
+    }
+
+    void swap(NodePool& other) {
+        using std::swap;
+        swap(allocator_, other.allocator_);
+        swap(blocks_, other.blocks_);
+        swap(free_, other.free_);
+        swap(current_, other.current_);
+        swap(end_, other.end_);
+        swap(node_size_, other.node_size_);
+        swap(alignment_, other.alignment_);
+        swap(block_nodes_, other.block_nodes_);
+        swap(node_count_, other.node_count_);
+        swap(free_count_, other.free_count_);
+        swap(block_count_, other.block_count_);
+        swap(bytes_reserved_, other.bytes_reserved_);
+    }
+
+    /**
+     * \brief Returns storage for a node
+     * \pre \p size and \p alignment are the same for all the calls
+     * \complexity Amortized O(1)
+     */
+    void* allocate(std::size_t size, std::size_t alignment) {
+        if (!node_size_)
+            set_node_size(size, alignment);
+
+        if (free_) {
+            FreeNode* node = free_;
+            free_ = node->next;
+            free_count_--;
+            return node;
+        }
+
+        if (current_ == end_)
+            grow();
+        void* node = current_;
+        current_ += node_size_;
+        node_count_++;
+        return node;
+    }
+
+    /**
+     * \brief Gives back a node returned by allocate() for reuse
+     * \complexity O(1)
+     */
+    void deallocate(void* node) {
+        FreeNode* free = ::new (node) FreeNode;
+        free->next = free_;
+        free_ = free;
+        free_count_++;
+    }
+
+    /**
+     * \brief Constructs an object in a node
+     */
+    template<class T, class... Args>
+        T* create(Args&&... args) {
+            void* node = allocate(sizeof(T), alignof(T));
+            try {
+                return ::new (node) T(std::forward<Args>(args)...);
+            } catch (...) {
+                deallocate(node);
+                throw;
+            }
+        }
+
+    /**
+     * \brief Destroys an object returned by create() and recycles its node
+     */
+    template<class T>
+        void destroy(T* object) {
+            object->~T();
+            deallocate(object);
+        }
+
+    /**
+     * \brief Releases all the blocks
+     * \note Doesn't call the destructors of the nodes still in use
+     * \complexity O(blocks)
+     */
+    void clear() {
+        while (blocks_) {
+            Block* next = blocks_->next;
+            std::size_t size = blocks_->size;
+            blocks_->~Block();
+            allocator_.deallocate(reinterpret_cast<char*>(blocks_), size);
+            blocks_ = next;
+        }
+        free_ = nullptr;
+        current_ = end_ = nullptr;
+        block_nodes_ = min_block_nodes;
+        node_count_ = free_count_ = block_count_ = bytes_reserved_ = 0;
+    }
+
+    /**
+     * \brief Takes over the blocks of \p other, which is left empty
+     *
+     * The nodes \p other handed out stay valid and can be deallocated
+     * into this pool, its free nodes become free nodes of this pool.
+     * \pre Both pools have the same node size and alignment, and their
+     *      allocators can deallocate each other's blocks
+     * \complexity O(blocks + free nodes of \p other)
+     */
+    void merge(NodePool& other) {
+        if (&other == this || !other.blocks_)
+            return;
+        if (!node_size_) {
+            node_size_ = other.node_size_;
+            alignment_ = other.alignment_;
+        }
+
+        // The rest of its current block is handed out straight to the free list
+        for (; other.current_ != other.end_; other.current_ += node_size_) {
+            other.deallocate(other.current_);
+            other.node_count_++;
+        }
+
+        Block* last_block = other.blocks_;
+        while (last_block->next)
+            last_block = last_block->next;
+        last_block->next = blocks_;
+        blocks_ = other.blocks_;
+
+        if (other.free_) {
+            FreeNode* last_free = other.free_;
+            while (last_free->next)
+                last_free = last_free->next;
+            last_free->next = free_;
+            free_ = other.free_;
+        }
+
+        node_count_ += other.node_count_;
+        free_count_ += other.free_count_;
+        block_count_ += other.block_count_;
+        bytes_reserved_ += other.bytes_reserved_;
+        block_nodes_ = std::max(block_nodes_, other.block_nodes_);
+
+        other.blocks_ = nullptr;
+        other.clear();
+    }
+
+    /**
+     * \brief Number of nodes handed out so far (in use or free)
+     */
+    std::size_t node_count() const {
+        return node_count_;
+    }
+
+    /**
+     * \brief Number of nodes in the free list
+     */
+    std::size_t free_count() const {
+        return free_count_;
+    }
+
+    /**
+     * \brief Number of blocks allocated so far
+     */
+    std::size_t block_count() const {
+        return block_count_;
+    }
+
+    /**
+     * \brief Number of bytes reserved by the blocks
+     */
+    std::size_t bytes_reserved() const {
+        return bytes_reserved_;
+    }
+
+    /**
+     * \brief Size of each node including padding, 0 if not known yet
+     */
+    std::size_t node_size() const {
+        return node_size_;
+    }
+
+    allocator_type get_allocator() const {
+        return allocator_;
+    }
+
+private:
+    struct Block {
+        Block* next;
+        std::size_t size;
+    };
+
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    void set_node_size(std::size_t size, std::size_t alignment) {
+        alignment_ = std::max(alignment, alignof(FreeNode));
+        size = std::max(size, sizeof(FreeNode));
+        node_size_ = (size + alignment_ - 1) / alignment_ * alignment_;
+    }
+
+    /**
+     * \brief Allocates a new block, the nodes in the current one must be used up
+     */
+    void grow() {
+        std::size_t header = (sizeof(Block) + alignment_ - 1) / alignment_ * alignment_;
+        std::size_t size = header + block_nodes_ * node_size_;
+        Block* block = ::new (allocator_.allocate(size)) Block;
+        block->next = blocks_;
+        block->size = size;
+        blocks_ = block;
+
+        current_ = reinterpret_cast<char*>(block) + header;
+        end_ = current_ + block_nodes_ * node_size_;
+
+        block_count_++;
+        bytes_reserved_ += size;
+        if (block_nodes_ * node_size_ < max_block_size)
+            block_nodes_ *= 2;
+    }
+
+    static const std::size_t min_block_nodes = 16;
+    static const std::size_t max_block_size = 1 << 20;
+
+    allocator_type allocator_;
+    Block* blocks_ = nullptr;
+    FreeNode* free_ = nullptr;
+    char* current_ = nullptr;
+    char* end_ = nullptr;
+    std::size_t node_size_ = 0;
+    std::size_t alignment_ = 1;
+    std::size_t block_nodes_ = min_block_nodes;
+    std::size_t node_count_ = 0;
+    std::size_t free_count_ = 0;
+    std::size_t block_count_ = 0;
+    std::size_t bytes_reserved_ = 0;
+};
+
+template<class Allocator>
+    const std::size_t NodePool<Allocator>::min_block_nodes;
+template<class Allocator>
+    const std::size_t NodePool<Allocator>::max_block_size;
+
+/**
+ * \brief Standard allocator drawing single objects from a NodePool
+ *
+ * Lets node-based standard containers such as std::list use the pool,
+ * all the containers sharing a pool can splice nodes between each other.
+ * Arrays are allocated from the pool's underlying allocator.
+ */
+template<class T, class Allocator = std::allocator<char>>
+class PoolAllocator {
+public:
+    typedef T                   value_type;
+    typedef NodePool<Allocator> pool_type;
+
+    explicit PoolAllocator(pool_type* pool) : pool_(pool) {}
+
+    template<class U>
+        PoolAllocator(const PoolAllocator<U, Allocator>& other) : pool_(other.pool()) {}
+
+    T* allocate(std::size_t count) {
+        if (count != 1)
+            return array_allocator().allocate(count);
+        return static_cast<T*>(pool_->allocate(sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* pointer, std::size_t count) {
+        if (count != 1)
+            array_allocator().deallocate(pointer, count);
+        else
+            pool_->deallocate(pointer);
+    }
+
+    pool_type* pool() const {
+        return pool_;
+    }
+
+    template<class U>
+        bool operator==(const PoolAllocator<U, Allocator>& other) const {
+            return pool_ == other.pool();
+        }
+
+    template<class U>
+        bool operator!=(const PoolAllocator<U, Allocator>& other) const {
+            return pool_ != other.pool();
+        }
+
+private:
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<T> array_allocator_type;
+
+    array_allocator_type array_allocator() const {
+        return array_allocator_type(pool_->get_allocator());
+    }
+
+    pool_type* pool_;
+};
+
+#endif // NODE_POOL_HPP
@@ -0,0 +1,600 @@
+#ifndef PERSISTENT_RED_BLACK_TREE_HPP
+#define PERSISTENT_RED_BLACK_TREE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * \brief Node of a PersistentRedBlackTree, possibly shared by several versions
+ */
+template<class Key, class Value>
+struct PersistentRedBlackNode {
+    enum class Color {
+        BLACK,
+        RED,
+    };
+
+    PersistentRedBlackNode(const Key& key, const Value& value, Color color)
+        : key(key), value(value), left(nullptr), right(nullptr), references(1), color(color) {}
+
+    /**
+     * \brief Copy of \p other, sharing its children
+     */
+    PersistentRedBlackNode(const PersistentRedBlackNode& other)
+        : key(other.key), value(other.value), left(other.left), right(other.right),
+          references(1), color(other.color) {
+        if (left)
+            left->references.fetch_add(1, std::memory_order_relaxed);
+        if (right)
+            right->references.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Key key;
+    Value value;
+    PersistentRedBlackNode* left;
+    PersistentRedBlackNode* right;
+    /// Number of parents and tree versions pointing to the node
+    std::atomic<int> references;
+    Color color;
+};
+
+/**
+ * \brief Ordered map whose copies are O(1) snapshots
+ *
+ * Nodes are reference counted and never modified once shared: insert()
+ * and erase() copy the path from the root to the nodes they touch and
+ * keep pointing to the untouched subtrees, so every copy of the tree
+ * keeps seeing the elements it had when it was taken. Nodes only
+ * referenced by this tree are modified in place, updates between two
+ * snapshots copy each node at most once.
+ *
+ * There are no parent pointers, which is what makes sharing subtrees
+ * possible, so elements are reached by find() and traverse() rather
+ * than by iterators.
+ *
+ * Different copies can be used and destroyed from different threads,
+ * a single copy is not thread-safe. AtomicSnapshot publishes copies
+ * from a writer to lock-free readers.
+ * \note Nodes are deallocated by whichever copy releases them last,
+ *       copies of \p Allocator must be able to deallocate each other's nodes
+ */
+template<class Key, class Value, class Comparator = std::less<Key>,
+         class Allocator = std::allocator<std::pair<const Key, Value>>>
+class PersistentRedBlackTree {
+public:
+    typedef Key                                 key_type;
+    typedef Value                               value_type;
+    typedef PersistentRedBlackNode<Key,Value>   node_type;
+    typedef node_type*                          node_pointer;
+    typedef const node_type*                    node_const_pointer;
+    typedef typename node_type::Color           color_type;
+    typedef Allocator                           allocator_type;
+
+    explicit PersistentRedBlackTree(const Allocator& allocator = Allocator())
+        : root_(nullptr), size_(0), allocator_(allocator) {}
+
+    /**
+     * \brief Snapshot of \p other, sharing all its nodes
+     * \complexity O(1)
+     */
+    PersistentRedBlackTree(const PersistentRedBlackTree& other)
+        : root_(other.root_), size_(other.size_), allocator_(other.allocator_) {
+        if (root_)
+            root_->references.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    PersistentRedBlackTree(PersistentRedBlackTree&& other)
+        : PersistentRedBlackTree(other.get_allocator()) {
+        swap(other);
+    }
+
+    PersistentRedBlackTree& operator=(PersistentRedBlackTree other) {
+        swap(other);
+        return *this;
+    }
+
+    /**
+     * \complexity O(1) if the nodes are shared with other copies,
+     *             O(n) for the ones only this tree references
+     */
+    ~PersistentRedBlackTree() {
+        release(root_);
+    }
+
+    void swap(PersistentRedBlackTree& other) {
+        std::swap(root_, other.root_);
+        std::swap(size_, other.size_);
+        std::swap(allocator_, other.allocator_);
+    }
+
+    /**
+     * \brief Removes all the elements, leaving the other copies untouched
+     * \complexity Same as the destructor
+     */
+    void clear() {
+        release(root_);
+        root_ = nullptr;
+        size_ = 0;
+    }
+
+    /**
+     * \brief Insert new element (assign if already present)
+     * \return Whether the key wasn't in the tree
+     * \complexity O(log n)
+     */
+    bool insert(const Key& key, const Value& value) {
+        node_pointer* path[max_height];
+        int depth = 0;
+        for (node_pointer* link = &root_; ; ) {
+            if (!*link) {
+                *link = create(key, value, root_ ? color_type::RED : color_type::BLACK);
+                path[depth++] = link;
+                break;
+            }
+            node_pointer node = unshare(*link);
+            path[depth++] = link;
+            if (Comparator()(key, node->key)) {
+                link = &node->left;
+            } else if (Comparator()(node->key, key)) {
+                link = &node->right;
+            } else {
+                node->value = value;
+                return false;
+            }
+        }
+        size_++;
+        insert_fixup(path, depth - 1);
+        return true;
+    }
+
+    /**
+     * \brief Remove the element with the given key
+     * \return Whether the key was in the tree
+     * \complexity O(log n)
+     */
+    bool erase(const Key& key) {
+        // Looked up first, so a missing key doesn't copy the path to it
+        if (!find(key))
+            return false;
+
+        // One more slot for the node erase_fixup() might move into the path
+        node_pointer* path[max_height + 1];
+        int depth = 0;
+        node_pointer found = nullptr;
+        for (node_pointer* link = &root_; !found; ) {
+            node_pointer node = unshare(*link);
+            path[depth++] = link;
+            if (Comparator()(key, node->key))
+                link = &node->left;
+            else if (Comparator()(node->key, key))
+                link = &node->right;
+            else
+                found = node;
+        }
+
+        // With two children, the successor takes its place and is removed instead
+        node_pointer removed = found;
+        if (found->left && found->right) {
+            node_pointer* link = &found->right;
+            for (;;) {
+                removed = unshare(*link);
+                path[depth++] = link;
+                if (!removed->left)
+                    break;
+                link = &removed->left;
+            }
+            std::swap(found->key, removed->key);
+            std::swap(found->value, removed->value);
+        }
+
+        node_pointer* link = path[depth - 1];
+        *link = removed->left ? removed->left : removed->right;
+        removed->left = removed->right = nullptr;
+        bool black = removed->color == color_type::BLACK;
+        release(removed);
+        size_--;
+
+        if (black)
+            erase_fixup(path, depth - 1);
+        return true;
+    }
+
+    /**
+     * \brief Find an element
+     * \return Pointer to the value or null if not found
+     * \complexity O(log n)
+     */
+    const Value* find(const Key& search) const {
+        for (node_const_pointer node = root_; node; ) {
+            if (Comparator()(search, node->key))
+                node = node->left;
+            else if (Comparator()(node->key, search))
+                node = node->right;
+            else
+                return &node->value;
+        }
+        return nullptr;
+    }
+
+    /**
+     * \brief Whether \p search is in the tree
+     * \complexity O(log n)
+     */
+    bool contains(const Key& search) const {
+        return find(search);
+    }
+
+    /**
+     * \brief Calls \p func(key, value) on the elements in key order
+     * \complexity O(n)
+     */
+    template<class Func>
+        void traverse(const Func& func) const {
+            const node_type* pending[max_height];
+            int count = 0;
+            for (node_const_pointer node = root_; ; node = node->right) {
+                for (; node; node = node->left)
+                    pending[count++] = node;
+                if (!count)
+                    return;
+                node = pending[--count];
+                func(node->key, node->value);
+            }
+        }
+
+    /**
+     * \brief Calls \p func(key, value) in key order on the elements
+     * whose key is in [\p low, \p high)
+     * \complexity O(log n + k) for k elements in the range
+     */
+    template<class Func>
+        void traverse_range(const Key& low, const Key& high, const Func& func) const {
+            // Skips the left subtrees entirely below low
+            node_const_pointer node = root_;
+            const node_type* pending[max_height];
+            int count = 0;
+            while (node) {
+                if (Comparator()(node->key, low)) {
+                    node = node->right;
+                } else {
+                    pending[count++] = node;
+                    node = node->left;
+                }
+            }
+            while (count) {
+                node = pending[--count];
+                if (!Comparator()(node->key, high))
+                    return;
+                func(node->key, node->value);
+                for (node = node->right; node; node = node->left)
+                    pending[count++] = node;
+            }
+        }
+
+    /**
+     * \brief Number of elements
+     * \complexity O(1)
+     */
+    int size() const {
+        return size_;
+    }
+
+    /**
+     * \brief Whether the tree is empty
+     */
+    bool empty() const {
+        return !root_;
+    }
+
+    /**
+     * \brief Number of nodes on the longest path from the root
+     * \complexity O(n)
+     */
+    int height() const {
+        return height_of(root_);
+    }
+
+    /**
+     * \brief Whether both trees are the same version, or copies of it
+     * \complexity O(1)
+     */
+    bool shares_root(const PersistentRedBlackTree& other) const {
+        return root_ == other.root_;
+    }
+
+    allocator_type get_allocator() const {
+        return allocator_type(allocator_);
+    }
+
+private:
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<node_type>
+        node_allocator_type;
+    typedef std::allocator_traits<node_allocator_type> node_allocator_traits;
+
+    /// Bound on the height, as size() is an int
+    static const int max_height = 2 * 8 * sizeof(int);
+
+    template<class... Args>
+        node_pointer create(Args&&... args) {
+            node_pointer result = node_allocator_traits::allocate(allocator_, 1);
+            try {
+                node_allocator_traits::construct(allocator_, result, std::forward<Args>(args)...);
+            } catch (...) {
+                node_allocator_traits::deallocate(allocator_, result, 1);
+                throw;
+            }
+            return result;
+        }
+
+    /**
+     * \brief Drops a reference to \p node, destroying the nodes no longer referenced
+     * \complexity O(1) per destroyed node
+     */
+    void release(node_pointer node) {
+        while (node && node->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            release(node->left);
+            node_pointer right = node->right;
+            node_allocator_traits::destroy(allocator_, node);
+            node_allocator_traits::deallocate(allocator_, node, 1);
+            node = right;
+        }
+    }
+
+    /**
+     * \brief Makes \p link point to a node only referenced by it, copying
+     *        the current one if it is shared
+     * \return The node now in \p link
+     * \complexity O(1)
+     */
+    node_pointer unshare(node_pointer& link) {
+        // Nodes only this version references can't be shared concurrently
+        if (link->references.load(std::memory_order_acquire) == 1)
+            return link;
+        node_pointer copy = create(*link);
+        release(link);
+        return link = copy;
+    }
+
+    static bool is_black(node_const_pointer node) {
+        return !node || node->color == color_type::BLACK;
+    }
+
+    /**
+     * \brief Rotates the subtree in \p link, moving its root down to the left
+     * (or to the right if not \p left)
+     * \pre The node in \p link and the child moving up are unshared
+     */
+    static void rotate(node_pointer& link, bool left) {
+        node_pointer node = link;
+        if (left) {
+            node_pointer child = node->right;
+            node->right = child->left;
+            child->left = node;
+            link = child;
+        } else {
+            node_pointer child = node->left;
+            node->left = child->right;
+            child->right = node;
+            link = child;
+        }
+    }
+
+    /**
+     * \brief Fix colors after inserting the red node in \p path[index]
+     * \param path Links from the root to the inserted node, all unshared
+     * \complexity O(log n)
+     */
+    void insert_fixup(node_pointer** path, int index) {
+        while (index >= 2 && (*path[index - 1])->color == color_type::RED) {
+            node_pointer node = *path[index];
+            node_pointer parent = *path[index - 1];
+            node_pointer grandparent = *path[index - 2];
+            bool parent_left = grandparent->left == parent;
+            node_pointer& uncle = parent_left ? grandparent->right : grandparent->left;
+
+            if (!is_black(uncle)) {
+                unshare(uncle)->color = color_type::BLACK;
+                parent->color = color_type::BLACK;
+                grandparent->color = color_type::RED;
+                index -= 2;
+                continue;
+            }
+
+            if ((parent->right == node) == parent_left) {
+                // Inner child, moved to the outside first
+                rotate(*path[index - 1], parent_left);
+                parent = *path[index - 1];
+            }
+            parent->color = color_type::BLACK;
+            grandparent->color = color_type::RED;
+            rotate(*path[index - 2], !parent_left);
+            break;
+        }
+        root_->color = color_type::BLACK;
+    }
+
+    /**
+     * \brief Fix colors after removing a black node, whose child is now in
+     * \p path[index] (possibly null)
+     * \param path Links from the root, the nodes above \p index are unshared,
+     *        with room for one more link
+     * \complexity O(log n)
+     */
+    void erase_fixup(node_pointer** path, int index) {
+        while (index > 0 && is_black(*path[index])) {
+            node_pointer parent = *path[index - 1];
+            bool left = path[index] == &parent->left;
+            node_pointer& sibling_link = left ? parent->right : parent->left;
+            node_pointer sibling = unshare(sibling_link);
+
+            if (sibling->color == color_type::RED) {
+                // Red sibling: rotated above the parent, leaving a black one
+                sibling->color = color_type::BLACK;
+                parent->color = color_type::RED;
+                rotate(*path[index - 1], left);
+                path[index + 1] = path[index];
+                path[index] = left ? &sibling->left : &sibling->right;
+                index++;
+                continue;
+            }
+
+            node_pointer& near = left ? sibling->left : sibling->right;
+            node_pointer& far = left ? sibling->right : sibling->left;
+            if (is_black(near) && is_black(far)) {
+                sibling->color = color_type::RED;
+                index--;
+                continue;
+            }
+
+            if (is_black(far)) {
+                unshare(near)->color = color_type::BLACK;
+                sibling->color = color_type::RED;
+                rotate(sibling_link, !left);
+                sibling = sibling_link;
+            }
+            node_pointer& outer = left ? sibling->right : sibling->left;
+            unshare(outer)->color = color_type::BLACK;
+            sibling->color = parent->color;
+            parent->color = color_type::BLACK;
+            rotate(*path[index - 1], left);
+            return;
+        }
+        if (*path[index])
+            unshare(*path[index])->color = color_type::BLACK;
+    }
+
+    static int height_of(node_const_pointer node) {
+        if (!node)
+            return 0;
+        return 1 + std::max(height_of(node->left), height_of(node->right));
+    }
+
+    node_pointer root_;
+    int size_;
+    node_allocator_type allocator_;
+};
+
+template<class Key, class Value, class Comparator, class Allocator>
+    const int PersistentRedBlackTree<Key, Value, Comparator, Allocator>::max_height;
+
+/**
+ * \brief Latest version of a value, published by a writer and read without locks
+ *
+ * Meant for PersistentRedBlackTree: the writer updates its own copy of the
+ * tree and calls publish(), readers call load() to get an O(1) snapshot
+ * and keep using it as long as they want, no matter how many versions are
+ * published in the meantime.
+ *
+ * Readers announce themselves in the counter of the current generation
+ * while they copy a version. Each publish() retires the replaced version
+ * in the current generation and, once the previous generation has no
+ * reader left, destroys the versions retired before the current one and
+ * starts a new generation. A replaced version thus waits for the calls
+ * to load() already in progress, never for the ones started afterwards,
+ * however often readers call it.
+ * \pre Copying a \p Tree is thread-safe while the source isn't modified
+ */
+template<class Tree>
+class AtomicSnapshot {
+public:
+    explicit AtomicSnapshot(const Tree& initial = Tree())
+        : current_(new Tree(initial)), generation_(0) {
+        readers_[0] = 0;
+        readers_[1] = 0;
+    }
+
+    AtomicSnapshot(const AtomicSnapshot&) = delete;
+    AtomicSnapshot& operator=(const AtomicSnapshot&) = delete;
+
+    /**
+     * \pre No load() or publish() in progress
+     */
+    ~AtomicSnapshot() {
+        for (const Retired& retired : retired_)
+            delete retired.tree;
+        delete current_.load();
+    }
+
+    /**
+     * \brief Copy of the latest published version
+     * \note Can be called from any thread, it doesn't lock nor wait on the writer
+     * \complexity O(1) plus the copy of \p Tree
+     */
+    Tree load() const {
+        std::uint64_t generation;
+        for (;;) {
+            generation = generation_.load();
+            readers_[generation & 1].fetch_add(1);
+            // The generation may have ended before the reader was counted
+            if (generation_.load() == generation)
+                break;
+            readers_[generation & 1].fetch_sub(1);
+        }
+        Tree result(*current_.load());
+        readers_[generation & 1].fetch_sub(1);
+        return result;
+    }
+
+    /**
+     * \brief Makes \p tree the version returned by the following calls to load()
+     * \note Only one thread at a time can publish
+     * \complexity O(1) plus the copy of \p Tree, and destroying the reclaimed versions
+     */
+    void publish(const Tree& tree) {
+        Tree* previous = current_.exchange(new Tree(tree));
+        retired_.push_back(Retired{previous, generation_.load()});
+        reclaim();
+    }
+
+    /**
+     * \brief Number of replaced versions not destroyed yet
+     * \note Only meaningful on the publishing thread
+     */
+    std::size_t retired_count() const {
+        return retired_.size();
+    }
+
+private:
+    struct Retired {
+        Tree* tree;
+        /// Generation during which the version was replaced
+        std::uint64_t generation;
+    };
+
+    /**
+     * \brief Destroys the versions retired before the current generation
+     * and starts a new one, unless readers of the previous one remain
+     *
+     * A version retired in generation g can only be copied by readers
+     * counted in g or before: the ones counted later see a newer version.
+     * Readers of the previous generation share their counter with the
+     * next one, which is why it must be empty before moving on.
+     */
+    void reclaim() {
+        std::uint64_t generation = generation_.load();
+        if (readers_[(generation + 1) & 1].load() != 0)
+            return;
+        // Versions are retired in increasing generations
+        auto first_kept = std::find_if(retired_.begin(), retired_.end(), [generation](const Retired& retired) {
+            return retired.generation == generation;
+        });
+        for (auto it = retired_.begin(); it != first_kept; ++it)
+            delete it->tree;
+        retired_.erase(retired_.begin(), first_kept);
+        generation_.store(generation + 1);
+    }
+
+    std::atomic<Tree*> current_;
+    std::atomic<std::uint64_t> generation_;
+    /// Readers in load() for the even and odd generations
+    mutable std::atomic<int> readers_[2];
+    std::vector<Retired> retired_;
+};
+
+#endif // PERSISTENT_RED_BLACK_TREE_HPP
@@ -0,0 +1,669 @@
+#ifndef RADIX_TRIE_HPP
+#define RADIX_TRIE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+
+#include "node_pool.hpp"
+
+/**
+ * \brief Trie with compressed paths and adaptive nodes (Adaptive Radix Tree)
+ *
+ * Same interface as Trie. Chains of nodes with a single child are collapsed:
+ * each node stores the bytes leading to it from its parent's edge as a
+ * prefix, so long keys sharing few branches (URLs, file paths) take a few
+ * nodes instead of one per character. Up to max_prefix bytes are stored in
+ * a node, longer runs use a chain of nodes.
+ *
+ * The children of a node are kept in one of four layouts, picked from
+ * their number and changed as it grows or shrinks:
+ *  - up to 4: sorted labels next to the child pointers
+ *  - up to 16: the same, searched with SSE2 when available
+ *  - up to 48: a byte per label indexing the child pointers
+ *  - up to 256: a pointer per label
+ *
+ * Nodes without children only have a header. Each layout has its own NodePool.
+ */
+class RadixTrie {
+public:
+    /// Bytes of a key stored in a single node
+    static const std::size_t max_prefix = 11;
+
+    RadixTrie() : root_(create_leaf()), size_(0) {}
+
+    /**
+     * \brief Copies the nodes into new pools
+     * \complexity O(n)
+     */
+    RadixTrie(const RadixTrie& other) : RadixTrie() {
+        destroy(root_);
+        root_ = copy_subtree(other.root_);
+        size_ = other.size_;
+    }
+
+    RadixTrie(RadixTrie&& other) : RadixTrie() {
+        swap(other);
+    }
+
+    RadixTrie& operator=(RadixTrie other) {
+        swap(other);
+        return *this;
+    }
+
+    void swap(RadixTrie& other) {
+        for (int kind = 0; kind < kind_count; kind++)
+            pools_[kind].swap(other.pools_[kind]);
+        std::swap(root_, other.root_);
+        std::swap(size_, other.size_);
+    }
+
+    /**
+     * \brief Removes all the words and gives the pool blocks back
+     * \complexity O(blocks)
+     */
+    void clear() {
+        for (NodePool<>& pool : pools_)
+            pool.clear();
+        root_ = create_leaf();
+        size_ = 0;
+    }
+
+    /**
+     * \brief Add a new word to the trie
+     * \complexity O(word.size)
+     */
+    void insert(const std::string& word) {
+        const unsigned char* key = reinterpret_cast<const unsigned char*>(word.data());
+        std::size_t length = word.size();
+        Node** slot = &root_;
+        for (std::size_t pos = 0; ; pos++) {
+            Node* node = *slot;
+            std::size_t matched = match_prefix(node, key + pos, length - pos);
+            if (matched < node->prefix_length) {
+                // The word leaves the prefix: a new node takes its matched part
+                Node4* parent = pools_[node4].create<Node4>();
+                std::memcpy(parent->prefix, node->prefix, matched);
+                parent->prefix_length = matched;
+                parent->keys[0] = node->prefix[matched];
+                parent->children[0] = node;
+                parent->count = 1;
+                node->prefix_length -= matched + 1;
+                std::memmove(node->prefix, node->prefix + matched + 1, node->prefix_length);
+                *slot = parent;
+                node = parent;
+            }
+            pos += matched;
+            if (pos == length) {
+                if (!node->marks_end) {
+                    node->marks_end = true;
+                    size_++;
+                }
+                return;
+            }
+            Node** child = find_slot(node, key[pos]);
+            if (!child) {
+                add_child(*slot, key[pos], create_chain(key + pos + 1, length - pos - 1));
+                size_++;
+                return;
+            }
+            slot = child;
+        }
+    }
+
+    /**
+     * \brief Remove a word from the trie
+     * \complexity O(word.size)
+     */
+    void erase(const std::string& word) {
+        const unsigned char* key = reinterpret_cast<const unsigned char*>(word.data());
+        std::size_t length = word.size();
+        // Links followed from the root and the labels of their edges
+        std::vector<std::pair<Node**, unsigned char>> path;
+        path.emplace_back(&root_, 0);
+        for (std::size_t pos = 0; ; pos++) {
+            Node* node = *path.back().first;
+            std::size_t matched = match_prefix(node, key + pos, length - pos);
+            if (matched < node->prefix_length)
+                return;
+            pos += matched;
+            if (pos == length)
+                break;
+            Node** child = find_slot(node, key[pos]);
+            if (!child)
+                return;
+            path.emplace_back(child, key[pos]);
+        }
+
+        Node* found = *path.back().first;
+        if (!found->marks_end)
+            return;
+        found->marks_end = false;
+        size_--;
+
+        // Removes the nodes no longer leading to a word, then merges the
+        // last one left into its child if it's only a link between them
+        std::size_t index = path.size() - 1;
+        for (; index > 0 && !(*path[index].first)->count && !(*path[index].first)->marks_end; index--) {
+            destroy(*path[index].first);
+            remove_child(*path[index - 1].first, path[index].second);
+        }
+        if (index > 0)
+            merge_single_child(*path[index].first);
+    }
+
+    /**
+     * \brief Check if a word exists
+     * \complexity O(word.size)
+     */
+    bool contains(const std::string& word) const {
+        const unsigned char* key = reinterpret_cast<const unsigned char*>(word.data());
+        std::size_t length = word.size();
+        const Node* node = root_;
+        for (std::size_t pos = 0; ; pos++) {
+            if (length - pos < node->prefix_length ||
+                    std::memcmp(node->prefix, key + pos, node->prefix_length) != 0)
+                return false;
+            pos += node->prefix_length;
+            if (pos == length)
+                return node->marks_end;
+            node = find_child(node, key[pos]);
+            if (!node)
+                return false;
+        }
+    }
+
+    /**
+     * \brief Check if a prefix exists
+     * \complexity O(word.size)
+     */
+    bool contains_prefix(const std::string& word) const {
+        const unsigned char* key = reinterpret_cast<const unsigned char*>(word.data());
+        std::size_t length = word.size();
+        const Node* node = root_;
+        for (std::size_t pos = 0; ; pos++) {
+            // Every node leads to a word, so ending within a prefix is a match
+            std::size_t compared = std::min<std::size_t>(length - pos, node->prefix_length);
+            if (std::memcmp(node->prefix, key + pos, compared) != 0)
+                return false;
+            pos += compared;
+            if (pos == length)
+                return true;
+            node = find_child(node, key[pos]);
+            if (!node)
+                return false;
+        }
+    }
+
+    /**
+     * \brief Prints the tree tructure to stdout, one line per node
+     * \complexity O(n)
+     */
+    void print_structure() const {
+        print_structure_recursive(root_, "");
+    }
+
+    /**
+     * \brief Number of words
+     * \complexity O(1)
+     */
+    int size() const {
+        return size_;
+    }
+
+    /**
+     * \brief Whether there are no words
+     * \complexity O(1)
+     */
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    /**
+     * \brief Number of nodes in use, including the root
+     * \complexity O(1)
+     */
+    std::size_t node_count() const {
+        std::size_t count = 0;
+        for (const NodePool<>& pool : pools_)
+            count += pool.node_count() - pool.free_count();
+        return count;
+    }
+
+    /**
+     * \brief Number of bytes reserved by the pool blocks
+     * \complexity O(1)
+     */
+    std::size_t bytes_reserved() const {
+        std::size_t bytes = 0;
+        for (const NodePool<>& pool : pools_)
+            bytes += pool.bytes_reserved();
+        return bytes;
+    }
+
+private:
+    enum Kind {
+        leaf,
+        node4,
+        node16,
+        node48,
+        node256,
+        kind_count
+    };
+
+    struct Node {
+        explicit Node(Kind kind) : kind(kind), prefix_length(0), count(0), marks_end(false) {}
+
+        std::uint8_t kind;
+        std::uint8_t prefix_length;
+        std::uint16_t count;
+        bool marks_end;
+        unsigned char prefix[max_prefix];
+    };
+
+    struct Node4 : Node {
+        Node4() : Node(node4) {}
+        unsigned char keys[4];
+        Node* children[4];
+    };
+
+    struct Node16 : Node {
+        Node16() : Node(node16) {}
+        unsigned char keys[16];
+        Node* children[16];
+    };
+
+    struct Node48 : Node {
+        Node48() : Node(node48) {
+            std::memset(index, no_child, sizeof(index));
+        }
+        /// Position in children for each label, no_child if none
+        unsigned char index[256];
+        Node* children[48];
+    };
+
+    struct Node256 : Node {
+        Node256() : Node(node256) {
+            std::fill(children, children + 256, nullptr);
+        }
+        Node* children[256];
+    };
+
+    static const unsigned char no_child = 0xFF;
+
+    static unsigned capacity(unsigned kind) {
+        static const unsigned capacities[kind_count] = {0, 4, 16, 48, 256};
+        return capacities[kind];
+    }
+
+    /**
+     * \brief Smallest layout holding \p count children
+     */
+    static Kind kind_for(unsigned count) {
+        unsigned kind = leaf;
+        while (capacity(kind) < count)
+            kind++;
+        return Kind(kind);
+    }
+
+    static std::size_t match_prefix(const Node* node, const unsigned char* key, std::size_t length) {
+        std::size_t limit = std::min<std::size_t>(length, node->prefix_length);
+        std::size_t matched = 0;
+        while (matched < limit && node->prefix[matched] == key[matched])
+            matched++;
+        return matched;
+    }
+
+    /**
+     * \brief Link to the child of \p node labeled \p c, null if none
+     * \complexity O(1)
+     */
+    static Node** find_slot(Node* node, unsigned char c) {
+        switch (node->kind) {
+            case node4: {
+                Node4* inner = static_cast<Node4*>(node);
+                for (unsigned i = 0; i < inner->count; i++)
+                    if (inner->keys[i] == c)
+                        return &inner->children[i];
+                return nullptr;
+            }
+            case node16: {
+                Node16* inner = static_cast<Node16*>(node);
+#ifdef __SSE2__
+                __m128i keys = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inner->keys));
+                unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(keys, _mm_set1_epi8(char(c))));
+                mask &= (1u << inner->count) - 1;
+                return mask ? &inner->children[__builtin_ctz(mask)] : nullptr;
+#else
+                for (unsigned i = 0; i < inner->count; i++)
+                    if (inner->keys[i] == c)
+                        return &inner->children[i];
+                return nullptr;
+#endif
+            }
+            case node48: {
+                Node48* inner = static_cast<Node48*>(node);
+                unsigned char index = inner->index[c];
+                return index == no_child ? nullptr : &inner->children[index];
+            }
+            case node256: {
+                Node256* inner = static_cast<Node256*>(node);
+                return inner->children[c] ? &inner->children[c] : nullptr;
+            }
+            default:
+                return nullptr;
+        }
+    }
+
+    static const Node* find_child(const Node* node, unsigned char c) {
+        Node** slot = find_slot(const_cast<Node*>(node), c);
+        return slot ? *slot : nullptr;
+    }
+
+    /**
+     * \brief Copies the labels and children of \p node, in label order
+     * \return Number of children
+     */
+    static unsigned gather(const Node* node, unsigned char* labels, Node** children) {
+        switch (node->kind) {
+            case node4: {
+                const Node4* inner = static_cast<const Node4*>(node);
+                std::copy(inner->keys, inner->keys + inner->count, labels);
+                std::copy(inner->children, inner->children + inner->count, children);
+                break;
+            }
+            case node16: {
+                const Node16* inner = static_cast<const Node16*>(node);
+                std::copy(inner->keys, inner->keys + inner->count, labels);
+                std::copy(inner->children, inner->children + inner->count, children);
+                break;
+            }
+            case node48: {
+                const Node48* inner = static_cast<const Node48*>(node);
+                unsigned count = 0;
+                for (unsigned c = 0; c < 256; c++) {
+                    if (inner->index[c] != no_child) {
+                        labels[count] = c;
+                        children[count++] = inner->children[inner->index[c]];
+                    }
+                }
+                break;
+            }
+            case node256: {
+                const Node256* inner = static_cast<const Node256*>(node);
+                unsigned count = 0;
+                for (unsigned c = 0; c < 256; c++) {
+                    if (inner->children[c]) {
+                        labels[count] = c;
+                        children[count++] = inner->children[c];
+                    }
+                }
+                break;
+            }
+        }
+        return node->count;
+    }
+
+    /**
+     * \brief New node with the prefix and mark of \p header and the given
+     * children, in the layout \p kind
+     */
+    Node* rebuild(const Node* header, Kind kind,
+                  const unsigned char* labels, Node* const* children, unsigned count) {
+        Node* node;
+        switch (kind) {
+            case leaf:
+                node = create_leaf();
+                break;
+            case node4: {
+                Node4* inner = pools_[node4].create<Node4>();
+                std::copy(labels, labels + count, inner->keys);
+                std::copy(children, children + count, inner->children);
+                node = inner;
+                break;
+            }
+            case node16: {
+                Node16* inner = pools_[node16].create<Node16>();
+                std::copy(labels, labels + count, inner->keys);
+                std::copy(children, children + count, inner->children);
+                node = inner;
+                break;
+            }
+            case node48: {
+                Node48* inner = pools_[node48].create<Node48>();
+                for (unsigned i = 0; i < count; i++) {
+                    inner->index[labels[i]] = i;
+                    inner->children[i] = children[i];
+                }
+                node = inner;
+                break;
+            }
+            default: {
+                Node256* inner = pools_[node256].create<Node256>();
+                for (unsigned i = 0; i < count; i++)
+                    inner->children[labels[i]] = children[i];
+                node = inner;
+                break;
+            }
+        }
+        node->count = count;
+        node->marks_end = header->marks_end;
+        node->prefix_length = header->prefix_length;
+        std::memcpy(node->prefix, header->prefix, header->prefix_length);
+        return node;
+    }
+
+    /**
+     * \brief Adds \p child to the node in \p slot with label \p c,
+     * moving the node to a larger layout if it's full
+     * \pre The node has no child labeled \p c
+     */
+    void add_child(Node*& slot, unsigned char c, Node* child) {
+        Node* node = slot;
+        if (node->count < capacity(node->kind)) {
+            switch (node->kind) {
+                case node4:
+                    insert_sorted(static_cast<Node4*>(node)->keys, static_cast<Node4*>(node)->children,
+                                  node->count, c, child);
+                    break;
+                case node16:
+                    insert_sorted(static_cast<Node16*>(node)->keys, static_cast<Node16*>(node)->children,
+                                  node->count, c, child);
+                    break;
+                case node48: {
+                    Node48* inner = static_cast<Node48*>(node);
+                    inner->index[c] = node->count;
+                    inner->children[node->count] = child;
+                    break;
+                }
+                case node256:
+                    static_cast<Node256*>(node)->children[c] = child;
+                    break;
+            }
+            node->count++;
+            return;
+        }
+
+        unsigned char labels[257];
+        Node* children[257];
+        unsigned count = gather(node, labels, children);
+        insert_sorted(labels, children, count, c, child);
+        slot = rebuild(node, kind_for(count + 1), labels, children, count + 1);
+        destroy(node);
+    }
+
+    static void insert_sorted(unsigned char* labels, Node** children, unsigned count,
+                              unsigned char c, Node* child) {
+        unsigned i = count;
+        for (; i > 0 && labels[i - 1] > c; i--) {
+            labels[i] = labels[i - 1];
+            children[i] = children[i - 1];
+        }
+        labels[i] = c;
+        children[i] = child;
+    }
+
+    /**
+     * \brief Removes the child labeled \p c from the node in \p slot, without
+     * destroying it, moving the node to a smaller layout if it's mostly empty
+     */
+    void remove_child(Node*& slot, unsigned char c) {
+        Node* node = slot;
+        unsigned char labels[256];
+        Node* children[256];
+        unsigned count = gather(node, labels, children);
+        unsigned i = 0;
+        while (labels[i] != c)
+            i++;
+        for (count--; i < count; i++) {
+            labels[i] = labels[i + 1];
+            children[i] = children[i + 1];
+        }
+
+        // Shrinks below 3/4 of the smaller capacity, so alternating
+        // inserts and erases don't keep moving the node
+        Kind kind = Kind(node->kind);
+        if (count <= capacity(kind - 1) * 3 / 4) {
+            slot = rebuild(node, kind_for(count), labels, children, count);
+            destroy(node);
+            return;
+        }
+
+        switch (kind) {
+            case node4:
+            case node16: {
+                unsigned char* keys = kind == node4 ? static_cast<Node4*>(node)->keys
+                                                    : static_cast<Node16*>(node)->keys;
+                Node** links = kind == node4 ? static_cast<Node4*>(node)->children
+                                             : static_cast<Node16*>(node)->children;
+                std::copy(labels, labels + count, keys);
+                std::copy(children, children + count, links);
+                break;
+            }
+            case node48: {
+                // The last child fills the hole
+                Node48* inner = static_cast<Node48*>(node);
+                unsigned char hole = inner->index[c];
+                inner->index[c] = no_child;
+                if (hole != count) {
+                    inner->children[hole] = inner->children[count];
+                    for (unsigned label = 0; label < 256; label++) {
+                        if (inner->index[label] == count) {
+                            inner->index[label] = hole;
+                            break;
+                        }
+                    }
+                }
+                break;
+            }
+            default:
+                static_cast<Node256*>(node)->children[c] = nullptr;
+                break;
+        }
+        node->count = count;
+    }
+
+    /**
+     * \brief Collapses the node in \p slot into its child if it has a single
+     * one, doesn't end a word and the joined prefix fits
+     */
+    void merge_single_child(Node*& slot) {
+        Node* node = slot;
+        if (node->count != 1 || node->marks_end)
+            return;
+        unsigned char label;
+        Node* child;
+        gather(node, &label, &child);
+        std::size_t length = node->prefix_length + 1 + child->prefix_length;
+        if (length > max_prefix)
+            return;
+        unsigned char prefix[max_prefix];
+        std::memcpy(prefix, node->prefix, node->prefix_length);
+        prefix[node->prefix_length] = label;
+        std::memcpy(prefix + node->prefix_length + 1, child->prefix, child->prefix_length);
+        std::memcpy(child->prefix, prefix, length);
+        child->prefix_length = length;
+        slot = child;
+        destroy(node);
+    }
+
+    /**
+     * \brief Chain of nodes spelling \p key, the last one marking the end of a word
+     */
+    Node* create_chain(const unsigned char* key, std::size_t length) {
+        Node* head;
+        Node** slot = &head;
+        for (std::size_t pos = 0; ; pos++) {
+            std::size_t taken = std::min(length - pos, std::size_t(max_prefix));
+            if (pos + taken == length) {
+                Node* last = create_leaf();
+                std::memcpy(last->prefix, key + pos, taken);
+                last->prefix_length = taken;
+                last->marks_end = true;
+                *slot = last;
+                return head;
+            }
+            Node4* link = pools_[node4].create<Node4>();
+            std::memcpy(link->prefix, key + pos, taken);
+            link->prefix_length = taken;
+            pos += taken;
+            link->keys[0] = key[pos];
+            link->count = 1;
+            *slot = link;
+            slot = &link->children[0];
+        }
+    }
+
+    Node* create_leaf() {
+        return pools_[leaf].create<Node>(leaf);
+    }
+
+    /**
+     * \brief Recycles \p node, but not its children
+     */
+    void destroy(Node* node) {
+        pools_[node->kind].deallocate(node);
+    }
+
+    /**
+     * \brief Copies the subtree of \p node into the pools of this trie
+     * \complexity O(n)
+     */
+    Node* copy_subtree(const Node* node) {
+        unsigned char labels[256];
+        Node* children[256];
+        unsigned count = gather(node, labels, children);
+        for (unsigned i = 0; i < count; i++)
+            children[i] = copy_subtree(children[i]);
+        return rebuild(node, Kind(node->kind), labels, children, count);
+    }
+
+    /**
+     * \brief Recursively prints a sub-tree
+     * \complexity O(n)
+     */
+    void print_structure_recursive(const Node* node, const std::string& path) const {
+        std::string full = path + std::string(reinterpret_cast<const char*>(node->prefix), node->prefix_length);
+        std::cout << full << (node->marks_end ? " *" : "") << '\n';
+        unsigned char labels[256];
+        Node* children[256];
+        unsigned count = gather(node, labels, children);
+        for (unsigned i = 0; i < count; i++)
+            print_structure_recursive(children[i], full + char(labels[i]));
+    }
+
+    NodePool<> pools_[kind_count];
+    Node* root_;
+    int size_;
+};
+
+#endif // RADIX_TRIE_HPP
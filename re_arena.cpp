@@ -0,0 +1,80 @@
+/**
+
+\file
+
+\author Mattia Basaglia
+
+\section License
+
+Copyright (C) 2015-2016  Mattia Basaglia
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "re_arena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+using namespace regex;
+
+const std::size_t Arena::max_block_size;
+
+Arena::Arena(std::size_t block_size)
+    : block_size_(std::max(block_size, sizeof(Block))) {}
+
+Arena::~Arena() {
+    while (blocks_) {
+        Block* next = blocks_->next;
+        ::operator delete(blocks_);
+        blocks_ = next;
+    }
+}
+
+void* Arena::allocate(std::size_t size, std::size_t alignment) {
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(current_);
+    std::uintptr_t aligned = (address + alignment - 1) & ~std::uintptr_t(alignment - 1);
+    if (!current_ || aligned + size > reinterpret_cast<std::uintptr_t>(end_)) {
+        grow(size + alignment);
+        address = reinterpret_cast<std::uintptr_t>(current_);
+        aligned = (address + alignment - 1) & ~std::uintptr_t(alignment - 1);
+    }
+    current_ = reinterpret_cast<char*>(aligned + size);
+    return reinterpret_cast<void*>(aligned);
+}
+
+std::size_t Arena::block_count() const {
+    return block_count_;
+}
+
+std::size_t Arena::bytes_reserved() const {
+    return bytes_reserved_;
+}
+
+void Arena::grow(std::size_t size) {
+    std::size_t block_size = std::max(block_size_, size + sizeof(Block));
+    Block* block = static_cast<Block*>(::operator new(block_size));
+    block->next = blocks_;
+    block->size = block_size;
+    blocks_ = block;
+
+    current_ = reinterpret_cast<char*>(block + 1);
+    end_ = reinterpret_cast<char*>(block) + block_size;
+
+    block_count_++;
+    bytes_reserved_ += block_size;
+    if (block_size_ < max_block_size)
+        block_size_ *= 2;
+}
@@ -0,0 +1,102 @@
+/**
+
+\file
+
+\author Mattia Basaglia
+
+\section License
+
+Copyright (C) 2015-2016  Mattia Basaglia
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef RE_ARENA_HPP
+#define RE_ARENA_HPP
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace regex {
+
+/**
+ * \brief Bump allocator, memory is only released all at once
+ *
+ * Objects are carved out of large blocks, the block size doubles up to
+ * a limit as the arena grows.
+ */
+class Arena {
+public:
+    explicit Arena(std::size_t block_size = 4096);
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /**
+     * \brief Releases all the blocks
+     * \note Doesn't call the destructors of the created objects
+     */
+    ~Arena();
+
+    /**
+     * \brief Allocates \p size bytes aligned to \p alignment
+     * \pre \p alignment is a power of 2
+     * \complexity O(1)
+     */
+    void* allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t));
+
+    /**
+     * \brief Constructs an object in the arena
+     * \note Its destructor won't be called, so \p T must not own resources
+     */
+    template<class T, class... Args>
+        T* create(Args&&... args) {
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+    /**
+     * \brief Number of blocks allocated so far
+     */
+    std::size_t block_count() const;
+
+    /**
+     * \brief Number of bytes reserved by the blocks
+     */
+    std::size_t bytes_reserved() const;
+
+private:
+    struct Block {
+        Block* next;
+        std::size_t size;
+    };
+
+    /**
+     * \brief Allocates a new block able to hold at least \p size bytes
+     */
+    void grow(std::size_t size);
+
+    static const std::size_t max_block_size = 1 << 20;
+
+    Block* blocks_ = nullptr;
+    char* current_ = nullptr;
+    char* end_ = nullptr;
+    std::size_t block_size_;
+    std::size_t block_count_ = 0;
+    std::size_t bytes_reserved_ = 0;
+};
+
+} // namespace regex
+
+#endif // RE_ARENA_HPP
@@ -25,9 +25,27 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "re_ast.hpp"
 
+#include <initializer_list>
+
+using namespace regex;
 using namespace regex::nfa;
 using namespace regex::ast;
 
+namespace {
+
+/**
+ * \brief Returns the longest among the given strings
+ */
+const std::string& longest(std::initializer_list<const std::string*> strings) {
+    const std::string* result = *strings.begin();
+    for (const std::string* string : strings)
+        if (string->size() > result->size())
+            result = string;
+    return *result;
+}
+
+} // namespace
+
 NFA Choice::build() const {
     NFA graph;
 
@@ -49,6 +67,50 @@ NFA Choice::build() const {
 }
 
 
+ProgramBuilder::Fragment Choice::emit(ProgramBuilder& builder) const {
+    ProgramBuilder::Fragment fragment = builder.add_fragment();
+    for (const Node* child : {left, right}) {
+        if (child) {
+            ProgramBuilder::Fragment child_fragment = child->emit(builder);
+            builder.add_transition(fragment.input, child_fragment.input);
+            builder.add_transition(child_fragment.output, fragment.output);
+        }
+    }
+    return fragment;
+}
+
+
+Literals Choice::literals() const {
+    if (!left || !right)
+        return Literals();
+
+    Literals left_literals = left->literals();
+    Literals right_literals = right->literals();
+    const std::string& left_prefix = left_literals.prefix;
+    const std::string& right_prefix = right_literals.prefix;
+    const std::string& left_suffix = left_literals.suffix;
+    const std::string& right_suffix = right_literals.suffix;
+
+    Literals result;
+    result.exact = left_literals.exact && right_literals.exact && left_prefix == right_prefix;
+
+    std::size_t prefix = 0;
+    while (prefix < left_prefix.size() && prefix < right_prefix.size() &&
+            left_prefix[prefix] == right_prefix[prefix])
+        prefix++;
+    result.prefix = left_prefix.substr(0, prefix);
+
+    std::size_t suffix = 0;
+    while (suffix < left_suffix.size() && suffix < right_suffix.size() &&
+            left_suffix[left_suffix.size() - suffix - 1] == right_suffix[right_suffix.size() - suffix - 1])
+        suffix++;
+    result.suffix = left_suffix.substr(left_suffix.size() - suffix);
+
+    result.required = longest({&result.prefix, &result.suffix});
+    return result;
+}
+
+
 NFA Concat::build() const {
     if (left && right) {
         NFA left_graph = std::move(left->build());
@@ -60,6 +122,40 @@ NFA Concat::build() const {
 }
 
 
+ProgramBuilder::Fragment Concat::emit(ProgramBuilder& builder) const {
+    if (!left || !right)
+        return builder.add_fragment();
+    ProgramBuilder::Fragment left_fragment = left->emit(builder);
+    ProgramBuilder::Fragment right_fragment = right->emit(builder);
+    builder.add_transition(left_fragment.output, right_fragment.input);
+    return ProgramBuilder::Fragment{left_fragment.input, right_fragment.output};
+}
+
+
+Literals Concat::literals() const {
+    if (!left || !right)
+        return Literals();
+
+    Literals left_literals = left->literals();
+    Literals right_literals = right->literals();
+
+    Literals result;
+    result.exact = left_literals.exact && right_literals.exact;
+    result.prefix = left_literals.prefix;
+    if (left_literals.exact)
+        result.prefix += right_literals.prefix;
+    result.suffix = right_literals.suffix;
+    if (right_literals.exact)
+        result.suffix = left_literals.suffix + result.suffix;
+
+    // The end of the left match is always followed by the start of the right one
+    std::string junction = left_literals.suffix + right_literals.prefix;
+    result.required = longest({&left_literals.required, &right_literals.required,
+                               &junction, &result.prefix, &result.suffix});
+    return result;
+}
+
+
 NFA KleeneStar::build() const {
     if (!child)
         return NFA();
@@ -78,6 +174,20 @@ NFA KleeneStar::build() const {
 }
 
 
+ProgramBuilder::Fragment KleeneStar::emit(ProgramBuilder& builder) const {
+    ProgramBuilder::Fragment fragment = builder.add_fragment();
+    if (!child)
+        return fragment;
+
+    ProgramBuilder::Fragment child_fragment = child->emit(builder);
+    builder.add_transition(fragment.input, fragment.output);
+    builder.add_transition(fragment.input, child_fragment.input);
+    builder.add_transition(child_fragment.output, child_fragment.input);
+    builder.add_transition(child_fragment.output, fragment.output);
+    return fragment;
+}
+
+
 NFA KleenePlus::build() const {
     if (!child)
         return NFA();
@@ -95,6 +205,29 @@ NFA KleenePlus::build() const {
 }
 
 
+ProgramBuilder::Fragment KleenePlus::emit(ProgramBuilder& builder) const {
+    ProgramBuilder::Fragment fragment = builder.add_fragment();
+    if (!child)
+        return fragment;
+
+    ProgramBuilder::Fragment child_fragment = child->emit(builder);
+    builder.add_transition(fragment.input, child_fragment.input);
+    builder.add_transition(child_fragment.output, child_fragment.input);
+    builder.add_transition(child_fragment.output, fragment.output);
+    return fragment;
+}
+
+
+Literals KleenePlus::literals() const {
+    if (!child)
+        return Literals();
+    // Matches at least once
+    Literals result = child->literals();
+    result.exact = false;
+    return result;
+}
+
+
 NFA Optional::build() const {
     if (!child)
         return NFA();
@@ -105,6 +238,16 @@ NFA Optional::build() const {
 }
 
 
+ProgramBuilder::Fragment Optional::emit(ProgramBuilder& builder) const {
+    if (!child)
+        return builder.add_fragment();
+
+    ProgramBuilder::Fragment child_fragment = child->emit(builder);
+    builder.add_transition(child_fragment.input, child_fragment.output);
+    return child_fragment;
+}
+
+
 NFA Subexpression::build() const {
     if (!child)
         return NFA();
@@ -113,7 +256,21 @@ NFA Subexpression::build() const {
 }
 
 
-Leaf::Leaf(const Transition::Functor &condition)
+ProgramBuilder::Fragment Subexpression::emit(ProgramBuilder& builder) const {
+    if (!child)
+        return builder.add_fragment();
+    return child->emit(builder);
+}
+
+
+Literals Subexpression::literals() const {
+    if (!child)
+        return Literals();
+    return child->literals();
+}
+
+
+Leaf::Leaf(const ByteSet &condition)
     : condition(condition) {}
 
 NFA Leaf::build() const {
@@ -123,5 +280,27 @@ NFA Leaf::build() const {
 }
 
 
+ProgramBuilder::Fragment Leaf::emit(ProgramBuilder& builder) const {
+    ProgramBuilder::Fragment fragment = builder.add_fragment();
+    builder.add_transition(fragment.input, fragment.output, condition);
+    return fragment;
+}
+
+
+Literals Leaf::literals() const {
+    Literals result;
+    if (condition.size() == 1) {
+        for (int c = 0; c < 256; c++) {
+            if (condition.contains(char(c))) {
+                result.exact = true;
+                result.prefix = result.suffix = result.required = std::string(1, char(c));
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+
 SingleCharacter::SingleCharacter(char c)
-    : Leaf([c](char d){return c == d;}) {}
+    : Leaf(ByteSet(c)) {}
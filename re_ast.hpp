@@ -26,6 +26,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef RE_AST_HPP
 #define RE_AST_HPP
 
+#include "re_literal.hpp"
 #include "re_nfa.hpp"
 
 namespace regex {
@@ -37,6 +38,9 @@ namespace ast {
 
 /**
  * \brief Abstract Node class
+ *
+ * Nodes are created in an Arena by the parser and released all at once,
+ * they are never destroyed individually so they must not own resources.
  * \note Deleting copy, add clone if needed
  */
 class Node {
@@ -48,13 +52,26 @@ public:
      */
     virtual nfa::NFA build() const = 0;
 
+    /**
+     * \brief Adds the states of the automaton to \p builder
+     * \return The input and output states, like the ones of build()
+     */
+    virtual nfa::ProgramBuilder::Fragment emit(nfa::ProgramBuilder& builder) const = 0;
+
+    /**
+     * \brief Literals found in every match of the node
+     *
+     * The default doesn't claim anything, which is always correct.
+     */
+    virtual Literals literals() const { return Literals(); }
+
 private:
     Node (const Node&) = delete;
     Node& operator= (const Node&) = delete;
 };
 
 /**
- * \brief Node with a single child (abstract). Takes ownersip
+ * \brief Node with a single child (abstract)
  */
 class UnaryNode : public Node {
 public:
@@ -62,16 +79,12 @@ public:
     explicit UnaryNode (Node* child)
         : child(child) {}
 
-    ~UnaryNode() {
-        delete child;
-    }
-
 protected:
     Node* child;
 };
 
 /**
- * \brief Node with two children (abstract). Takes ownersip
+ * \brief Node with two children (abstract)
  */
 class BinaryNode : public Node {
 public:
@@ -79,11 +92,6 @@ public:
     explicit BinaryNode (Node* left, Node* right)
         : left(left), right(right) {}
 
-    ~BinaryNode() {
-        delete left;
-        delete right;
-    }
-
 protected:
     Node* left;
     Node* right;
@@ -96,6 +104,8 @@ class Choice : public BinaryNode {
 public:
     using BinaryNode::BinaryNode;
     nfa::NFA build() const override;
+    nfa::ProgramBuilder::Fragment emit(nfa::ProgramBuilder& builder) const override;
+    Literals literals() const override;
 };
 
 /**
@@ -105,6 +115,8 @@ class Concat : public BinaryNode {
 public:
     using BinaryNode::BinaryNode;
     nfa::NFA build() const override;
+    nfa::ProgramBuilder::Fragment emit(nfa::ProgramBuilder& builder) const override;
+    Literals literals() const override;
 };
 
 /**
@@ -114,6 +126,7 @@ class KleeneStar : public UnaryNode {
 public:
     using UnaryNode::UnaryNode;
     nfa::NFA build() const override;
+    nfa::ProgramBuilder::Fragment emit(nfa::ProgramBuilder& builder) const override;
 };
 
 /**
@@ -123,6 +136,8 @@ class KleenePlus : public UnaryNode {
 public:
     using UnaryNode::UnaryNode;
     nfa::NFA build() const override;
+    nfa::ProgramBuilder::Fragment emit(nfa::ProgramBuilder& builder) const override;
+    Literals literals() const override;
 };
 
 /**
@@ -132,6 +147,7 @@ class Optional : public UnaryNode {
 public:
     using UnaryNode::UnaryNode;
     nfa::NFA build() const override;
+    nfa::ProgramBuilder::Fragment emit(nfa::ProgramBuilder& builder) const override;
 };
 
 /**
@@ -141,6 +157,8 @@ class Subexpression : public UnaryNode {
 public:
     using UnaryNode::UnaryNode;
     nfa::NFA build() const override;
+    nfa::ProgramBuilder::Fragment emit(nfa::ProgramBuilder& builder) const override;
+    Literals literals() const override;
 };
 
 /**
@@ -148,10 +166,12 @@ public:
  */
 class Leaf : public Node {
 public:
-    Leaf(const nfa::Transition::Functor& condition);
+    explicit Leaf(const nfa::ByteSet& condition);
     nfa::NFA build() const override;
+    nfa::ProgramBuilder::Fragment emit(nfa::ProgramBuilder& builder) const override;
+    Literals literals() const override;
 private:
-    nfa::Transition::Functor condition;
+    nfa::ByteSet condition;
 };
 
 /**
@@ -159,7 +179,7 @@ private:
  */
 class SingleCharacter : public Leaf {
 public:
-    SingleCharacter(char c);
+    explicit SingleCharacter(char c);
 };
 
 
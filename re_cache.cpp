@@ -0,0 +1,112 @@
+/**
+\file
+
+\author Mattia Basaglia
+
+\section License
+
+Copyright (C) 2014-2016  Mattia Basaglia
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "re_cache.hpp"
+
+#include <typeinfo>
+
+#include "re_parser.hpp"
+#include "regex.hpp"
+
+using namespace regex;
+
+const std::size_t PatternCache::default_capacity;
+
+PatternCache::PatternCache(std::size_t capacity)
+    : capacity_(capacity) {}
+
+PatternCache& PatternCache::global() {
+    static PatternCache cache;
+    return cache;
+}
+
+std::shared_ptr<const Pattern> PatternCache::get(const std::string& expression,
+                                                 std::shared_ptr<Parser> parser) {
+    if (!parser)
+        parser = std::make_shared<SimpleParser>();
+    Key key(typeid(*parser), expression);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto iter = index_.find(key);
+        if (iter != index_.end()) {
+            statistics_.hits++;
+            entries_.splice(entries_.begin(), entries_, iter->second);
+            return iter->second->second;
+        }
+        statistics_.misses++;
+    }
+
+    auto pattern = std::make_shared<const Pattern>(expression, parser);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (capacity_ == 0)
+        return pattern;
+
+    // Another thread might have compiled the same pattern in the meantime
+    auto iter = index_.find(key);
+    if (iter != index_.end()) {
+        entries_.splice(entries_.begin(), entries_, iter->second);
+        return iter->second->second;
+    }
+
+    entries_.emplace_front(key, pattern);
+    index_.emplace(key, entries_.begin());
+    evict();
+    return pattern;
+}
+
+void PatternCache::set_capacity(std::size_t capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = capacity;
+    evict();
+}
+
+std::size_t PatternCache::capacity() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return capacity_;
+}
+
+std::size_t PatternCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+void PatternCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    index_.clear();
+}
+
+PatternCache::Statistics PatternCache::statistics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return statistics_;
+}
+
+void PatternCache::evict() {
+    while (entries_.size() > capacity_) {
+        index_.erase(entries_.back().first);
+        entries_.pop_back();
+        statistics_.evictions++;
+    }
+}
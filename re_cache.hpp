@@ -0,0 +1,122 @@
+/**
+\file
+
+\author Mattia Basaglia
+
+\section License
+
+Copyright (C) 2014-2016  Mattia Basaglia
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef RE_CACHE_HPP
+#define RE_CACHE_HPP
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
+
+namespace regex {
+
+class Parser;
+class Pattern;
+
+/**
+ * \brief Thread-safe cache of compiled patterns, keyed by expression and
+ * parser type, which discards the least recently used ones when full
+ */
+class PatternCache {
+public:
+    /**
+     * \brief Counters to monitor the effectiveness of the cache
+     */
+    struct Statistics {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t evictions = 0;
+    };
+
+    static const std::size_t default_capacity = 256;
+
+    /**
+     * \param capacity Maximum number of patterns, 0 disables caching
+     */
+    explicit PatternCache(std::size_t capacity = default_capacity);
+
+    /**
+     * \brief Cache used by RegEx
+     */
+    static PatternCache& global();
+
+    /**
+     * \brief Returns the cached pattern, compiling it on a miss
+     * \param parser Parser used on a miss, if null a SimpleParser is used
+     * \note Compilation happens without holding the lock
+     */
+    std::shared_ptr<const Pattern> get(const std::string& expression,
+                                       std::shared_ptr<Parser> parser = nullptr);
+
+    /**
+     * \brief Changes the maximum number of patterns, evicting as needed
+     */
+    void set_capacity(std::size_t capacity);
+
+    std::size_t capacity() const;
+
+    /**
+     * \brief Number of cached patterns
+     */
+    std::size_t size() const;
+
+    /**
+     * \brief Removes all the patterns (counters are preserved)
+     */
+    void clear();
+
+    Statistics statistics() const;
+
+private:
+    typedef std::pair<std::type_index, std::string> Key;
+
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const {
+            return key.first.hash_code() * 31 + std::hash<std::string>()(key.second);
+        }
+    };
+
+    typedef std::list<std::pair<Key, std::shared_ptr<const Pattern>>> List;
+
+    /**
+     * \brief Removes least recently used patterns until the size fits capacity_
+     * \pre mutex_ is locked
+     */
+    void evict();
+
+    mutable std::mutex mutex_;
+    std::size_t capacity_;
+    /// Most recently used at the front
+    List entries_;
+    std::unordered_map<Key, List::iterator, KeyHash> index_;
+    Statistics statistics_;
+};
+
+} // namespace regex
+
+#endif // RE_CACHE_HPP
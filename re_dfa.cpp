@@ -0,0 +1,131 @@
+/**
+
+\file
+
+\author Mattia Basaglia
+
+\section License
+
+Copyright (C) 2015-2016  Mattia Basaglia
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "re_dfa.hpp"
+
+#include <algorithm>
+
+using namespace regex::dfa;
+using namespace regex::nfa;
+
+const int LazyDfa::dead;
+const int LazyDfa::full;
+const int LazyDfa::unknown;
+const std::size_t LazyDfa::default_max_states;
+
+LazyDfa::LazyDfa(const Program& program, std::size_t max_states)
+    : program_(program), runner_(program), max_states_(max_states),
+      classes_(program.byte_classes()) {
+    start_ = state_for(runner_.state());
+}
+
+int LazyDfa::start() const {
+    return start_;
+}
+
+int LazyDfa::next(int state, char c) {
+    std::size_t cell = state * classes_.count() + classes_(c);
+    int target = table_[cell];
+#ifdef REGEX_STATS
+    if (target == unknown)
+        stats_.dfa_misses++;
+    else
+        stats_.dfa_hits++;
+#endif
+    if (target == unknown) {
+        runner_.set_state(states_[state].key);
+        runner_.step(c);
+        target = state_for(runner_.state());
+        // table_ might have been reallocated by state_for
+        if (target != full)
+            table_[cell] = target;
+    }
+    return target;
+}
+
+bool LazyDfa::accepting(int state) const {
+    return state >= 0 && !states_[state].matches.empty();
+}
+
+const std::vector<int>& LazyDfa::matches(int state) const {
+    return states_[state].matches;
+}
+
+const std::vector<int>& LazyDfa::nfa_states(int state) const {
+    return states_[state].key;
+}
+
+std::size_t LazyDfa::state_count() const {
+    return states_.size();
+}
+
+std::size_t LazyDfa::max_states() const {
+    return max_states_;
+}
+
+const ByteClasses& LazyDfa::byte_classes() const {
+    return classes_;
+}
+
+regex::MatchStats LazyDfa::stats() const {
+#ifdef REGEX_STATS
+    return stats_;
+#else
+    return MatchStats();
+#endif
+}
+
+void LazyDfa::reset_stats() {
+#ifdef REGEX_STATS
+    stats_ = MatchStats();
+#endif
+}
+
+int LazyDfa::state_for(const NfaRunner::StateSet& nodes) {
+    if (nodes.empty())
+        return dead;
+
+    NodeKey key(nodes.begin(), nodes.end());
+    std::sort(key.begin(), key.end());
+
+    auto iter = index_.find(key);
+    if (iter != index_.end())
+        return iter->second;
+
+    if (states_.size() >= max_states_)
+        return full;
+
+    int index = states_.size();
+    states_.emplace_back();
+    State& state = states_.back();
+    for (int node : key)
+        if (program_.match_id(node) != -1)
+            state.matches.push_back(program_.match_id(node));
+    std::sort(state.matches.begin(), state.matches.end());
+    state.key = key;
+    table_.resize(table_.size() + classes_.count(), unknown);
+    index_.emplace(std::move(key), index);
+    return index;
+}
@@ -0,0 +1,162 @@
+/**
+
+\file
+
+\author Mattia Basaglia
+
+\section License
+
+Copyright (C) 2015-2016  Mattia Basaglia
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef RE_DFA_HPP
+#define RE_DFA_HPP
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+#include "re_nfa.hpp"
+
+namespace regex {
+namespace dfa {
+
+/**
+ * \brief Deterministic automaton built lazily from a NFA (subset construction)
+ *
+ * Each state corresponds to an epsilon-closed set of Program states, states and
+ * transitions are only computed when the input reaches them and are cached
+ * for subsequent runs.
+ *
+ * Transitions are stored in a single table with a column for each byte class
+ * of the NFA.
+ */
+class LazyDfa {
+public:
+    /**
+     * \brief Returned by next() when there is no way to reach an accepting state
+     */
+    static const int dead = -1;
+    /**
+     * \brief Returned by next() when the state limit doesn't allow to build
+     * the target state, the caller should go on with a NfaRunner
+     */
+    static const int full = -2;
+
+    /**
+     * \brief Cap on the number of states used by default
+     */
+    static const std::size_t default_max_states = 1024;
+
+    /**
+     * \brief Creates the automaton and its starting state
+     * \note The program must outlive the DFA
+     */
+    explicit LazyDfa(const nfa::Program& program, std::size_t max_states = default_max_states);
+
+    /**
+     * \brief Starting state
+     * \return A state index or dead if the program is empty
+     */
+    int start() const;
+
+    /**
+     * \brief Returns the state reached from \p state through \p c
+     * \pre \p state is a valid state index
+     * \return A state index, dead or full
+     * \complexity O(1) when the transition is cached
+     */
+    int next(int state, char c);
+
+    /**
+     * \brief Whether \p state contains an accepting program state
+     */
+    bool accepting(int state) const;
+
+    /**
+     * \brief Sorted match ids of the accepting program states in \p state
+     */
+    const std::vector<int>& matches(int state) const;
+
+    /**
+     * \brief Sorted program states corresponding to the given state
+     */
+    const std::vector<int>& nfa_states(int state) const;
+
+    /**
+     * \brief Number of states built so far
+     */
+    std::size_t state_count() const;
+
+    /**
+     * \brief Maximum number of states
+     */
+    std::size_t max_states() const;
+
+    /**
+     * \brief Byte classes used as columns of the transition table
+     */
+    const nfa::ByteClasses& byte_classes() const;
+
+    /**
+     * \brief Transitions found in the table or not by next(), empty without REGEX_STATS
+     */
+    MatchStats stats() const;
+
+    void reset_stats();
+
+private:
+    /**
+     * \brief Sorted set of program states, used as key to find existing states
+     */
+    typedef std::vector<int> NodeKey;
+
+    /**
+     * \brief Marks transitions which haven't been computed yet
+     */
+    static const int unknown = -3;
+
+    struct State {
+        NodeKey key;
+        std::vector<int> matches;
+    };
+
+    /**
+     * \brief Finds or creates the state corresponding to \p nodes
+     * \return A state index, dead or full
+     */
+    int state_for(const nfa::NfaRunner::StateSet& nodes);
+
+    const nfa::Program& program_;
+    /// Used to compute missing transitions
+    nfa::NfaRunner runner_;
+    std::size_t max_states_;
+    nfa::ByteClasses classes_;
+    std::vector<State> states_;
+    /**
+     * \brief Transitions, row \c s column \c c is at <tt>s * classes_.count() + c</tt>
+     */
+    std::vector<int> table_;
+    std::map<NodeKey, int> index_;
+    int start_ = dead;
+#ifdef REGEX_STATS
+    MatchStats stats_;
+#endif
+};
+
+}} // namespace regex::dfa
+#endif // RE_DFA_HPP
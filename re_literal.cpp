@@ -0,0 +1,71 @@
+/**
+
+\file
+
+\author Mattia Basaglia
+
+\section License
+
+Copyright (C) 2015-2016  Mattia Basaglia
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "re_literal.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace regex;
+
+bool Literals::may_full_match(const char* data, std::size_t size) const {
+    if (exact)
+        return size == prefix.size() && std::memcmp(data, prefix.data(), size) == 0;
+
+    if (size < prefix.size() || std::memcmp(data, prefix.data(), prefix.size()) != 0)
+        return false;
+
+    if (size < suffix.size() ||
+            std::memcmp(data + size - suffix.size(), suffix.data(), suffix.size()) != 0)
+        return false;
+
+    // Prefix and suffix have already been checked
+    if (required.size() > std::max(prefix.size(), suffix.size()))
+        return find_literal(data, size, required) != nullptr;
+
+    return true;
+}
+
+bool Literals::may_contain_match(const char* data, std::size_t size) const {
+    return find_literal(data, size, required) != nullptr;
+}
+
+const char* regex::find_literal(const char* data, std::size_t size, const std::string& needle) {
+    if (needle.empty())
+        return data;
+    if (needle.size() > size)
+        return nullptr;
+
+    const char* last = data + size - needle.size();
+    for (const char* candidate = data; candidate <= last; candidate++) {
+        candidate = static_cast<const char*>(
+            std::memchr(candidate, needle[0], last - candidate + 1));
+        if (!candidate)
+            return nullptr;
+        if (std::memcmp(candidate + 1, needle.data() + 1, needle.size() - 1) == 0)
+            return candidate;
+    }
+    return nullptr;
+}
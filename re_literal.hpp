@@ -0,0 +1,81 @@
+/**
+
+\file
+
+\author Mattia Basaglia
+
+\section License
+
+Copyright (C) 2015-2016  Mattia Basaglia
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef RE_LITERAL_HPP
+#define RE_LITERAL_HPP
+
+#include <cstddef>
+#include <string>
+
+namespace regex {
+
+/**
+ * \brief Literal strings found in every match of an expression
+ *
+ * Used to reject the input before running the automaton.
+ * Empty strings mean nothing is known.
+ */
+struct Literals {
+    /**
+     * \brief Whether \c prefix is the only string the expression matches
+     */
+    bool exact = false;
+    /**
+     * \brief Every match starts with this
+     */
+    std::string prefix;
+    /**
+     * \brief Every match ends with this
+     */
+    std::string suffix;
+    /**
+     * \brief Every match contains this
+     */
+    std::string required;
+
+    /**
+     * \brief Whether the whole input could be a match
+     * \complexity O(size)
+     */
+    bool may_full_match(const char* data, std::size_t size) const;
+
+    /**
+     * \brief Whether the input could contain a match
+     * \complexity O(size)
+     */
+    bool may_contain_match(const char* data, std::size_t size) const;
+};
+
+/**
+ * \brief Finds the first occurrence of \p needle in the input
+ *
+ * Uses memchr to jump between occurrences of the first character.
+ * \return Pointer to the occurrence or null if not found
+ */
+const char* find_literal(const char* data, std::size_t size, const std::string& needle);
+
+} // namespace regex
+
+#endif // RE_LITERAL_HPP
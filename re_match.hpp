@@ -0,0 +1,82 @@
+/**
+
+\file
+
+\author Mattia Basaglia
+
+\section License
+
+Copyright (C) 2015-2016  Mattia Basaglia
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef RE_MATCH_HPP
+#define RE_MATCH_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "stats.hpp"
+
+namespace regex {
+
+/**
+ * \brief Location of a match, as offsets from the start of the input
+ */
+struct Match {
+    std::size_t begin;
+    std::size_t end;
+
+    std::size_t length() const {
+        return end - begin;
+    }
+};
+
+/**
+ * \brief Work done by the automata running an expression
+ *
+ * Only recorded when the library is built with REGEX_STATS defined,
+ * otherwise the automata keep nothing and their statistics stay empty.
+ */
+struct MatchStats {
+    /// Number of active NFA states after each character an NFA has read
+    Histogram active_states;
+    /// Transitions the lazy DFA found in its table
+    std::uint64_t dfa_hits = 0;
+    /// Transitions the lazy DFA had to compute, or couldn't for lack of states
+    std::uint64_t dfa_misses = 0;
+
+    /**
+     * \brief Fraction of the DFA transitions found in its table, 0 if there were none
+     */
+    double dfa_hit_rate() const {
+        std::uint64_t total = dfa_hits + dfa_misses;
+        return total ? double(dfa_hits) / total : 0;
+    }
+
+    /**
+     * \brief Adds the work recorded by \p other
+     */
+    void merge(const MatchStats& other) {
+        active_states.merge(other.active_states);
+        dfa_hits += other.dfa_hits;
+        dfa_misses += other.dfa_misses;
+    }
+};
+
+} // namespace regex
+
+#endif // RE_MATCH_HPP
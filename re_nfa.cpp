@@ -25,8 +25,42 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "re_nfa.hpp"
 
+#include <map>
+
+#include "re_dfa.hpp"
+#include "re_literal.hpp"
+
 using namespace regex::nfa;
 
+void ByteClasses::split(const ByteSet& set) {
+    // Maps (old class, whether it's in set) to the new class
+    std::array<int, 512> split_classes;
+    split_classes.fill(-1);
+    int count = 0;
+    for (std::size_t c = 0; c < classes_.size(); c++) {
+        int& target = split_classes[classes_[c] * 2 + set.contains(char(c))];
+        if (target == -1)
+            target = count++;
+        classes_[c] = target;
+    }
+    count_ = count;
+}
+
+char ByteClasses::representative(int byte_class) const {
+    for (std::size_t c = 0; c < classes_.size(); c++)
+        if (classes_[c] == byte_class)
+            return char(c);
+    return 0;
+}
+
+ByteSet ByteClasses::members(int byte_class) const {
+    ByteSet set;
+    for (std::size_t c = 0; c < classes_.size(); c++)
+        if (classes_[c] == byte_class)
+            set.insert(char(c));
+    return set;
+}
+
 NFA::NFA() {
     set_input(new Node);
     set_output(new Node);
@@ -52,6 +86,7 @@ NFA NFA::duplicate() const {
     std::unordered_map<Node*, Node*> translation;
 
     NFA result;
+    result.clear();
 
     for (Node* node : nodes_) {
         Node* copied_node = node->clone();
@@ -63,6 +98,11 @@ NFA NFA::duplicate() const {
         node->translate(translation);
     }
 
+    if (input_)
+        result.input_ = translation[input_];
+    if (output_)
+        result.output_ = translation[output_];
+
     return std::move(result);
 }
 
@@ -104,7 +144,55 @@ NodeList NFA::nodes() const {
 }
 
 void NFA::make_deterministic() {
-    // TODO
+    if (!input_)
+        return;
+
+    Program program(*this);
+    dfa::LazyDfa deterministic(program, std::size_t(-1));
+
+    // Characters in the same class always lead to the same state
+    const ByteClasses& classes = deterministic.byte_classes();
+
+    // state_count() grows while the loop visits new states
+    for (std::size_t state = 0; state < deterministic.state_count(); state++)
+        for (int byte_class = 0; byte_class < classes.count(); byte_class++)
+            deterministic.next(state, classes.representative(byte_class));
+
+    NFA result;
+    std::vector<Node*> nodes(deterministic.state_count());
+    for (std::size_t state = 0; state < nodes.size(); state++) {
+        if (int(state) == deterministic.start()) {
+            nodes[state] = result.input();
+        } else {
+            nodes[state] = new Node;
+            result.insert_node(nodes[state]);
+        }
+    }
+
+    for (std::size_t state = 0; state < nodes.size(); state++) {
+        // group characters by target so each pair of nodes has a single transition
+        std::map<int, ByteSet> targets;
+        for (int byte_class = 0; byte_class < classes.count(); byte_class++) {
+            int target = deterministic.next(state, classes.representative(byte_class));
+            if (target >= 0)
+                targets[target].insert(classes.members(byte_class));
+        }
+        for (const auto& target : targets)
+            nodes[state]->add_transition(nodes[target.first], target.second);
+        // the only empty transitions left are the ones to the output node
+        if (deterministic.accepting(state))
+            nodes[state]->add_transition(result.output());
+    }
+
+    *this = std::move(result);
+}
+
+ByteClasses NFA::byte_classes() const {
+    ByteClasses classes;
+    for (Node* node : nodes_)
+        for (const Transition& transition : node->transitions_)
+            classes.split(transition.condition);
+    return classes;
 }
 
 bool NFA::merge(NFA &other) {
@@ -182,12 +270,12 @@ void Node::add_transition(Node *target) {
         empty_transitions_.insert(target);
 }
 
-void Node::add_transition(Node *target, const Transition::Functor &condition) {
+void Node::add_transition(Node *target, const ByteSet &condition) {
     add_transition({target,condition});
 }
 
 void Node::add_transition(const Transition &transition) {
-    if (transition.condition && transition.target)
+    if (!transition.condition.empty() && transition.target)
         transitions_.push_back(transition);
 }
 
@@ -198,7 +286,7 @@ NodeList Node::empty_transitions() const {
 NodeList Node::next_nodes(char c) const {
     NodeList nodes;
     for (const auto& transition : transitions_)
-        if (transition.condition(c))
+        if (transition.condition.contains(c))
             nodes.insert(transition.target);
     return nodes;
 }
@@ -212,47 +300,491 @@ void Node::merge(const Node &other) {
     empty_transitions_.insert(other.empty_transitions_.begin(),other.empty_transitions_.end());
 }
 
-NfaRunner::NfaRunner(const NFA& nfa) : nfa_(nfa) {
-    set_state({nfa.input()});
+int ProgramBuilder::add_state() {
+    match_ids_.push_back(-1);
+    return match_ids_.size() - 1;
+}
+
+ProgramBuilder::Fragment ProgramBuilder::add_fragment() {
+    int input = add_state();
+    return Fragment{input, add_state()};
+}
+
+void ProgramBuilder::add_transition(int source, int target, const ByteSet& condition) {
+    transitions_.push_back({source, target});
+    conditions_.push_back(condition);
+}
+
+void ProgramBuilder::add_transition(int source, int target) {
+    empty_.push_back({source, target});
+}
+
+void ProgramBuilder::set_input(int state) {
+    input_ = state;
+}
+
+void ProgramBuilder::set_output(int state) {
+    output_ = state;
+}
+
+void ProgramBuilder::set_match_id(int state, int match_id) {
+    match_ids_[state] = match_id;
+}
+
+int ProgramBuilder::size() const {
+    return match_ids_.size();
+}
+
+Program::Program() {
+    edge_begin_.push_back(0);
+    empty_begin_.push_back(0);
+    closure_begin_.push_back(0);
+}
+
+Program::Program(const NFA& nfa) : Program(nfa, {nfa.output()}) {}
+
+Program::Program(const NFA& nfa, const std::vector<Node*>& accepting)
+    : Program(flatten(nfa, accepting)) {}
+
+Program::Program(const ProgramBuilder& builder)
+    : match_ids_(builder.match_ids_), input_(builder.input_), output_(builder.output_) {
+    int states = builder.size();
+
+    // Counting sort by source state, keeping the order of insertion
+    auto group = [states](const std::vector<ProgramBuilder::Transition>& transitions,
+                          std::vector<int>& begin, std::vector<int>& order) {
+        begin.assign(states + 1, 0);
+        for (const ProgramBuilder::Transition& transition : transitions)
+            begin[transition.source + 1]++;
+        for (int state = 0; state < states; state++)
+            begin[state + 1] += begin[state];
+        std::vector<int> next(begin.begin(), begin.end() - 1);
+        order.resize(transitions.size());
+        for (std::size_t i = 0; i < transitions.size(); i++)
+            order[next[transitions[i].source]++] = i;
+    };
+
+    std::vector<int> order;
+    group(builder.transitions_, edge_begin_, order);
+    std::unordered_map<ByteSet, int, ByteSet::Hash> condition_index;
+    edges_.reserve(order.size());
+    for (int i : order) {
+        const ByteSet& set = builder.conditions_[i];
+        auto condition = condition_index.emplace(set, conditions_.size());
+        if (condition.second) {
+            conditions_.push_back(set);
+            classes_.split(set);
+        }
+        edges_.push_back({builder.transitions_[i].target, condition.first->second});
+    }
+
+    group(builder.empty_, empty_begin_, order);
+    empty_.reserve(order.size());
+    for (int i : order)
+        empty_.push_back(builder.empty_[i].target);
+
+    closure_begin_.push_back(0);
+    SparseSet closure(size());
+    std::vector<int> stack;
+    for (int state = 0; state < size(); state++) {
+        closure.clear();
+        closure.insert(state);
+        stack.push_back(state);
+        while (!stack.empty()) {
+            int current = stack.back();
+            stack.pop_back();
+            for (int adjacent : empty_transitions(current))
+                if (closure.insert(adjacent))
+                    stack.push_back(adjacent);
+        }
+
+        for (int reached : closure)
+            if (match_ids_[reached] != -1 || edge_begin_[reached] != edge_begin_[reached+1])
+                closure_.push_back(reached);
+        closure_begin_.push_back(closure_.size());
+    }
+}
+
+ProgramBuilder Program::flatten(const NFA& nfa, const std::vector<Node*>& accepting) {
+    ProgramBuilder builder;
+    if (!nfa.input())
+        return builder;
+
+    // Number the nodes in breadth-first order, so unreachable ones are dropped
+    std::unordered_map<Node*, int> index;
+    std::vector<Node*> nodes;
+    auto number = [&index, &nodes, &builder](Node* node) {
+        auto inserted = index.emplace(node, nodes.size());
+        if (inserted.second) {
+            nodes.push_back(node);
+            builder.add_state();
+        }
+        return inserted.first->second;
+    };
+    number(nfa.input());
+    for (std::size_t i = 0; i < nodes.size(); i++) {
+        for (const Transition& transition : nodes[i]->transitions_)
+            builder.add_transition(i, number(transition.target), transition.condition);
+        for (Node* target : nodes[i]->empty_transitions_)
+            builder.add_transition(i, number(target));
+    }
+
+    builder.set_input(0);
+    auto output = index.find(nfa.output());
+    if (output != index.end())
+        builder.set_output(output->second);
+
+    for (std::size_t i = 0; i < accepting.size(); i++) {
+        auto state = index.find(accepting[i]);
+        if (state != index.end())
+            builder.set_match_id(state->second, i);
+    }
+    return builder;
+}
+
+int Program::size() const {
+    return edge_begin_.size() - 1;
+}
+
+int Program::input() const {
+    return input_;
 }
 
-const NodeList& NfaRunner::state() const {
+int Program::output() const {
+    return output_;
+}
+
+Program::Range<Program::Edge> Program::edges(int state) const {
+    return Range<Edge>(edges_.data() + edge_begin_[state], edges_.data() + edge_begin_[state+1]);
+}
+
+Program::Range<int> Program::empty_transitions(int state) const {
+    return Range<int>(empty_.data() + empty_begin_[state], empty_.data() + empty_begin_[state+1]);
+}
+
+Program::Range<int> Program::closure(int state) const {
+    return Range<int>(closure_.data() + closure_begin_[state], closure_.data() + closure_begin_[state+1]);
+}
+
+const std::vector<ByteSet>& Program::conditions() const {
+    return conditions_;
+}
+
+const ByteClasses& Program::byte_classes() const {
+    return classes_;
+}
+
+NfaRunner::NfaRunner(const Program& program)
+    : program_(program), state_(program.size()), next_(program.size()) {
+    reset();
+}
+
+void NfaRunner::reset() {
+    state_.clear();
+    if (program_.input() != -1)
+        expand_empty(state_, program_.input());
+}
+
+const NfaRunner::StateSet& NfaRunner::state() const {
     return state_;
 }
 
-void NfaRunner::set_state(const NodeList& state) {
-    state_ = expand_empty(state);
+void NfaRunner::set_state(const std::vector<int>& state) {
+    state_.clear();
+    for (int node : state)
+        expand_empty(state_, node);
 }
 
 bool NfaRunner::acceptable() const {
-    return nfa_.output() && state_.count(nfa_.output());
+    return program_.output() != -1 && state_.contains(program_.output());
+}
+
+void NfaRunner::matches(std::vector<int>& ids) const {
+    for (int state : state_)
+        if (program_.match_id(state) != -1)
+            ids.push_back(program_.match_id(state));
 }
 
 void NfaRunner::step(char c) {
-    state_ = expand(state_,c);
+    next_.clear();
+    for (int source : state_)
+        for (const Program::Edge& edge : program_.edges(source))
+            if (program_.matches(edge, c))
+                expand_empty(next_, edge.target);
+    state_.swap(next_);
+#ifdef REGEX_STATS
+    stats_.active_states.record(state_.size());
+#endif
+}
+
+regex::MatchStats NfaRunner::stats() const {
+#ifdef REGEX_STATS
+    return stats_;
+#else
+    return MatchStats();
+#endif
+}
+
+void NfaRunner::reset_stats() {
+#ifdef REGEX_STATS
+    stats_ = MatchStats();
+#endif
+}
+
+void NfaRunner::expand_empty(StateSet& output, int state) const {
+    for (int reached : program_.closure(state))
+        output.insert(reached);
+}
+
+Scanner::Scanner(const Program& program, const std::string& prefix)
+    : program_(program), prefix_(prefix),
+      state_(program.size()), next_(program.size()),
+      start_(program.size()), next_start_(program.size()),
+      dead_mark_(program.size()) {
+    reset();
+}
+
+void Scanner::reset() {
+    position_ = 0;
+    min_start_ = 0;
+    no_empty_at_ = -1;
+    has_candidate_ = false;
+    idle_ = true;
+    buffer_.clear();
+    buffer_begin_ = 0;
+    candidate_states_.clear();
+    dead_.clear();
+    dead_begin_ = 0;
+    std::fill(dead_mark_.begin(), dead_mark_.end(), 0);
+    state_.clear();
+    settle();
+}
+
+void Scanner::feed(const char* data, std::size_t size, std::vector<Match>& matches) {
+    std::size_t i = 0;
+    while (i < size) {
+        if (idle_ && !prefix_.empty()) {
+            i += skip(data + i, size - i);
+            if (i == size)
+                break;
+        }
+        feed(data[i++], matches);
+    }
+}
+
+void Scanner::feed(const std::string& chunk, std::vector<Match>& matches) {
+    feed(chunk.data(), chunk.size(), matches);
+}
+
+void Scanner::feed(char c, std::vector<Match>& matches) {
+    if (has_candidate_) {
+        if (buffer_.empty())
+            buffer_begin_ = position_;
+        buffer_ += c;
+    }
+    step(c);
+    if (has_candidate_ && state_.empty()) {
+        report(matches);
+        drain(matches);
+        trim();
+    } else {
+        settle();
+        // Nothing before the end of a new candidate is read again
+        if (has_candidate_ && candidate_.end == position_)
+            buffer_.clear();
+    }
+}
+
+void Scanner::finish(std::vector<Match>& matches) {
+    while (has_candidate_) {
+        report(matches);
+        drain(matches);
+    }
+    trim();
+}
+
+std::size_t Scanner::position() const {
+    return position_;
 }
 
-NodeList NfaRunner::expand_empty(NodeList source) {
-    NodeList output;
-    while (!source.empty()) {
-        Node* current_node = *source.begin();
-        source.erase(current_node);
-        if (!current_node)
+regex::MatchStats Scanner::stats() const {
+#ifdef REGEX_STATS
+    return stats_;
+#else
+    return MatchStats();
+#endif
+}
+
+void Scanner::reset_stats() {
+#ifdef REGEX_STATS
+    stats_ = MatchStats();
+#endif
+}
+
+void Scanner::advance(char c, std::vector<Match>& matches) {
+    step(c);
+    if (has_candidate_ && state_.empty())
+        report(matches);
+    else
+        settle();
+}
+
+void Scanner::drain(std::vector<Match>& matches) {
+    // report() goes back to the end of the match, within the buffer
+    while (position_ < buffer_begin_ + buffer_.size())
+        advance(buffer_[position_ - buffer_begin_], matches);
+}
+
+void Scanner::trim() {
+    std::size_t keep = has_candidate_ ? candidate_.end : position_;
+    if (keep > buffer_begin_) {
+        buffer_.erase(0, std::min(keep - buffer_begin_, buffer_.size()));
+        buffer_begin_ = keep;
+    }
+}
+
+std::size_t Scanner::skip(const char* data, std::size_t size) {
+    std::size_t skipped;
+    if (const char* found = find_literal(data, size, prefix_))
+        skipped = found - data;
+    else if (size >= prefix_.size())
+        // The end of the chunk might be the start of the prefix
+        skipped = size - prefix_.size() + 1;
+    else
+        skipped = 0;
+
+    if (skipped) {
+        state_.clear();
+        position_ += skipped;
+        settle();
+    }
+    return skipped;
+}
+
+void Scanner::step(char c) {
+    bool dead = !dead_.empty() && mark_dead_ends(position_);
+    bool at_candidate_end = has_candidate_ && position_ == candidate_.end;
+    next_.clear();
+    for (int source : state_) {
+        if (dead && dead_mark_[source] == position_ + 1)
             continue;
-        output.insert(current_node);
-        for (Node* adjacent : current_node->empty_transitions()) {
-            if (!source.count(adjacent) && !output.count(adjacent))
-                source.insert(adjacent);
+        // Threads starting after the candidate can't lead to a better match
+        if (has_candidate_ && start_[source] > candidate_.begin)
+            continue;
+        if (at_candidate_end)
+            candidate_states_.push_back(source);
+        for (const Program::Edge& edge : program_.edges(source)) {
+            if (program_.matches(edge, c)) {
+                for (int target : program_.closure(edge.target))
+                    if (next_.insert(target))
+                        next_start_[target] = start_[source];
+            }
+        }
+    }
+    state_.swap(next_);
+    start_.swap(next_start_);
+#ifdef REGEX_STATS
+    stats_.active_states.record(state_.size());
+#endif
+    position_++;
+    idle_ = state_.empty() && !has_candidate_;
+}
+
+void Scanner::settle() {
+    if (program_.input() == -1)
+        return;
+
+    // States are inserted in order of starting position, so existing ones
+    // keep the leftmost start
+    if (!has_candidate_ && position_ >= min_start_) {
+        for (int target : program_.closure(program_.input()))
+            if (state_.insert(target))
+                start_[target] = position_;
+    }
+
+    int output = program_.output();
+    if (output != -1 && state_.contains(output)) {
+        std::size_t begin = start_[output];
+        if (begin == position_ && position_ == no_empty_at_)
+            return;
+        if (!has_candidate_ || begin <= candidate_.begin) {
+            has_candidate_ = true;
+            idle_ = false;
+            candidate_ = Match{begin, position_};
+            candidate_states_.clear();
         }
     }
-    return output;
 }
 
-NodeList NfaRunner::expand(NodeList source, char c) {
-    NodeList output;
-    for (Node* source_node : source)
-        for (Node* output_node : source_node->next_nodes(c))
-            if (!output.count(output_node))
-                output.insert(output_node);
-    return expand_empty(output);
+void Scanner::report(std::vector<Match>& matches) {
+    matches.push_back(candidate_);
+    record_dead_ends();
+    has_candidate_ = false;
+
+    position_ = candidate_.end;
+    if (candidate_.begin == candidate_.end) {
+        min_start_ = position_ + 1;
+    } else {
+        min_start_ = position_;
+        no_empty_at_ = position_;
+    }
+
+    // The positions before the end of the match won't be read again
+    for (; dead_begin_ < position_ && !dead_.empty(); dead_begin_++)
+        dead_.pop_front();
+    dead_begin_ = std::max(dead_begin_, position_);
+    state_.clear();
+    idle_ = true;
+    settle();
+}
+
+void Scanner::record_dead_ends() {
+    int output = program_.output();
+    // The candidate is over, the state buffers are free
+    state_.clear();
+    for (int state : candidate_states_)
+        state_.insert(state);
+
+    for (std::size_t position = candidate_.end; position < position_ && !state_.empty(); position++) {
+        bool dead = mark_dead_ends(position);
+        char c = buffer_[position - buffer_begin_];
+        next_.clear();
+        for (int state : state_) {
+            if (dead && dead_mark_[state] == position + 1)
+                continue;
+            if (state != output)
+                add_dead_end(position, state);
+            for (const Program::Edge& edge : program_.edges(state)) {
+                if (program_.matches(edge, c)) {
+                    for (int target : program_.closure(edge.target))
+                        next_.insert(target);
+                }
+            }
+        }
+        state_.swap(next_);
+    }
+}
+
+void Scanner::add_dead_end(std::size_t position, int state) {
+    if (dead_.empty())
+        dead_begin_ = position;
+    if (position - dead_begin_ >= dead_.size())
+        dead_.resize(position - dead_begin_ + 1);
+    dead_[position - dead_begin_].push_back(state);
+    dead_mark_[state] = position + 1;
+}
+
+bool Scanner::mark_dead_ends(std::size_t position) {
+    if (position < dead_begin_)
+        return false;
+    if (position - dead_begin_ >= dead_.size()) {
+        // Only a candidate match can make the scanner go back to them
+        if (!has_candidate_)
+            dead_.clear();
+        return false;
+    }
+    const std::vector<int>& dead = dead_[position - dead_begin_];
+    for (int state : dead)
+        dead_mark_[state] = position + 1;
+    return !dead.empty();
 }
@@ -26,12 +26,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef RE_NFA_HPP
 #define RE_NFA_HPP
 
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <deque>
 #include <functional>
 #include <string>
+#include <utility>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "re_match.hpp"
+
 namespace regex {
 namespace nfa {
 
@@ -40,6 +47,140 @@ class Transition;
 
 typedef std::unordered_set<Node*> NodeList;
 
+/**
+ * \brief Set of characters accepted by a transition
+ */
+class ByteSet {
+public:
+    ByteSet() {}
+
+    explicit ByteSet(char c) {
+        insert(c);
+    }
+
+    /**
+     * \brief Set containing every character
+     */
+    static ByteSet all() {
+        ByteSet set;
+        set.bits_.set();
+        return set;
+    }
+
+    void insert(char c) {
+        bits_[index(c)] = true;
+    }
+
+    /**
+     * \brief Inserts all the characters between \p first and \p last (inclusive)
+     */
+    void insert_range(char first, char last) {
+        for (std::size_t i = index(first); i <= index(last); i++)
+            bits_[i] = true;
+    }
+
+    void insert(const ByteSet& other) {
+        bits_ |= other.bits_;
+    }
+
+    /**
+     * \brief Replaces the set with its complement
+     */
+    void negate() {
+        bits_.flip();
+    }
+
+    bool contains(char c) const {
+        return bits_[index(c)];
+    }
+
+    bool empty() const {
+        return bits_.none();
+    }
+
+    /**
+     * \brief Number of characters in the set
+     */
+    std::size_t size() const {
+        return bits_.count();
+    }
+
+    bool operator==(const ByteSet& other) const {
+        return bits_ == other.bits_;
+    }
+
+    bool operator!=(const ByteSet& other) const {
+        return bits_ != other.bits_;
+    }
+
+    /**
+     * \brief Position of \p c in tables indexed by character
+     */
+    static std::size_t index(char c) {
+        return static_cast<unsigned char>(c);
+    }
+
+    /**
+     * \brief Hash functor, to use ByteSet as key of unordered containers
+     */
+    struct Hash {
+        std::size_t operator()(const ByteSet& set) const {
+            return std::hash<std::bitset<256>>()(set.bits_);
+        }
+    };
+
+private:
+    std::bitset<256> bits_;
+};
+
+/**
+ * \brief Partition of the characters in classes which are indistinguishable
+ * by the transitions of an automaton
+ */
+class ByteClasses {
+public:
+    /**
+     * \brief Single class containing all characters
+     */
+    ByteClasses() {
+        classes_.fill(0);
+    }
+
+    /**
+     * \brief Refines the partition so that \p set is an union of classes
+     * \complexity O(256)
+     */
+    void split(const ByteSet& set);
+
+    /**
+     * \brief Class of the given character
+     */
+    int operator()(char c) const {
+        return classes_[ByteSet::index(c)];
+    }
+
+    /**
+     * \brief Number of classes
+     */
+    int count() const {
+        return count_;
+    }
+
+    /**
+     * \brief A character belonging to the given class
+     */
+    char representative(int byte_class) const;
+
+    /**
+     * \brief All the characters in the given class
+     */
+    ByteSet members(int byte_class) const;
+
+private:
+    std::array<unsigned char, 256> classes_;
+    int count_ = 1;
+};
+
 /**
  * \brief Undeterministic automaton, used to execute regular expressions
  */
@@ -88,9 +229,20 @@ public:
 
     /**
      * \brief Turn the automaton into an equivalent deterministic automaton
+     *
+     * Node transitions become deterministic, accepting nodes have a single
+     * empty transition to the output node.
+     * \complexity Exponential in the number of nodes in the worst case,
+     * use dfa::LazyDfa to only build the states needed by the input
      */
     void make_deterministic();
 
+    /**
+     * \brief Byte classes distinguished by the transitions of this graph
+     * \complexity O(t) where t is the number of transitions
+     */
+    ByteClasses byte_classes() const;
+
     /**
      * \brief Merges another graph to the current one, emptying it in the process
      * \return Whether the merge was successful
@@ -130,17 +282,15 @@ private:
 
 
 /**
- * \brief Transition between nodes, takes a character and returns if it matches
+ * \brief Transition between nodes, matches any character in \c condition
  */
 class Transition {
 public:
-    typedef std::function<bool(char)> Functor;
-
-    Transition(Node* target, const Functor& condition)
+    Transition(Node* target, const ByteSet& condition)
         : target(target), condition(condition) {}
 
     Node*   target;
-    Functor condition;
+    ByteSet condition;
 };
 
 /**
@@ -171,7 +321,7 @@ public:
     /**
      * \brief Adds a transition
      */
-    void add_transition(Node* target, const Transition::Functor& condition);
+    void add_transition(Node* target, const ByteSet& condition);
 
     /**
      * \brief Adds a transition
@@ -205,45 +355,517 @@ private:
     NFA*                    graph_ = nullptr;
 
     friend class NFA;
+    friend class Program;
+};
+
+/**
+ * \brief Assembles the states of a Program without building a NFA graph
+ *
+ * Transitions can be added in any order, they are grouped by state when
+ * the Program is constructed.
+ */
+class ProgramBuilder {
+public:
+    /**
+     * \brief Part of the automaton with a single entry and exit state
+     */
+    struct Fragment {
+        int input;
+        int output;
+    };
+
+    /**
+     * \brief Adds a state without transitions
+     * \return Its index
+     */
+    int add_state();
+
+    /**
+     * \brief Adds two unconnected states (a fragment not matching anything)
+     */
+    Fragment add_fragment();
+
+    /**
+     * \brief Adds a transition through the characters in \p condition
+     */
+    void add_transition(int source, int target, const ByteSet& condition);
+
+    /**
+     * \brief Adds an empty transition
+     */
+    void add_transition(int source, int target);
+
+    void set_input(int state);
+
+    void set_output(int state);
+
+    /**
+     * \brief Marks \p state as accepting
+     */
+    void set_match_id(int state, int match_id);
+
+    /**
+     * \brief Number of states
+     */
+    int size() const;
+
+private:
+    struct Transition {
+        int source;
+        int target;
+    };
+
+    std::vector<Transition> transitions_;
+    /// Condition of each element of transitions_
+    std::vector<ByteSet> conditions_;
+    std::vector<Transition> empty_;
+    std::vector<int> match_ids_;
+    int input_ = -1;
+    int output_ = -1;
+
+    friend class Program;
 };
 
+/**
+ * \brief Compact form of a NFA, ready to be executed
+ *
+ * States are identified by their index, transitions and empty transitions
+ * of all the states are stored in contiguous arrays.
+ */
+class Program {
+public:
+    /**
+     * \brief Transition to \c target through the characters in \c condition
+     */
+    struct Edge {
+        int target;
+        int condition;
+    };
+
+    /**
+     * \brief Contiguous sequence of elements, usable in range-based for
+     */
+    template<class T>
+        class Range {
+        public:
+            Range(const T* begin, const T* end) : begin_(begin), end_(end) {}
+            const T* begin() const { return begin_; }
+            const T* end() const { return end_; }
+            std::size_t size() const { return end_ - begin_; }
+        private:
+            const T* begin_;
+            const T* end_;
+        };
+
+    /**
+     * \brief Program without any state (it doesn't match anything)
+     */
+    Program();
+
+    /**
+     * \brief Flattens the nodes of \p nfa reachable from its input
+     *
+     * The output node is the only accepting state, with match id 0.
+     * \complexity O(n+t) where t is the number of transitions
+     */
+    explicit Program(const NFA& nfa);
+
+    /**
+     * \brief Flattens the nodes of \p nfa reachable from its input
+     * \param accepting Distinct accepting nodes, each state gets as match
+     *                  id the index of its node in this vector
+     * \complexity O(n+t) where t is the number of transitions
+     */
+    Program(const NFA& nfa, const std::vector<Node*>& accepting);
+
+    /**
+     * \brief Groups the transitions added to \p builder by state
+     * \complexity O(n+t) where t is the number of transitions
+     */
+    explicit Program(const ProgramBuilder& builder);
+
+    /**
+     * \brief Number of states
+     */
+    int size() const;
+
+    /**
+     * \brief Starting state (-1 if the program is empty)
+     */
+    int input() const;
+
+    /**
+     * \brief State of the output node of the NFA (-1 if it can't be reached)
+     */
+    int output() const;
+
+    /**
+     * \brief Identifies which accepting node \p state corresponds to
+     * \return The match id or -1 if the state isn't accepting
+     */
+    int match_id(int state) const {
+        return match_ids_[state];
+    }
+
+    /**
+     * \brief Transitions leaving \p state
+     */
+    Range<Edge> edges(int state) const;
+
+    /**
+     * \brief Targets of the empty transitions leaving \p state
+     */
+    Range<int> empty_transitions(int state) const;
+
+    /**
+     * \brief States reachable from \p state through empty transitions
+     *
+     * Only the states which have transitions or are accepting are present
+     * (including \p state itself), as the others can't affect the result.
+     */
+    Range<int> closure(int state) const;
+
+    /**
+     * \brief Whether \p edge accepts \p c
+     */
+    bool matches(const Edge& edge, char c) const {
+        return conditions_[edge.condition].contains(c);
+    }
+
+    /**
+     * \brief Distinct transition conditions, referenced by Edge::condition
+     */
+    const std::vector<ByteSet>& conditions() const;
+
+    /**
+     * \brief Byte classes distinguished by the transitions
+     */
+    const ByteClasses& byte_classes() const;
+
+private:
+    /**
+     * \brief Builder with the nodes of \p nfa reachable from its input
+     */
+    static ProgramBuilder flatten(const NFA& nfa, const std::vector<Node*>& accepting);
+
+    /// Index of the first edge of each state, plus one past the end
+    std::vector<int> edge_begin_;
+    std::vector<Edge> edges_;
+    /// Index of the first empty transition of each state, plus one past the end
+    std::vector<int> empty_begin_;
+    std::vector<int> empty_;
+    /// Index of the first closure state of each state, plus one past the end
+    std::vector<int> closure_begin_;
+    std::vector<int> closure_;
+    std::vector<int> match_ids_;
+    std::vector<ByteSet> conditions_;
+    ByteClasses classes_;
+    int input_ = -1;
+    int output_ = -1;
+};
+
+/**
+ * \brief Set of small integers with O(1) insertion, lookup and clear
+ */
+class SparseSet {
+public:
+    explicit SparseSet(std::size_t capacity = 0)
+        : dense_(capacity), sparse_(capacity) {}
+
+    /**
+     * \brief Changes the maximum value (plus one) storable in the set, clears the set
+     */
+    void resize(std::size_t capacity) {
+        dense_.resize(capacity);
+        sparse_.resize(capacity);
+        size_ = 0;
+    }
+
+    std::size_t capacity() const {
+        return dense_.size();
+    }
+
+    bool contains(int value) const {
+        std::size_t index = sparse_[value];
+        return index < size_ && dense_[index] == value;
+    }
+
+    /**
+     * \brief Inserts a value
+     * \pre <tt>value < capacity()</tt>
+     * \return \b true if the value wasn't already in the set
+     */
+    bool insert(int value) {
+        if (contains(value))
+            return false;
+        sparse_[value] = size_;
+        dense_[size_++] = value;
+        return true;
+    }
+
+    void clear() {
+        size_ = 0;
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    /**
+     * \brief Iterates values in insertion order
+     */
+    const int* begin() const {
+        return dense_.data();
+    }
+
+    const int* end() const {
+        return dense_.data() + size_;
+    }
+
+    void swap(SparseSet& other) {
+        dense_.swap(other.dense_);
+        sparse_.swap(other.sparse_);
+        std::swap(size_, other.size_);
+    }
+
+private:
+    std::vector<int> dense_;
+    std::vector<std::size_t> sparse_;
+    std::size_t size_ = 0;
+};
+
+/**
+ * \brief Executes a Program, keeping track of all the active states
+ *
+ * The state buffers are allocated on construction, stepping through the
+ * input and resetting the runner don't allocate memory.
+ */
 class NfaRunner {
 public:
-    explicit NfaRunner(const NFA& nfa);
+    typedef SparseSet StateSet;
+
+    explicit NfaRunner(const Program& program);
+
+    /**
+     * \brief Goes back to the starting state
+     */
+    void reset();
 
     /**
      * \brief Returns the current state
      */
-    const NodeList& state() const;
+    const StateSet& state() const;
 
     /**
      * \brief Sets the current state
      */
-    void set_state(const NodeList& state);
+    void set_state(const std::vector<int>& state);
 
     /**
-     * \brief Whether the current state contains an accepting node
+     * \brief Whether the current state contains the output
      */
     bool acceptable() const;
 
+    /**
+     * \brief Appends to \p ids the match ids of the active accepting states
+     */
+    void matches(std::vector<int>& ids) const;
+
     /**
      * \brief Advance to the state corresponding to the given input
      */
     void step(char c);
 
+    /**
+     * \brief Sizes of the state after each step, empty without REGEX_STATS
+     */
+    MatchStats stats() const;
+
+    void reset_stats();
+
 protected:
     /**
-     * \brief Expand empty transitions
+     * \brief Inserts \p state in \p output, expanding empty transitions
+     */
+    void expand_empty(StateSet& output, int state) const;
+
+private:
+    const Program& program_;
+    StateSet state_;
+    /// Buffer for the state following the current one
+    StateSet next_;
+#ifdef REGEX_STATS
+    MatchStats stats_;
+#endif
+};
+
+/**
+ * \brief Finds all the matches of a Program in an input fed in chunks
+ *
+ * Matches are leftmost-longest and don't overlap, an empty match right
+ * after the end of the previous match is ignored.
+ * All the starting positions are explored in a single pass, each active
+ * state remembers the leftmost position it has been reached from.
+ *
+ * Once a candidate match is found, the threads which could still extend
+ * it keep running and the input following its end is buffered, as it
+ * needs to be read again when the match is reported. That buffer has no
+ * bound: it lasts as long as a longer match remains possible. When the
+ * match is reported, the states reached since its end are remembered as
+ * dead ends, since any of them leading to a match would have extended it,
+ * and the input is read again without them: a state is expanded at most
+ * once at each position.
+ * \complexity O(n * m) where n is the size of the input and m the size of
+ *             the program, the buffer and the dead ends are O(b * m) for b
+ *             buffered characters
+ */
+class Scanner {
+public:
+    /**
+     * \param program Program to execute
+     * \param prefix  String every match starts with, when no state is
+     *                active the input is skipped to its next occurrence
+     */
+    explicit Scanner(const Program& program, const std::string& prefix = std::string());
+
+    /**
+     * \brief Goes back to the start of the input
+     */
+    void reset();
+
+    /**
+     * \brief Reads the next chunk of input
+     * \param data    Chunk contents
+     * \param size    Chunk size
+     * \param matches Matches completed within the chunk are appended here
+     */
+    void feed(const char* data, std::size_t size, std::vector<Match>& matches);
+
+    /**
+     * \brief Reads the next chunk of input
+     */
+    void feed(const std::string& chunk, std::vector<Match>& matches);
+
+    /**
+     * \brief Reads a single character
      */
-    static NodeList expand_empty(NodeList source);
+    void feed(char c, std::vector<Match>& matches);
+
+    /**
+     * \brief Marks the end of the input, reporting the pending matches
+     * \note Call reset() before feeding a new input
+     */
+    void finish(std::vector<Match>& matches);
+
+    /**
+     * \brief Number of characters read since the start of the input
+     */
+    std::size_t position() const;
+
     /**
-     * \brief Expand transitions
+     * \brief Sizes of the active states after each character, empty without REGEX_STATS
+     * \note Kept across reset()
      */
-    static NodeList expand(NodeList source, char c);
+    MatchStats stats() const;
+
+    void reset_stats();
 
 private:
-    const NFA& nfa_;
-    NodeList state_;
+    /**
+     * \brief Steps through \p c and reports the candidate match once
+     * no thread can extend it anymore
+     */
+    void advance(char c, std::vector<Match>& matches);
+
+    /**
+     * \brief Reads again the buffered characters after the current position
+     */
+    void drain(std::vector<Match>& matches);
+
+    /**
+     * \brief Drops the buffered characters which won't be read again
+     */
+    void trim();
+
+    /**
+     * \brief Skips the characters which can't start a match
+     * \pre idle_
+     * \return Number of skipped characters
+     */
+    std::size_t skip(const char* data, std::size_t size);
+
+    /**
+     * \brief Advances the active states through \p c
+     */
+    void step(char c);
+
+    /**
+     * \brief Starts a new thread at the current position and checks
+     * whether it's the end of a better candidate match
+     */
+    void settle();
+
+    /**
+     * \brief Reports the candidate match and restarts from its end
+     */
+    void report(std::vector<Match>& matches);
+
+    /**
+     * \brief Adds the states reached since the end of the candidate match
+     * to the dead ends, the output aside
+     *
+     * Called once no thread can extend the candidate: any of these states
+     * leading to a match would have extended it, so none does. They are
+     * found again from candidate_states_ along the buffered input.
+     */
+    void record_dead_ends();
+
+    void add_dead_end(std::size_t position, int state);
+
+    /**
+     * \brief Marks the dead ends at \p position in dead_mark_
+     * \return Whether there are any
+     */
+    bool mark_dead_ends(std::size_t position);
+
+    const Program& program_;
+    std::string prefix_;
+    SparseSet state_;
+    SparseSet next_;
+    /// Whether the only active states have been started at the current position
+    bool idle_ = true;
+    /// Starting position of each state in state_
+    std::vector<std::size_t> start_;
+    /// Starting position of each state in next_
+    std::vector<std::size_t> next_start_;
+
+    std::size_t position_ = 0;
+    /// Threads aren't started before this position
+    std::size_t min_start_ = 0;
+    /// End of the last non-empty match, where an empty match is ignored
+    std::size_t no_empty_at_ = -1;
+
+    bool has_candidate_ = false;
+    Match candidate_;
+    /// Characters from buffer_begin_ on, kept to be read again
+    std::string buffer_;
+    std::size_t buffer_begin_ = 0;
+
+    /// States which can still extend the candidate, at its end, set by
+    /// the step leaving it
+    std::vector<int> candidate_states_;
+    /// States which lead to no match, at each position from dead_begin_ on
+    std::deque<std::vector<int>> dead_;
+    std::size_t dead_begin_ = 0;
+    /// Position + 1 for the dead ends at that position, see mark_dead_ends()
+    std::vector<std::size_t> dead_mark_;
+#ifdef REGEX_STATS
+    MatchStats stats_;
+#endif
 };
 
 }} // namespace regex::dfa
@@ -27,62 +27,92 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <sstream>
 
+#include "re_arena.hpp"
 #include "re_ast.hpp"
 
 using namespace regex;
 
-nfa::NFA regex::Parser::compile(std::istream &input) {
-    ast::Node* parsed = parse(input);
+nfa::NFA regex::Parser::compile(std::istream &input, Literals* literals) {
+    Arena arena;
+    ast::Node* parsed = parse(input, arena);
+    if (literals)
+        *literals = parsed ? parsed->literals() : Literals();
     if (!parsed)
         return nfa::NFA();
-    nfa::NFA nfa = std::move(parsed->build());
-    delete parsed;
-    return std::move(nfa);
+    return parsed->build();
 }
 
-nfa::NFA Parser::compile(const std::string &input) {
+nfa::NFA Parser::compile(const std::string &input, Literals* literals) {
     std::istringstream ss(input);
-    return std::move(compile(ss));
+    return std::move(compile(ss, literals));
+}
+
+nfa::ProgramBuilder::Fragment Parser::compile_into(std::istream& input,
+                                                   nfa::ProgramBuilder& builder,
+                                                   Literals* literals) {
+    Arena arena;
+    ast::Node* parsed = parse(input, arena);
+    if (literals)
+        *literals = parsed ? parsed->literals() : Literals();
+    if (!parsed)
+        return builder.add_fragment();
+    return parsed->emit(builder);
+}
+
+nfa::ProgramBuilder::Fragment Parser::compile_into(const std::string& input,
+                                                   nfa::ProgramBuilder& builder,
+                                                   Literals* literals) {
+    std::istringstream ss(input);
+    return compile_into(ss, builder, literals);
+}
+
+nfa::Program Parser::compile_program(const std::string& input, Literals* literals) {
+    nfa::ProgramBuilder builder;
+    nfa::ProgramBuilder::Fragment fragment = compile_into(input, builder, literals);
+    builder.set_input(fragment.input);
+    builder.set_output(fragment.output);
+    builder.set_match_id(fragment.output, 0);
+    return nfa::Program(builder);
 }
 
 bool SimpleParser::error() const {
     return false;
 }
 
-ast::Node *SimpleParser::parse(std::istream &input) {
+ast::Node *SimpleParser::parse(std::istream &input, Arena &arena) {
     if (!input)
         return nullptr;
-    return parse_choice(input);
+    return parse_choice(input, arena);
 }
 
-ast::Node *SimpleParser::parse_choice(std::istream &input) const {
-    ast::Node* node = parse_concat(input);
+ast::Node *SimpleParser::parse_choice(std::istream &input, Arena &arena) const {
+    ast::Node* node = parse_concat(input, arena);
     while (input.peek() == '|') {
         input.get();
         if (input.peek() == std::char_traits<char>::eof())
             break;
-        node = new ast::Choice(node, parse_concat(input));
+        node = arena.create<ast::Choice>(node, parse_concat(input, arena));
     }
     return node;
 }
 
-ast::Node *SimpleParser::parse_concat(std::istream &input) const {
-    ast::Node* node = parse_primary(input);
+ast::Node *SimpleParser::parse_concat(std::istream &input, Arena &arena) const {
+    ast::Node* node = parse_primary(input, arena);
     while (is_primary(input.peek())) {
-        node = new ast::Concat(node,parse_primary(input));
+        node = arena.create<ast::Concat>(node,parse_primary(input, arena));
     }
     return node;
 }
 
-ast::Node *SimpleParser::parse_primary(std::istream &input) const {
+ast::Node *SimpleParser::parse_primary(std::istream &input, Arena &arena) const {
     std::char_traits<char>::int_type c = input.get();
     ast::Node *node = nullptr;
     if (c == '\\' && input.peek() != std::char_traits<char>::eof()) {
-        node = new ast::SingleCharacter(input.get());
+        node = arena.create<ast::SingleCharacter>(input.get());
     } else if (c == '.') {
-        node = new ast::Leaf([](char){return true;});
+        node = arena.create<ast::Leaf>(nfa::ByteSet::all());
     } else if (c == '[') {
-        node = parse_bracket(input);
+        node = parse_bracket(input, arena);
     } else if (c == '(') {
         bool capture = true;
         if (input.peek() == '?') {
@@ -92,56 +122,60 @@ ast::Node *SimpleParser::parse_primary(std::istream &input) const {
                 capture = false;
             }
         }
-        node = parse_choice(input);
+        node = parse_choice(input, arena);
         if (capture)
-            node = new ast::Subexpression(node);
+            node = arena.create<ast::Subexpression>(node);
         input.get(); // skip )
     } else {
-        node = new ast::SingleCharacter(c);
+        node = arena.create<ast::SingleCharacter>(c);
     }
 
-    return parse_quantifier(input, node);
+    return parse_quantifier(input, arena, node);
 }
 
-ast::Node *SimpleParser::parse_bracket(std::istream &input) const {
+ast::Node *SimpleParser::parse_bracket(std::istream &input, Arena &arena) const {
     std::char_traits<char>::int_type c = input.get();
     bool negate = false;
-    std::string characters;
+    nfa::ByteSet characters;
     if ( c == '^' ) {
         negate = true;
         c = input.get();
     } else if ( c == '-' ) {
-        characters += c;
+        characters.insert(c);
         c = input.get();
     }
 
     while ( c != std::char_traits<char>::eof() && c != ']' ) {
         // TODO: [:alpha:]
         if (c == '\\' && input.peek() != std::char_traits<char>::eof()) {
-            characters += input.get();
+            characters.insert(input.get());
         } else if (input.peek() == '-') {
             input.get();
-            char d = input.get();
-            for (; c <= d; c++)
-                characters += c;
+            if (input.peek() == ']' || input.peek() == std::char_traits<char>::eof()) {
+                // trailing - is a literal
+                characters.insert(c);
+                characters.insert('-');
+            } else {
+                characters.insert_range(c, input.get());
+            }
         } else {
-            characters += c;
+            characters.insert(c);
         }
         c = input.get();
     }
     if ( negate )
-        return new ast::Leaf([characters](char c) { return characters.find(c) == std::string::npos; });
-    return new ast::Leaf([characters](char c) { return characters.find(c) == std::string::npos; });
+        characters.negate();
+    return arena.create<ast::Leaf>(characters);
 }
 
-ast::Node *SimpleParser::parse_quantifier(std::istream &input, ast::Node *child) const {
+ast::Node *SimpleParser::parse_quantifier(std::istream &input, Arena &arena, ast::Node *child) const {
     std::char_traits<char>::int_type c = input.get();
     if (c == '?')
-        return new ast::Optional(child);
+        return arena.create<ast::Optional>(child);
     else if (c == '*')
-        return new ast::KleeneStar(child);
+        return arena.create<ast::KleeneStar>(child);
     else if (c == '+')
-        return new ast::KleenePlus(child);
+        return arena.create<ast::KleenePlus>(child);
     // TODO: a{3,5}
     if (c != std::char_traits<char>::eof())
         input.unget();
@@ -34,6 +34,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 namespace regex {
 
 namespace ast { class Node; }
+class Arena;
+struct Literals;
 
 class Parser {
 public:
@@ -41,15 +43,46 @@ public:
 
     /**
      * \brief Compiles the input stream
+     * \param literals If not null, set to the literals required by the expression
      * \return The corresponding automaton
      */
-    nfa::NFA compile(std::istream& input);
+    nfa::NFA compile(std::istream& input, Literals* literals = nullptr);
 
     /**
      * \brief Compiles the input string
+     * \param literals If not null, set to the literals required by the expression
      * \return The corresponding automaton
      */
-    nfa::NFA compile(const std::string& input);
+    nfa::NFA compile(const std::string& input, Literals* literals = nullptr);
+
+    /**
+     * \brief Compiles the input stream, adding its states to \p builder
+     *
+     * Doesn't create an intermediate NFA graph, and the AST is released
+     * at once when the function returns.
+     * \param literals If not null, set to the literals required by the expression
+     * \return The input and output states of the expression
+     */
+    nfa::ProgramBuilder::Fragment compile_into(std::istream& input,
+                                               nfa::ProgramBuilder& builder,
+                                               Literals* literals = nullptr);
+
+    /**
+     * \brief Compiles the input string, adding its states to \p builder
+     * \param literals If not null, set to the literals required by the expression
+     * \return The input and output states of the expression
+     */
+    nfa::ProgramBuilder::Fragment compile_into(const std::string& input,
+                                               nfa::ProgramBuilder& builder,
+                                               Literals* literals = nullptr);
+
+    /**
+     * \brief Compiles the input string into a program
+     *
+     * The output of the expression is the only accepting state, with match id 0.
+     * \param literals If not null, set to the literals required by the expression
+     */
+    nfa::Program compile_program(const std::string& input, Literals* literals = nullptr);
 
     /**
      * \brief Whether the parser has encountered an error
@@ -59,9 +92,9 @@ public:
 protected:
     /**
      * \brief Parses the input stream
-     * \return A dynamically-allocated AST tree
+     * \return An AST tree allocated in \p arena
      */
-    virtual ast::Node* parse(std::istream& input) = 0;
+    virtual ast::Node* parse(std::istream& input, Arena& arena) = 0;
 };
 
 class SimpleParser : public Parser {
@@ -69,27 +102,27 @@ public:
     bool error() const override;
 
 protected:
-    ast::Node* parse(std::istream& input) override;
+    ast::Node* parse(std::istream& input, Arena& arena) override;
 
 private:
-    ast::Node* parse_choice(std::istream& input) const;
-    ast::Node* parse_concat(std::istream& input) const;
+    ast::Node* parse_choice(std::istream& input, Arena& arena) const;
+    ast::Node* parse_concat(std::istream& input, Arena& arena) const;
     /**
      * \pre  input.peek() is ( or a character indicating some kind of character match
      * \post input.peek() is the character follwing the primary expression
      */
-    ast::Node* parse_primary(std::istream& input) const;
+    ast::Node* parse_primary(std::istream& input, Arena& arena) const;
     /**
      * \pre  input.peek() is the character following the [
      * \post input.peek() is the character following the ]
      */
-    ast::Node* parse_bracket(std::istream& input) const;
+    ast::Node* parse_bracket(std::istream& input, Arena& arena) const;
     /**
      * \pre  input.peek() is the quantifier character
      * \post input.peek() is the character following the quantifier
      * \note returns \c child if there is no quantifier
      */
-    ast::Node* parse_quantifier(std::istream& input, ast::Node* child) const;
+    ast::Node* parse_quantifier(std::istream& input, Arena& arena, ast::Node* child) const;
 
     bool is_primary(std::char_traits<char>::int_type c) const;
 };
@@ -24,12 +24,40 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 */
+#include <cstddef>
 #include <functional>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
-template<class Key, class Value, class Comparator = std::less<Key>>
-class RedBlackNode {
+#include "node_pool.hpp"
+#include "stats.hpp"
+#include "traversal.hpp"
+
+/**
+ * \brief Number of nodes in the subtree of a RedBlackNode, only stored if \p Enabled
+ */
+template<bool Enabled>
+struct RedBlackSubtreeSize {
+    int subtree_size() const { return 0; }
+    void set_subtree_size(int) {}
+};
+
+template<>
+struct RedBlackSubtreeSize<true> {
+    int subtree_size() const { return subtree_size_; }
+    void set_subtree_size(int size) { subtree_size_ = size; }
+
+private:
+    int subtree_size_ = 1;
+};
+
+template<class Key, class Value, class Comparator = std::less<Key>, bool OrderStatistics = false>
+class RedBlackNode : public RedBlackSubtreeSize<OrderStatistics> {
 public:
     enum class Color {
         BLACK,
@@ -44,9 +72,10 @@ public:
      * \param search     The key to find
      * \param get_parent Whether to return the parent (for insertion)
      *                   rather than null on unmatched key
+     * \complexity O(log n)
      */
     RedBlackNode* recursive_find(const Key& search, bool get_parent) {
-        return noconst(&RedBlackNode::recursive_find, search, get_parent);
+        return find_from(this, search, get_parent);
     }
 
     /**
@@ -54,14 +83,10 @@ public:
      * \param search     The key to find
      * \param get_parent Whether to return the parent (for insertion)
      *                   rather than null on unmatched key
+     * \complexity O(log n)
      */
     const RedBlackNode* recursive_find(const Key& search, bool get_parent) const {
-        const RedBlackNode* fail_return = get_parent ? this : nullptr;
-        if (Comparator()(search,key))
-            return left ? left->recursive_find(search, get_parent) : fail_return;
-        else if (Comparator()(key,search))
-            return right ? right->recursive_find(search, get_parent) : fail_return;
-        return this;
+        return find_from(this, search, get_parent);
     }
 
     bool is_left_child() const {
@@ -73,12 +98,10 @@ public:
     }
 
     RedBlackNode* sibling() {
-        return noconst(&RedBlackNode::sibling);
+        return sibling_of(this);
     }
     const RedBlackNode* sibling() const {
-        if (!parent)
-            return nullptr;
-        return parent->left == this ? parent->right : parent->left;
+        return sibling_of(this);
     }
 
     /**
@@ -86,14 +109,14 @@ public:
      * \complexity O(log n)
      */
     RedBlackNode* minimum() {
-        return noconst(&RedBlackNode::minimum);
+        return minimum_of(this);
     }
     /**
      * \brief Get node with maximum key in the current subtree
      * \complexity O(log n)
      */
     RedBlackNode* maximum() {
-        return noconst(&RedBlackNode::maximum);
+        return maximum_of(this);
     }
 
     /**
@@ -101,7 +124,7 @@ public:
      * \complexity O(log n)
      */
     RedBlackNode* successor() {
-        return noconst(&RedBlackNode::successor);
+        return successor_of(this);
     }
 
     /**
@@ -109,7 +132,7 @@ public:
      * \complexity O(log n)
      */
     RedBlackNode* predecessor() {
-        return noconst(&RedBlackNode::predecessor);
+        return predecessor_of(this);
     }
 
 
@@ -118,18 +141,14 @@ public:
      * \complexity O(log n)
      */
     const RedBlackNode* minimum() const {
-        if (left)
-            return left->minimum();
-        return this;
+        return minimum_of(this);
     }
     /**
      * \brief Get node with maximum key in the current subtree
      * \complexity O(log n)
      */
     const RedBlackNode* maximum() const {
-        if (right)
-            return right->maximum();
-        return this;
+        return maximum_of(this);
     }
 
     /**
@@ -137,15 +156,7 @@ public:
      * \complexity O(log n)
      */
     const RedBlackNode* successor() const {
-        if (right)
-            return right->minimum();
-        const RedBlackNode* node = this;
-        const RedBlackNode* p = parent;
-        while(p && node->is_right_child()) {
-            node = p;
-            p = p->parent;
-        }
-        return p;
+        return successor_of(this);
     }
 
     /**
@@ -153,35 +164,49 @@ public:
      * \complexity O(log n)
      */
     const RedBlackNode* predecessor() const {
-        if (left)
-            return left->maximum();
-        const RedBlackNode* node = *this;
-        const RedBlackNode* p = parent;
-        while(p && node->is_left_child()) {
-            node = p;
-            p = p->p;
-        }
-        return p;
+        return predecessor_of(this);
     }
 
     /**
      * \brief Copy the sub-tree rooted in the current node
+     *
+     * Iterative, the right children still to copy are kept on a stack
+     * bounded by the height of a red-black tree.
+     * \param pool NodePool to allocate the new nodes from
      * \complexity O(n)
      */
-    RedBlackNode* deep_copy() const {
-        RedBlackNode* node = new RedBlackNode(*this);
-        if (left) {
-            node->left = left->deep_copy();
-            node->left->parent = node;
-        }
-        if (right) {
-            node->right = right->deep_copy();
-            node->right->parent = node;
+    template<class Pool>
+        RedBlackNode* deep_copy(Pool& pool) const {
+            // A red-black tree of n nodes is at most 2 log2(n+1) high
+            const RedBlackNode* pending_source[2 * 8 * sizeof(std::size_t)];
+            RedBlackNode* pending_copy[2 * 8 * sizeof(std::size_t)];
+            std::size_t pending = 0;
+
+            RedBlackNode* root = copy_alone(pool, nullptr);
+            const RedBlackNode* source = this;
+            RedBlackNode* copy = root;
+            for (;;) {
+                if (source->right) {
+                    pending_source[pending] = source;
+                    pending_copy[pending++] = copy;
+                }
+                if (source->left) {
+                    copy->left = source->left->copy_alone(pool, copy);
+                } else if (pending) {
+                    source = pending_source[--pending];
+                    copy = pending_copy[pending];
+                    copy->right = source->right->copy_alone(pool, copy);
+                    source = source->right;
+                    copy = copy->right;
+                    continue;
+                } else {
+                    break;
+                }
+                source = source->left;
+                copy = copy->left;
+            }
+            return root;
         }
-        node->parent = nullptr;
-
-        return node;
-    }
 
     Key   key;
     Value value;
@@ -192,30 +217,127 @@ public:
     Color color;
 
 private:
+    /*
+     * The static helpers take the node pointer as a template parameter,
+     * so they serve both the const and non-const members
+     */
+    template<class NodePtr>
+        static NodePtr find_from(NodePtr node, const Key& search, bool get_parent) {
+            for (;;) {
+                NodePtr next;
+                if (Comparator()(search, node->key))
+                    next = node->left;
+                else if (Comparator()(node->key, search))
+                    next = node->right;
+                else
+                    return node;
+                if (!next)
+                    return get_parent ? node : nullptr;
+                node = next;
+            }
+        }
+
+    template<class NodePtr>
+        static NodePtr sibling_of(NodePtr node) {
+            if (!node->parent)
+                return nullptr;
+            return node->parent->left == node ? node->parent->right : node->parent->left;
+        }
+
+    template<class NodePtr>
+        static NodePtr minimum_of(NodePtr node) {
+            while (node->left)
+                node = node->left;
+            return node;
+        }
+
+    template<class NodePtr>
+        static NodePtr maximum_of(NodePtr node) {
+            while (node->right)
+                node = node->right;
+            return node;
+        }
+
+    template<class NodePtr>
+        static NodePtr successor_of(NodePtr node) {
+            if (node->right)
+                return minimum_of(node->right);
+            NodePtr p = node->parent;
+            while (p && node == p->right) {
+                node = p;
+                p = p->parent;
+            }
+            return p;
+        }
+
+    template<class NodePtr>
+        static NodePtr predecessor_of(NodePtr node) {
+            if (node->left)
+                return maximum_of(node->left);
+            NodePtr p = node->parent;
+            while (p && node == p->left) {
+                node = p;
+                p = p->parent;
+            }
+            return p;
+        }
+
     /**
-     * \brief Simple hack to avoid code duplication
+     * \brief Copy of this node alone, under \p parent
      */
-    template<class... FuncArgs, class... PassedArgs>
-        RedBlackNode* noconst(const RedBlackNode* (RedBlackNode::*method)(FuncArgs...) const, PassedArgs... args) const {
-            return const_cast<RedBlackNode*>((this->*method)(args...));
+    template<class Pool>
+        RedBlackNode* copy_alone(Pool& pool, RedBlackNode* parent) const {
+            RedBlackNode* node = pool.template create<RedBlackNode>(*this);
+            node->parent = parent;
+            node->left = node->right = nullptr;
+            return node;
         }
 };
 
-template<class Key, class Value, class Comparator = std::less<Key>>
-class RedBlackTree {
+/**
+ * \brief Statistics of a RedBlackTree, collected when its CollectStats parameter is true
+ */
+struct RedBlackTreeStats {
+    /// Depth at which each new node has been inserted, the root being at 0
+    Histogram insert_depth;
+    /// Rotations done by the rebalancing after each insertion
+    Histogram insert_rotations;
+    /// Rotations done by the rebalancing after each removal of a black node
+    Histogram erase_rotations;
+};
+
+/**
+ * \brief Ordered map, balanced as a red-black tree
+ *
+ * The nodes of a tree are allocated from its own NodePool, which
+ * gets its blocks from \p Allocator. The tree returned by split() gets
+ * a pool of its own as well, so both halves can go to different threads.
+ *
+ * If \p OrderStatistics is true, each node also stores the size of its
+ * subtree, which gives select() and rank() in O(log n).
+ *
+ * If \p CollectStats is true, stats() gives the RedBlackTreeStats of the
+ * insertions and removals done so far.
+ */
+template<class Key, class Value, class Comparator = std::less<Key>,
+         class Allocator = std::allocator<std::pair<const Key, Value>>,
+         bool OrderStatistics = false, bool CollectStats = false>
+class RedBlackTree : public StatsRecorder<RedBlackTreeStats, CollectStats> {
 public:
     typedef const Key                               key_type;
     typedef Value                                   value_type;
-    typedef RedBlackNode<key_type,Value,Comparator> node_type;
+    typedef RedBlackNode<key_type,Value,Comparator,OrderStatistics> node_type;
     typedef node_type*                              node_pointer;
     typedef const node_type*                        node_const_pointer;
     typedef typename node_type::Color               color_type;
+    typedef Allocator                               allocator_type;
+    typedef NodePool<Allocator>                     pool_type;
 
     template<class NodePointer>
     class iterator_base {
     public:
         typedef NodePointer node_pointer;
-        typedef decltype(NodePointer()->value) reference_type;
+        typedef decltype((NodePointer()->value)) reference_type;
         typedef typename std::add_pointer<reference_type>::type pointer_type;
         typedef typename
             std::conditional<
@@ -262,6 +384,13 @@ public:
             return &node->value;
         }
 
+        /**
+         * \brief Key of the element
+         */
+        key_type& key() const {
+            return node->key;
+        }
+
         bool operator== (const iterator_base& other) const {
             return node == other.node;
         }
@@ -282,34 +411,50 @@ public:
     typedef iterator_base<node_pointer>         iterator;
     typedef iterator_base<node_const_pointer>   const_iterator;
 
-    RedBlackTree() : root_(nullptr), size_(0) {}
+    explicit RedBlackTree(const Allocator& allocator = Allocator())
+        : root_(nullptr), size_(0),
+          pool_(sizeof(node_type), alignof(node_type), allocator) {}
 
-    RedBlackTree (RedBlackTree&& other) : root_(other.root_), size_(other.size_) {
-        other.root_ = nullptr;
-        other.size_ = 0;
+    RedBlackTree (RedBlackTree&& other) : RedBlackTree(other.get_allocator()) {
+        swap(other);
     }
 
-    RedBlackTree (const RedBlackTree& other)
-        : root_(other.root_->deep_copy()), size_(other.size_) {}
-
-    RedBlackTree& operator= (const RedBlackTree& other) {
-        recursive_delete(root_);
-        root_ = other.root_->deep_copy();
+    /**
+     * \brief Copies the nodes into a new pool
+     * \complexity O(n)
+     */
+    RedBlackTree (const RedBlackTree& other) : RedBlackTree(other.get_allocator()) {
+        root_ = other.root_ ? other.root_->deep_copy(pool_) : nullptr;
         size_ = other.size_;
-        return *this;
     }
 
-    RedBlackTree& operator= (RedBlackTree&& other) {
-        recursive_delete(root_);
-        root_ = other.root_;
-        size_ = other.size_;
-        other.root_ = nullptr;
-        other.size_ = 0;
+    RedBlackTree& operator= (RedBlackTree other) {
+        swap(other);
         return *this;
     }
 
+    /**
+     * \complexity O(blocks) if the keys and values are trivially destructible, O(n) otherwise
+     */
     ~RedBlackTree() {
-        recursive_delete(root_);
+        destroy_nodes();
+    }
+
+    void swap(RedBlackTree& other) {
+        std::swap(root_, other.root_);
+        std::swap(size_, other.size_);
+        pool_.swap(other.pool_);
+    }
+
+    /**
+     * \brief Removes all the nodes and gives the pool blocks back to the allocator
+     * \complexity O(blocks) if the keys and values are trivially destructible, O(n) otherwise
+     */
+    void clear() {
+        destroy_nodes();
+        pool_.clear();
+        root_ = nullptr;
+        size_ = 0;
     }
 
     /**
@@ -330,7 +475,7 @@ public:
         iterator next = it;
         ++next;
         node_pointer todelete = erase_node(it.node);
-        delete todelete;
+        pool_.destroy(todelete);
         return next;
     }
 
@@ -425,6 +570,91 @@ public:
         return const_iterator(this, root_->recursive_find(search,false));
     }
 
+    /**
+     * \brief Get iterator to the first element whose key isn't less than \p search
+     * \complexity O(log n)
+     */
+    iterator lower_bound(const Key& search) {
+        return iterator(this, lower_bound_node(search));
+    }
+
+    /**
+     * \brief Get iterator to the first element whose key isn't less than \p search
+     * \complexity O(log n)
+     */
+    const_iterator lower_bound(const Key& search) const {
+        return const_iterator(this, lower_bound_node(search));
+    }
+
+    /**
+     * \brief Get iterator to the first element whose key is greater than \p search
+     * \complexity O(log n)
+     */
+    iterator upper_bound(const Key& search) {
+        return iterator(this, upper_bound_node(search));
+    }
+
+    /**
+     * \brief Get iterator to the first element whose key is greater than \p search
+     * \complexity O(log n)
+     */
+    const_iterator upper_bound(const Key& search) const {
+        return const_iterator(this, upper_bound_node(search));
+    }
+
+    /**
+     * \brief Range of the elements with the given key (at most one)
+     * \complexity O(log n)
+     */
+    std::pair<iterator, iterator> equal_range(const Key& search) {
+        return std::make_pair(lower_bound(search), upper_bound(search));
+    }
+
+    /**
+     * \brief Range of the elements with the given key (at most one)
+     * \complexity O(log n)
+     */
+    std::pair<const_iterator, const_iterator> equal_range(const Key& search) const {
+        return std::make_pair(lower_bound(search), upper_bound(search));
+    }
+
+    /**
+     * \brief Get iterator to the element at \p index in key order, end() if out of range
+     * \pre OrderStatistics is true
+     * \complexity O(log n)
+     */
+    iterator select(int index) {
+        return iterator(this, select_node(index));
+    }
+
+    /**
+     * \brief Get iterator to the element at \p index in key order, end() if out of range
+     * \pre OrderStatistics is true
+     * \complexity O(log n)
+     */
+    const_iterator select(int index) const {
+        return const_iterator(this, select_node(index));
+    }
+
+    /**
+     * \brief Number of elements whose key is less than \p search
+     * \pre OrderStatistics is true
+     * \complexity O(log n)
+     */
+    int rank(const Key& search) const {
+        static_assert(OrderStatistics, "rank() requires OrderStatistics");
+        int rank = 0;
+        for (node_const_pointer node = root_; node; ) {
+            if (Comparator()(node->key, search)) {
+                rank += subtree_size(node->left) + 1;
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+        return rank;
+    }
+
     /**
      * \brief Number of nodes in the tree
      * \complexity O(1)
@@ -440,6 +670,26 @@ public:
         return !root_;
     }
 
+    allocator_type get_allocator() const {
+        return allocator_type(pool_.get_allocator());
+    }
+
+    /**
+     * \brief Number of nodes taken from the pool, in use or free for reuse
+     * \complexity O(1)
+     */
+    std::size_t node_count() const {
+        return pool_.node_count();
+    }
+
+    /**
+     * \brief Number of bytes reserved by the pool blocks
+     * \complexity O(1)
+     */
+    std::size_t bytes_reserved() const {
+        return pool_.bytes_reserved();
+    }
+
 
     template<class Policy, class Func>
         void traverse(const Func& func)
@@ -447,6 +697,143 @@ public:
             Policy::traverse(root_, func);
         }
 
+    /**
+     * \brief Calls \p func(key, value) in key order on the elements
+     * whose key is in [\p low, \p high)
+     *
+     * Only the nodes on the paths to the bounds and the ones in the range
+     * are visited.
+     * \complexity O(log n + k) for k elements in the range
+     */
+    template<class Func>
+        void traverse_range(const Key& low, const Key& high, const Func& func)
+        {
+            for (node_pointer node = lower_bound_node(low);
+                    node && Comparator()(node->key, high); node = node->successor())
+                func(node->key, node->value);
+        }
+
+    /**
+     * \brief Replaces the contents with the items of a sorted range
+     *
+     * Builds a balanced tree directly: the nodes on the last level,
+     * if it isn't full, are red and all the others are black.
+     * \param first, last Range of pairs (key, value) sorted by key,
+     *        for equal keys the last value is kept
+     * \complexity O(n)
+     */
+    template<class Iterator>
+        void assign_sorted(Iterator first, Iterator last) {
+            clear();
+            std::vector<node_pointer> nodes;
+            for (; first != last; ++first) {
+                if (!nodes.empty() && !Comparator()(nodes.back()->key, first->first))
+                    nodes.back()->value = first->second;
+                else
+                    nodes.push_back(pool_.template create<node_type>(first->first, first->second, color_type::BLACK));
+            }
+
+            int full_levels = 0;
+            while ((std::size_t(2) << full_levels) <= nodes.size() + 1)
+                full_levels++;
+            root_ = build_balanced(nodes.data(), nodes.size(), 0, full_levels, nullptr);
+            size_ = nodes.size();
+        }
+
+    /**
+     * \brief Moves the elements whose key isn't less than \p key to the returned tree
+     *
+     * The returned tree has a pool of its own: the nodes on the smaller
+     * side are copied into a new pool, the other ones stay in place. So
+     * iterators to elements on the smaller side are invalidated.
+     * \complexity O(log n + min(k, n-k)) for k elements less than \p key
+     */
+    RedBlackTree split(const Key& key) {
+        RedBlackTree greater(get_allocator());
+        Split parts = split_node(root_, black_height(root_), key);
+        Joined low = {parts.left, parts.left_height};
+        Joined high = {parts.right, parts.right_height};
+        if (parts.found)
+            high = join_nodes(Joined(), parts.found, high);
+        set_root(low);
+        greater.set_root(high);
+        bool low_smaller;
+        int smaller_size = count_smaller(root_, greater.root_, low_smaller);
+        greater.size_ = low_smaller ? size_ - smaller_size : smaller_size;
+        size_ -= greater.size_;
+
+        if (low_smaller) {
+            // The greater tree keeps the blocks, this one starts a new pool
+            pool_.swap(greater.pool_);
+            copy_nodes_from(greater);
+        } else {
+            greater.copy_nodes_from(*this);
+        }
+        return greater;
+    }
+
+    /**
+     * \brief Moves all the elements of \p other at the end of this tree
+     * \pre All the keys of \p other are greater than the keys in this tree
+     * \complexity O(log n + log m), plus O(blocks) to take over the pool of \p other
+     */
+    void join(RedBlackTree&& other) {
+        Joined high = take_nodes(other);
+        int size = size_ + other.size_;
+        other.size_ = 0;
+        set_root(join_pair(Joined{root_, black_height(root_)}, high));
+        size_ = size;
+    }
+
+    /**
+     * \brief Moves the elements of \p other whose key isn't in this tree
+     *        into this tree, \p other is left empty
+     *
+     * Join-based: the other tree is split around the root of this one and
+     * the two sides are combined recursively, the top levels in parallel
+     * on up to \p threads threads. A much smaller \p other is instead
+     * inserted node by node.
+     * \complexity O(m log(n/m + 1)) for sizes m <= n,
+     *             plus O(blocks) to take over the pool of \p other
+     */
+    void unite(RedBlackTree&& other, int threads = 1) {
+        if (other.size_ && size_ / other.size_ >= small_operand_ratio) {
+            node_pointer nodes = take_nodes(other).root;
+            other.size_ = 0;
+            link_nodes(nodes);
+            return;
+        }
+        SetOperation operation(threads);
+        Joined result = operation.unite(Joined{root_, black_height(root_)}, take_nodes(other));
+        finish(operation, other, result, size_ + other.size_ - operation.matches);
+    }
+
+    /**
+     * \brief Keeps only the elements whose key is also in \p other, which is left empty
+     * \complexity O(m log(n/m + 1)) for sizes m <= n, see unite()
+     */
+    void intersect(RedBlackTree&& other, int threads = 1) {
+        SetOperation operation(threads);
+        Joined result = operation.intersect(Joined{root_, black_height(root_)}, take_nodes(other));
+        finish(operation, other, result, operation.matches);
+    }
+
+    /**
+     * \brief Removes the elements whose key is in \p other, which is left empty
+     * \complexity O(m log(n/m + 1)) for sizes m <= n, see unite()
+     */
+    void subtract(RedBlackTree&& other, int threads = 1) {
+        if (other.size_ && size_ / other.size_ >= small_operand_ratio) {
+            for (node_const_pointer node = other.root_->minimum(); node; node = node->successor())
+                erase(node->key);
+            other.clear();
+            return;
+        }
+        SetOperation operation(threads);
+        Joined result = operation.subtract(Joined{root_, black_height(root_)}, take_nodes(other));
+        finish(operation, other, result, size_ - operation.matches);
+    }
+
 protected:
     /**
      * \brief Left rotation
@@ -454,6 +841,13 @@ protected:
      * \complexity O(1)
      */
     void rotate_left(node_pointer node) {
+        rotate_left(node, root_);
+    }
+
+    /**
+     * \brief Left rotation in the tree rooted in \p root
+     */
+    static void rotate_left(node_pointer node, node_pointer& root) {
         // get next root of the subtree currently rooted in node
         node_pointer next_subroot = node->right;
         // change the middle subtree
@@ -463,7 +857,7 @@ protected:
         // fix parent
         next_subroot->parent = node->parent;
         if (!node->parent)
-            root_ = next_subroot;
+            root = next_subroot;
         else if (node->is_left_child())
             node->parent->left = next_subroot;
         else
@@ -471,6 +865,9 @@ protected:
         // set the old root ad left child
         next_subroot->left = node;
         node->parent = next_subroot;
+        // node is now below next_subroot, which has the size node had
+        update_size(node);
+        update_size(next_subroot);
     }
 
     /**
@@ -479,6 +876,13 @@ protected:
      * \complexity O(1)
      */
     void rotate_right (node_pointer node) {
+        rotate_right(node, root_);
+    }
+
+    /**
+     * \brief Right rotation in the tree rooted in \p root
+     */
+    static void rotate_right (node_pointer node, node_pointer& root) {
         // get next root of the subtree currently rooted in node
         node_pointer next_subroot = node->left;
         // change the middle subtree
@@ -488,7 +892,7 @@ protected:
         // fix parent
         next_subroot->parent = node->parent;
         if (!node->parent)
-            root_ = next_subroot;
+            root = next_subroot;
         else if (node->is_left_child())
             node->parent->left = next_subroot;
         else
@@ -496,18 +900,118 @@ protected:
         // set the old root as right child
         next_subroot->right = node;
         node->parent = next_subroot;
+        update_size(node);
+        update_size(next_subroot);
+    }
+
+    static int subtree_size(node_const_pointer node) {
+        return node ? node->subtree_size() : 0;
     }
 
     /**
-     * \brief Recursively deletes a sub-tree
-     * \note Doesn't fix parent pointers
+     * \brief Recomputes the subtree size of \p node from its children
+     * \complexity O(1), no-op unless OrderStatistics
      */
-    void recursive_delete(node_pointer node) {
-        if (node->left)
-            recursive_delete(node->left);
-        if (node->right)
-            recursive_delete(node->right);
-        delete node;
+    static void update_size(node_pointer node) {
+        if (OrderStatistics)
+            node->set_subtree_size(1 + subtree_size(node->left) + subtree_size(node->right));
+    }
+
+    /**
+     * \brief Recomputes the subtree sizes from \p node up to the root
+     * \complexity O(log n), no-op unless OrderStatistics
+     */
+    static void update_sizes_upwards(node_pointer node) {
+        if (OrderStatistics)
+            for (; node; node = node->parent)
+                update_size(node);
+    }
+
+    /**
+     * \brief First node whose key isn't less than \p search, null if none
+     * \complexity O(log n)
+     */
+    node_pointer lower_bound_node(const Key& search) const {
+        node_pointer result = nullptr;
+        for (node_pointer node = root_; node; ) {
+            if (Comparator()(node->key, search)) {
+                node = node->right;
+            } else {
+                result = node;
+                node = node->left;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * \brief First node whose key is greater than \p search, null if none
+     * \complexity O(log n)
+     */
+    node_pointer upper_bound_node(const Key& search) const {
+        node_pointer result = nullptr;
+        for (node_pointer node = root_; node; ) {
+            if (Comparator()(search, node->key)) {
+                result = node;
+                node = node->left;
+            } else {
+                node = node->right;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * \brief Node at \p index in key order, null if out of range
+     * \complexity O(log n)
+     */
+    node_pointer select_node(int index) const {
+        static_assert(OrderStatistics, "select() requires OrderStatistics");
+        node_pointer node = root_;
+        while (node) {
+            int left = subtree_size(node->left);
+            if (index < left) {
+                node = node->left;
+            } else if (index == left) {
+                break;
+            } else {
+                index -= left + 1;
+                node = node->right;
+            }
+        }
+        return node;
+    }
+
+    /**
+     * \brief Deletes a sub-tree
+     *
+     * Rotates the left children up until the node on top has none, then
+     * deletes it and goes on with its right child: no recursion nor stack.
+     * \note Doesn't fix the pointer to \p node in its parent
+     * \complexity O(n)
+     */
+    void delete_subtree(node_pointer node) {
+        while (node) {
+            if (node_pointer left = node->left) {
+                node->left = left->right;
+                left->right = node;
+                node = left;
+            } else {
+                node_pointer right = node->right;
+                pool_.destroy(node);
+                node = right;
+            }
+        }
+    }
+
+    /**
+     * \brief Calls the destructors of all the nodes, unless they are trivial
+     *
+     * The memory itself is released along with the pool blocks.
+     */
+    void destroy_nodes() {
+        if (root_ && !std::is_trivially_destructible<node_type>::value)
+            delete_subtree(root_);
     }
 
     /**
@@ -515,6 +1019,37 @@ protected:
      * \complexity O(log n)
      */
     void insert_fixup(node_pointer node) {
+        this->record_stats([node](RedBlackTreeStats& stats) {
+            int depth = 0;
+            for (node_const_pointer ancestor = node->parent; ancestor; ancestor = ancestor->parent)
+                depth++;
+            stats.insert_depth.record(depth);
+        });
+        int rotations;
+        insert_fixup(node, root_, rotations);
+        this->record_stats([rotations](RedBlackTreeStats& stats) {
+            stats.insert_rotations.record(rotations);
+        });
+    }
+
+    /**
+     * \brief Fix color of a red node whose parent might be red, in the tree rooted in \p root
+     * \return Whether the black height of the tree has grown
+     * \complexity O(log n)
+     */
+    static bool insert_fixup(node_pointer node, node_pointer& root) {
+        int rotations;
+        return insert_fixup(node, root, rotations);
+    }
+
+    /**
+     * \brief Fix color of a red node whose parent might be red, in the tree
+     * rooted in \p root, counting the rotations in \p rotations
+     * \return Whether the black height of the tree has grown
+     * \complexity O(log n)
+     */
+    static bool insert_fixup(node_pointer node, node_pointer& root, int& rotations) {
+        rotations = 0;
         while (node && node->parent && node->parent->color == color_type::RED) {
             if (node->parent->is_left_child()) {
                 node_pointer y = node->parent->parent->right;
@@ -526,11 +1061,13 @@ protected:
                 } else {
                     if (node->is_right_child()) {
                         node = node->parent;
-                        rotate_left(node);
+                        rotate_left(node, root);
+                        rotations++;
                     }
                     node->parent->color = color_type::BLACK;
                     node->parent->parent->color = color_type::RED;
-                    rotate_right(node->parent->parent);
+                    rotate_right(node->parent->parent, root);
+                    rotations++;
                 }
             } else {
                 node_pointer y = node->parent->parent->left;
@@ -542,15 +1079,19 @@ protected:
                 } else {
                     if (node->is_left_child()) {
                         node = node->parent;
-                        rotate_right(node);
+                        rotate_right(node, root);
+                        rotations++;
                     }
                     node->parent->color = color_type::BLACK;
                     node->parent->parent->color = color_type::RED;
-                    rotate_left(node->parent->parent);
+                    rotate_left(node->parent->parent, root);
+                    rotations++;
                 }
             }
         }
-        root_->color = color_type::BLACK;
+        bool grown = root->color == color_type::RED;
+        root->color = color_type::BLACK;
+        return grown;
     }
 
     /**
@@ -559,22 +1100,14 @@ protected:
      * \return Matching node
      */
     node_pointer insert_node(const Key& key, const Value& value, bool assign) {
-        if (!root_)
-            return root_ = new node_type(key,value,color_type::BLACK);
+        if (!root_) {
+            size_ = 1;
+            return root_ = pool_.template create<node_type>(key,value,color_type::BLACK);
+        }
         node_pointer location = root_->recursive_find(key,true);
-        if (Comparator()(key,location->key)) {
-            node_pointer new_node = new node_type(key,value,color_type::RED);
-            location->left = new_node;
-            new_node->parent = location;
-            insert_fixup(new_node);
-            size_++;
-            return new_node;
-        } else if (Comparator()(location->key,key)) {
-            node_pointer new_node = new node_type(key,value,color_type::RED);
-            location->right = new_node;
-            new_node->parent = location;
-            insert_fixup(new_node);
-            size_++;
+        if (Comparator()(key,location->key) || Comparator()(location->key,key)) {
+            node_pointer new_node = pool_.template create<node_type>(key,value,color_type::RED);
+            link_leaf(new_node, location);
             return new_node;
         } else if (assign) {
             // assign already existing node
@@ -584,55 +1117,124 @@ protected:
     }
 
     /**
-     * \brief Fix color caused by node deletion
+     * \brief Attaches the red leaf \p node below \p location and rebalances
+     * \pre \p location is where a search for the key of \p node ends, and
+     *      that key isn't in the tree
      * \complexity O(log n)
      */
-    void erase_fixup(node_pointer node) {
-        while (node != root_ && node->color == color_type::BLACK) {
+    void link_leaf(node_pointer node, node_pointer location) {
+        if (Comparator()(node->key,location->key))
+            location->left = node;
+        else
+            location->right = node;
+        node->parent = location;
+        update_sizes_upwards(location);
+        insert_fixup(node);
+        size_++;
+    }
 
-            node_pointer sib = node->sibling();
-            if (sib && sib->color == color_type::RED) {
-                sib->color = color_type::BLACK;
-                node->parent->color = color_type::RED;
-                if (node->is_left_child())
-                    rotate_left(node->parent);
-                else
-                    rotate_right(node->parent);
-                sib = node->sibling();
+    /**
+     * \brief Moves the nodes of the subtree \p nodes from this pool into the
+     * tree one by one, the ones whose key is already there are destroyed
+     * \complexity O(m log n)
+     */
+    void link_nodes(node_pointer nodes) {
+        std::vector<node_pointer> pending;
+        for (node_pointer node = nodes ? nodes->minimum() : nullptr; node; node = node->successor())
+            pending.push_back(node);
+        for (node_pointer node : pending) {
+            node_pointer location = root_->recursive_find(node->key,true);
+            if (!Comparator()(node->key,location->key) && !Comparator()(location->key,node->key)) {
+                pool_.destroy(node);
+                continue;
             }
-            if (sib->left->color == color_type::BLACK && sib->right->color == color_type::BLACK) {
-                sib->color = color_type::RED;
-                node = node->parent;
-            } else if (node->is_left_child()) {
-                if (sib->right->color == color_type::BLACK) {
-                    sib->left->color = color_type::BLACK;
+            node->left = node->right = nullptr;
+            node->color = color_type::RED;
+            update_size(node);
+            link_leaf(node, location);
+        }
+    }
+
+    /**
+     * \brief Whether \p node is black, null leaves count as black
+     */
+    static bool is_black(node_const_pointer node) {
+        return !node || node->color == color_type::BLACK;
+    }
+
+    /**
+     * \brief Fix color caused by node deletion
+     * \param node   Node which took the place of the removed one, might be null
+     * \param parent Parent of \p node
+     * \complexity O(log n)
+     */
+    void erase_fixup(node_pointer node, node_pointer parent) {
+        int rotations = 0;
+        while (node != root_ && is_black(node)) {
+            if (node == parent->left) {
+                node_pointer sib = parent->right;
+                if (!is_black(sib)) {
+                    sib->color = color_type::BLACK;
+                    parent->color = color_type::RED;
+                    rotate_left(parent);
+                    rotations++;
+                    sib = parent->right;
+                }
+                if (is_black(sib->left) && is_black(sib->right)) {
                     sib->color = color_type::RED;
-                    rotate_right(sib);
-                    sib = node->sibling();
+                    node = parent;
+                    parent = node->parent;
+                } else {
+                    if (is_black(sib->right)) {
+                        sib->left->color = color_type::BLACK;
+                        sib->color = color_type::RED;
+                        rotate_right(sib);
+                        rotations++;
+                        sib = parent->right;
+                    }
+                    sib->color = parent->color;
+                    parent->color = color_type::BLACK;
+                    sib->right->color = color_type::BLACK;
+                    rotate_left(parent);
+                    rotations++;
+                    node = root_;
                 }
-                sib->color = node->parent->color;
-                node->parent->color = color_type::RED;
-                sib->right->color = color_type::BLACK;
-                rotate_left(node->parent);
-                node = root_;
             } else {
                 // same as above, swapping left and right
-                if (sib->left->color == color_type::BLACK) {
-                    sib->right->color = color_type::BLACK;
+                node_pointer sib = parent->left;
+                if (!is_black(sib)) {
+                    sib->color = color_type::BLACK;
+                    parent->color = color_type::RED;
+                    rotate_right(parent);
+                    rotations++;
+                    sib = parent->left;
+                }
+                if (is_black(sib->left) && is_black(sib->right)) {
                     sib->color = color_type::RED;
-                    rotate_left(sib);
-                    sib = node->sibling();
+                    node = parent;
+                    parent = node->parent;
+                } else {
+                    if (is_black(sib->left)) {
+                        sib->right->color = color_type::BLACK;
+                        sib->color = color_type::RED;
+                        rotate_left(sib);
+                        rotations++;
+                        sib = parent->left;
+                    }
+                    sib->color = parent->color;
+                    parent->color = color_type::BLACK;
+                    sib->left->color = color_type::BLACK;
+                    rotate_right(parent);
+                    rotations++;
+                    node = root_;
                 }
-                sib->color = node->parent->color;
-                node->parent->color = color_type::RED;
-                sib->left->color = color_type::BLACK;
-                rotate_right(node->parent);
-                node = root_;
-
             }
-
         }
-        node->color = color_type::BLACK;
+        if (node)
+            node->color = color_type::BLACK;
+        this->record_stats([rotations](RedBlackTreeStats& stats) {
+            stats.erase_rotations.record(rotations);
+        });
     }
 
     /**
@@ -645,6 +1247,9 @@ protected:
         node_pointer y = !node->left || !node->right ? node : node->successor();
         // x is the only child of y (if it has 1 child) null otherwise
         node_pointer x = y->left ? y->left : y->right;
+        // parent of x once y is removed
+        node_pointer x_parent = y->parent == node ? y : y->parent;
+        color_type removed_color = y->color;
 
         if (x)
             x->parent = y->parent;
@@ -673,111 +1278,409 @@ protected:
             if ((y->right = node->right))  {
                 y->right->parent = y;
             }
+            y->color = node->color;
         }
 
-        if (y->color == color_type::BLACK)
-            erase_fixup(x);
+        // The removal shortened the path from x_parent to the root
+        update_sizes_upwards(x_parent);
+
+        if (removed_color == color_type::BLACK)
+            erase_fixup(x, x_parent);
 
         size_--;
         return node;
     }
 
-private:
-    node_pointer root_;
-    int size_;
+    /// Set operations insert or erase node by node when one operand is this many times smaller
+    static const int small_operand_ratio = 16;
 
-    void print_structure_recursive(node_const_pointer node, int depth) const {
-        if (node) {
-            print_structure_recursive(node->left,depth+1);
-            std::string color;
-            std::string nocolor = "\x1b[0m";
-            if (node->color == color_type::RED)
-                color = "\x1b[31m";
-            std::cout << std::string(depth,'.') << " "
-                      << color << "(" << nocolor << node->key << color << ")" << nocolor << " "
-                      << node->value << '\n';
-            print_structure_recursive(node->right,depth+1);
-        } else {
-            std::cout << std::string(depth,'.') << " NULL\n";
+    /**
+     * \brief Detached subtree and its black height
+     *
+     * The black height counts the black nodes on a path from the root to a
+     * null leaf, including the root. The root might be red, otherwise the
+     * subtree is a valid red-black tree.
+     */
+    struct Joined {
+        node_pointer root;
+        int height;
+    };
+
+    /**
+     * \brief Result of split_node(): subtrees with the keys less and greater
+     * than the one splitting them and the node holding that key, if any
+     */
+    struct Split {
+        node_pointer left;
+        int left_height;
+        node_pointer found;
+        node_pointer right;
+        int right_height;
+    };
+
+    static int black_height(node_const_pointer node) {
+        int height = 0;
+        for (; node; node = node->left)
+            height += is_black(node);
+        return height;
+    }
+
+    /**
+     * \brief Number of nodes of the smaller of the trees rooted in \p a and \p b
+     * \param a_smaller Set to whether it's the one rooted in \p a
+     * \complexity O(1) with OrderStatistics, O(log n + min(a, b)) otherwise
+     */
+    static int count_smaller(node_const_pointer a, node_const_pointer b, bool& a_smaller) {
+        if (OrderStatistics) {
+            a_smaller = subtree_size(a) <= subtree_size(b);
+            return a_smaller ? subtree_size(a) : subtree_size(b);
+        }
+        int count = 0;
+        a = a ? a->minimum() : nullptr;
+        b = b ? b->minimum() : nullptr;
+        for (; a && b; count++) {
+            a = a->successor();
+            b = b->successor();
         }
+        a_smaller = !a;
+        return count;
     }
-};
 
-namespace traversal {
+    /**
+     * \brief Detaches the child \p node from its parent
+     */
+    static Joined detach(node_pointer node, int height) {
+        if (node)
+            node->parent = nullptr;
+        return Joined{node, height};
+    }
 
-struct Forward
-{
-    template<class NodePtr>
-        static NodePtr first(NodePtr node)
-        {
-            return node->left;
+    void set_root(Joined tree) {
+        root_ = tree.root;
+        if (root_)
+            root_->color = color_type::BLACK;
+    }
+
+    /**
+     * \brief Links \p count nodes sorted by key into a balanced subtree
+     * \param full_levels Number of levels full of nodes, the nodes below are red
+     * \complexity O(count)
+     */
+    static node_pointer build_balanced(node_pointer* nodes, std::size_t count, int depth,
+                                       int full_levels, node_pointer parent) {
+        if (!count)
+            return nullptr;
+        std::size_t middle = count / 2;
+        node_pointer node = nodes[middle];
+        node->parent = parent;
+        node->color = depth < full_levels ? color_type::BLACK : color_type::RED;
+        node->left = build_balanced(nodes, middle, depth + 1, full_levels, node);
+        node->right = build_balanced(nodes + middle + 1, count - middle - 1, depth + 1, full_levels, node);
+        update_size(node);
+        return node;
+    }
+
+    /**
+     * \brief Joins two subtrees with \p middle between them
+     *
+     * \p middle goes on the spine of the higher subtree, where the black
+     * height matches the other subtree, then insert_fixup() restores the
+     * colors up the spine.
+     * \pre The keys in \p left < \p middle's key < the keys in \p right
+     * \complexity O(difference of the heights)
+     */
+    static Joined join_nodes(Joined left, node_pointer middle, Joined right) {
+        for (Joined* tree : {&left, &right}) {
+            if (tree->root && tree->root->color == color_type::RED) {
+                tree->root->color = color_type::BLACK;
+                tree->height++;
+            }
+        }
+        middle->color = color_type::RED;
+        middle->parent = nullptr;
+
+        if (left.height == right.height) {
+            middle->left = left.root;
+            middle->right = right.root;
+            if (left.root)
+                left.root->parent = middle;
+            if (right.root)
+                right.root->parent = middle;
+            update_size(middle);
+            return Joined{middle, left.height};
         }
 
-    template<class NodePtr>
-        static NodePtr last(NodePtr node)
-        {
-            return node->right;
+        bool right_spine = left.height > right.height;
+        Joined& high = right_spine ? left : right;
+        Joined& low = right_spine ? right : left;
+        node_pointer parent = nullptr;
+        node_pointer node = high.root;
+        for (int height = high.height; !(is_black(node) && height == low.height); ) {
+            height -= is_black(node);
+            parent = node;
+            node = right_spine ? node->right : node->left;
         }
-};
 
-struct Reverse
-{
-    template<class NodePtr>
-        static NodePtr first(NodePtr node)
-        {
-            return node->right;
+        middle->left = right_spine ? node : low.root;
+        middle->right = right_spine ? low.root : node;
+        if (node)
+            node->parent = middle;
+        if (low.root)
+            low.root->parent = middle;
+        middle->parent = parent;
+        if (right_spine)
+            parent->right = middle;
+        else
+            parent->left = middle;
+        update_size(middle);
+        update_sizes_upwards(parent);
+
+        node_pointer root = high.root;
+        bool grown = insert_fixup(middle, root);
+        return Joined{root, high.height + grown};
+    }
+
+    /**
+     * \brief Detaches the last node of \p tree
+     * \return The remaining subtree, the last node is written to \p last
+     * \complexity O(log n)
+     */
+    static Joined split_last(Joined tree, node_pointer& last) {
+        node_pointer node = tree.root;
+        int child_height = tree.height - is_black(node);
+        Joined left = detach(node->left, child_height);
+        if (!node->right) {
+            last = node;
+            return left;
         }
+        Joined rest = split_last(detach(node->right, child_height), last);
+        return join_nodes(left, node, rest);
+    }
 
-    template<class NodePtr>
-        static NodePtr last(NodePtr node)
-        {
-            return node->left;
+    /**
+     * \brief Joins two subtrees
+     * \pre The keys in \p left < the keys in \p right
+     * \complexity O(log n)
+     */
+    static Joined join_pair(Joined left, Joined right) {
+        if (!left.root)
+            return right;
+        if (!right.root)
+            return left;
+        node_pointer last;
+        Joined rest = split_last(left, last);
+        return join_nodes(rest, last, right);
+    }
+
+    /**
+     * \brief Splits the subtree rooted in \p node around \p key
+     * \param height Black height of \p node
+     * \complexity O(log n)
+     */
+    static Split split_node(node_pointer node, int height, const Key& key) {
+        if (!node)
+            return Split{nullptr, 0, nullptr, nullptr, 0};
+        int child_height = height - is_black(node);
+        Joined left = detach(node->left, child_height);
+        Joined right = detach(node->right, child_height);
+        if (Comparator()(key, node->key)) {
+            Split parts = split_node(left.root, child_height, key);
+            Joined high = join_nodes(Joined{parts.right, parts.right_height}, node, right);
+            parts.right = high.root;
+            parts.right_height = high.height;
+            return parts;
+        } else if (Comparator()(node->key, key)) {
+            Split parts = split_node(right.root, child_height, key);
+            Joined low = join_nodes(left, node, Joined{parts.left, parts.left_height});
+            parts.left = low.root;
+            parts.left_height = low.height;
+            return parts;
         }
-};
+        node->left = node->right = nullptr;
+        return Split{left.root, left.height, node, right.root, right.height};
+    }
 
-template<class Direction = Forward>
-    struct InOrder
-{
-    template<class NodePtr, class Func>
-        static void traverse(NodePtr node, const Func& func)
-        {
-            if ( !node )
-                return;
-            traverse(Direction::first(node), func);
-            func(node->key, node->value);
-            traverse(Direction::last(node), func);
+    /**
+     * \brief Takes the nodes of \p other along with the blocks of its pool
+     * \return The root of \p other and its black height, \p other is left without nodes
+     * \complexity O(log m + blocks of \p other)
+     */
+    Joined take_nodes(RedBlackTree& other) {
+        pool_.merge(other.pool_);
+        Joined taken = Joined{other.root_, black_height(other.root_)};
+        other.root_ = nullptr;
+        return taken;
+    }
+
+    /**
+     * \brief Replaces the nodes of this tree with copies from its own pool
+     *
+     * The nodes are destroyed in the pool of \p owner, which holds them.
+     * \complexity O(n)
+     */
+    void copy_nodes_from(RedBlackTree& owner) {
+        if (!root_)
+            return;
+        node_pointer nodes = root_;
+        root_ = nodes->deep_copy(pool_);
+        owner.delete_subtree(nodes);
+    }
+
+    /**
+     * \brief Join-based union, intersection and difference of subtrees
+     *
+     * The nodes are relinked, not copied. The ones left out are collected
+     * and only destroyed at the end, as the pool isn't thread-safe.
+     */
+    struct SetOperation {
+        explicit SetOperation(int threads) : threads(threads) {}
+
+        Joined unite(Joined a, Joined b) {
+            if (!a.root)
+                return b;
+            if (!b.root)
+                return a;
+            node_pointer node = a.root;
+            int child_height = a.height - is_black(node);
+            Joined a_left = detach(node->left, child_height);
+            Joined a_right = detach(node->right, child_height);
+            Split parts = split_node(b.root, b.height, node->key);
+            if (parts.found)
+                discard(parts.found);
+
+            Joined left, right;
+            fork(a.height, [&](SetOperation& operation) {
+                left = operation.unite(a_left, Joined{parts.left, parts.left_height});
+            }, [&](SetOperation& operation) {
+                right = operation.unite(a_right, Joined{parts.right, parts.right_height});
+            });
+            return join_nodes(left, node, right);
         }
-};
 
-template<class Direction = Forward>
-    struct PreOrder
-{
-    template<class NodePtr, class Func>
-        static void traverse(NodePtr node, const Func& func)
-        {
-            if ( !node )
-                return;
-            func(node->key, node->value);
-            traverse(Direction::first(node), func);
-            traverse(Direction::last(node), func);
+        Joined intersect(Joined a, Joined b) {
+            if (!a.root || !b.root) {
+                if (a.root)
+                    garbage.push_back(a.root);
+                if (b.root)
+                    garbage.push_back(b.root);
+                return Joined();
+            }
+            node_pointer node = a.root;
+            int child_height = a.height - is_black(node);
+            Joined a_left = detach(node->left, child_height);
+            Joined a_right = detach(node->right, child_height);
+            Split parts = split_node(b.root, b.height, node->key);
+
+            Joined left, right;
+            fork(a.height, [&](SetOperation& operation) {
+                left = operation.intersect(a_left, Joined{parts.left, parts.left_height});
+            }, [&](SetOperation& operation) {
+                right = operation.intersect(a_right, Joined{parts.right, parts.right_height});
+            });
+            node->left = node->right = nullptr;
+            if (parts.found) {
+                discard(parts.found);
+                return join_nodes(left, node, right);
+            }
+            garbage.push_back(node);
+            return join_pair(left, right);
         }
-};
 
-template<class Direction = Forward>
-    struct PostOrder
-{
-    template<class NodePtr, class Func>
-        static void traverse(NodePtr node, const Func& func)
-        {
-            if ( !node )
-                return;
-            traverse(Direction::first(node), func);
-            traverse(Direction::last(node), func);
-            func(node->key, node->value);
+        Joined subtract(Joined a, Joined b) {
+            if (!a.root || !b.root) {
+                if (b.root)
+                    garbage.push_back(b.root);
+                return a;
+            }
+            node_pointer node = b.root;
+            int child_height = b.height - is_black(node);
+            Joined b_left = detach(node->left, child_height);
+            Joined b_right = detach(node->right, child_height);
+            node->left = node->right = nullptr;
+            garbage.push_back(node);
+            Split parts = split_node(a.root, a.height, node->key);
+            if (parts.found)
+                discard(parts.found);
+
+            Joined left, right;
+            fork(b.height, [&](SetOperation& operation) {
+                left = operation.subtract(Joined{parts.left, parts.left_height}, b_left);
+            }, [&](SetOperation& operation) {
+                right = operation.subtract(Joined{parts.right, parts.right_height}, b_right);
+            });
+            return join_pair(left, right);
         }
-};
 
+        /**
+         * \brief Runs \p first and \p second, in parallel if there are
+         * threads to spare and the subtrees are large enough
+         */
+        template<class First, class Second>
+            void fork(int height, const First& first, const Second& second) {
+                if (threads < 2 || height < min_parallel_height) {
+                    first(*this);
+                    second(*this);
+                    return;
+                }
+                SetOperation other(threads / 2);
+                threads -= other.threads;
+                std::thread thread([&first, &other]() { first(other); });
+                second(*this);
+                thread.join();
+                threads += other.threads;
+                matches += other.matches;
+                garbage.insert(garbage.end(), other.garbage.begin(), other.garbage.end());
+            }
+
+        /**
+         * \brief Collects a node whose key is in both operands
+         */
+        void discard(node_pointer node) {
+            matches++;
+            garbage.push_back(node);
+        }
+
+        /// Subtrees below this black height, about 2^10 nodes or less, aren't worth a thread
+        static const int min_parallel_height = 10;
+
+        int threads;
+        /// Number of keys found in both operands
+        int matches = 0;
+        /// Roots of the subtrees to destroy
+        std::vector<node_pointer> garbage;
+    };
+
+    /**
+     * \brief Installs the result of a set operation and destroys the nodes left out
+     */
+    void finish(SetOperation& operation, RedBlackTree& other, Joined result, int size) {
+        for (node_pointer node : operation.garbage)
+            delete_subtree(node);
+        set_root(result);
+        size_ = size;
+        other.size_ = 0;
+    }
+
+private:
+    node_pointer root_;
+    int size_;
+    pool_type pool_;
 
-} // namespace traversal
+    void print_structure_recursive(node_const_pointer node, int depth) const {
+        if (node) {
+            print_structure_recursive(node->left,depth+1);
+            std::string color;
+            std::string nocolor = "\x1b[0m";
+            if (node->color == color_type::RED)
+                color = "\x1b[31m";
+            std::cout << std::string(depth,'.') << " "
+                      << color << "(" << nocolor << node->key << color << ")" << nocolor << " "
+                      << node->value << '\n';
+            print_structure_recursive(node->right,depth+1);
+        } else {
+            std::cout << std::string(depth,'.') << " NULL\n";
+        }
+    }
+};
 
 #endif // RED_BLACK_TREE_HPP
@@ -23,12 +23,165 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "regex.hpp"
 
+#include <algorithm>
+
 #include "re_ast.hpp"
+#include "re_cache.hpp"
+#include "re_dfa.hpp"
+#include "re_literal.hpp"
 #include "re_nfa.hpp"
 #include "re_parser.hpp"
 
 using namespace regex;
 
+Pattern::Pattern(const std::string& expression, std::shared_ptr<Parser> parser)
+    : expression_(expression) {
+    if (!parser)
+        parser = std::make_shared<SimpleParser>();
+    auto literals = std::make_shared<Literals>();
+    program_ = std::make_shared<nfa::Program>(parser->compile_program(expression, literals.get()));
+    literals_ = literals;
+}
+
+const std::string& Pattern::expression() const {
+    return expression_;
+}
+
+const nfa::Program& Pattern::program() const {
+    return *program_;
+}
+
+const Literals& Pattern::literals() const {
+    return *literals_;
+}
+
+MatchContext::MatchContext(std::shared_ptr<const Pattern> pattern)
+    : pattern_(pattern) {}
+
+bool MatchContext::full_match(const std::string &string) {
+    const Literals& literals = pattern_->literals();
+    if (!literals.may_full_match(string.data(), string.size()))
+        return false;
+    // The input has been compared with the only string the pattern matches
+    if (literals.exact)
+        return true;
+
+    if (!deterministic_) {
+        deterministic_ = std::make_shared<dfa::LazyDfa>(pattern_->program());
+        runner_ = std::make_shared<nfa::NfaRunner>(pattern_->program());
+    }
+
+    int state = deterministic_->start();
+    for (std::size_t i = 0; i < string.size(); i++) {
+        int next = deterministic_->next(state, string[i]);
+        if (next == dfa::LazyDfa::dead)
+            return false;
+
+        if (next == dfa::LazyDfa::full) {
+            // Too many states, go on with the NFA from where the DFA stopped
+            runner_->set_state(deterministic_->nfa_states(state));
+            for (; i < string.size(); i++) {
+                if (runner_->state().empty())
+                    return false;
+                runner_->step(string[i]);
+            }
+            return runner_->acceptable();
+        }
+
+        state = next;
+    }
+    return deterministic_->accepting(state);
+}
+
+bool MatchContext::search(const std::string &string, Match* match) {
+    if (!pattern_->literals().may_contain_match(string.data(), string.size()))
+        return false;
+
+    if (!scanner_)
+        scanner_ = std::make_shared<nfa::Scanner>(pattern_->program(), pattern_->literals().prefix);
+
+    // Reads in blocks to stop soon after the first match
+    const std::size_t block = 4096;
+    std::vector<Match> matches;
+    scanner_->reset();
+    for (std::size_t i = 0; i < string.size() && matches.empty(); i += block)
+        scanner_->feed(string.data() + i, std::min(block, string.size() - i), matches);
+    if (matches.empty())
+        scanner_->finish(matches);
+
+    if (matches.empty())
+        return false;
+    if (match)
+        *match = matches.front();
+    return true;
+}
+
+std::vector<Match> MatchContext::find_all(const std::string &string) {
+    std::vector<Match> matches;
+    if (!pattern_->literals().may_contain_match(string.data(), string.size()))
+        return matches;
+
+    if (!scanner_)
+        scanner_ = std::make_shared<nfa::Scanner>(pattern_->program(), pattern_->literals().prefix);
+
+    scanner_->reset();
+    scanner_->feed(string, matches);
+    scanner_->finish(matches);
+    return matches;
+}
+
+const std::shared_ptr<const Pattern>& MatchContext::pattern() const {
+    return pattern_;
+}
+
+MatchStats MatchContext::stats() const {
+    MatchStats stats;
+    if (deterministic_) {
+        stats.merge(deterministic_->stats());
+        stats.merge(runner_->stats());
+    }
+    if (scanner_)
+        stats.merge(scanner_->stats());
+    return stats;
+}
+
+void MatchContext::reset_stats() {
+    if (deterministic_) {
+        deterministic_->reset_stats();
+        runner_->reset_stats();
+    }
+    if (scanner_)
+        scanner_->reset_stats();
+}
+
+Matcher::Matcher(std::shared_ptr<const Pattern> pattern)
+    : pattern_(pattern),
+      scanner_(std::make_shared<nfa::Scanner>(pattern->program(), pattern->literals().prefix)) {}
+
+void Matcher::feed(const char* data, std::size_t size, std::vector<Match>& matches) {
+    scanner_->feed(data, size, matches);
+}
+
+void Matcher::feed(const std::string& chunk, std::vector<Match>& matches) {
+    scanner_->feed(chunk, matches);
+}
+
+void Matcher::finish(std::vector<Match>& matches) {
+    scanner_->finish(matches);
+}
+
+void Matcher::reset() {
+    scanner_->reset();
+}
+
+MatchStats Matcher::stats() const {
+    return scanner_->stats();
+}
+
+void Matcher::reset_stats() {
+    scanner_->reset_stats();
+}
+
 RegEx::RegEx(const std::string &expression, std::shared_ptr<Parser> parser)
         : parser_(parser ? parser : std::shared_ptr<Parser> {new SimpleParser}){
     set_expression(expression);
@@ -37,17 +190,34 @@ RegEx::RegEx(const std::string &expression, std::shared_ptr<Parser> parser)
 bool RegEx::full_match(const std::string &string) {
     if (!compiled_)
         compile();
-    nfa::NfaRunner run(*compiled_);
-    for (char c : string) {
-        if (run.state().empty())
-            return false;
-        run.step(c);
-    }
-    return run.acceptable();
+    return context_->full_match(string);
+}
+
+bool RegEx::search(const std::string &string, Match* match) {
+    if (!compiled_)
+        compile();
+    return context_->search(string, match);
+}
+
+std::vector<Match> RegEx::find_all(const std::string &string) {
+    if (!compiled_)
+        compile();
+    return context_->find_all(string);
+}
+
+Matcher RegEx::matcher() {
+    return Matcher(pattern());
+}
+
+std::shared_ptr<const Pattern> RegEx::pattern() {
+    if (!compiled_)
+        compile();
+    return compiled_;
 }
 
 void RegEx::set_expression(const std::string &expression) {
     expression_ = expression;
+    context_.reset();
     compiled_.reset();
 }
 
@@ -55,10 +225,151 @@ std::string RegEx::expression() const {
     return expression_;
 }
 
-nfa::NFA* RegEx::compiled() const {
-    return  new nfa::NFA(std::move(parser_->compile(expression_)));
+MatchStats RegEx::stats() const {
+    return context_ ? context_->stats() : MatchStats();
+}
+
+Pattern* RegEx::compiled() const {
+    return new Pattern(expression_, parser_);
 }
 
 void RegEx::compile() {
-    compiled_.reset(compiled());
+    compiled_ = PatternCache::global().get(expression_, parser_);
+    context_ = std::make_shared<MatchContext>(compiled_);
+}
+
+
+/**
+ * \brief Program with its lazy DFA and a runner for when the DFA is full
+ */
+struct RegexSet::Automaton {
+    explicit Automaton(const nfa::ProgramBuilder& builder)
+        : program(builder), deterministic(program), runner(program) {}
+
+    /**
+     * \brief Collects the match ids of the states reached through \p string
+     * \param any Whether to collect the ids of all the states along the way,
+     *            rather than only the final one
+     */
+    std::vector<int> run(const std::string& string, int size, bool any) {
+        std::vector<int> ids;
+        std::vector<bool> found(size, false);
+        auto collect = [&ids, &found](const std::vector<int>& matches) {
+            for (int id : matches) {
+                if (!found[id]) {
+                    found[id] = true;
+                    ids.push_back(id);
+                }
+            }
+        };
+
+        std::vector<int> matches;
+        int state = deterministic.start();
+        if (any)
+            collect(deterministic.matches(state));
+        for (std::size_t i = 0; i < string.size() && int(ids.size()) < size; i++) {
+            int next = deterministic.next(state, string[i]);
+            if (next == dfa::LazyDfa::dead) {
+                state = next;
+                break;
+            }
+
+            if (next == dfa::LazyDfa::full) {
+                runner.set_state(deterministic.nfa_states(state));
+                for (; i < string.size() && !runner.state().empty(); i++) {
+                    runner.step(string[i]);
+                    if (any) {
+                        matches.clear();
+                        runner.matches(matches);
+                        collect(matches);
+                    }
+                }
+                if (!any) {
+                    runner.matches(matches);
+                    collect(matches);
+                }
+                std::sort(ids.begin(), ids.end());
+                return ids;
+            }
+
+            state = next;
+            if (any)
+                collect(deterministic.matches(state));
+        }
+
+        if (!any && state != dfa::LazyDfa::dead)
+            collect(deterministic.matches(state));
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    MatchStats stats() const {
+        MatchStats stats = deterministic.stats();
+        stats.merge(runner.stats());
+        return stats;
+    }
+
+    nfa::Program program;
+    dfa::LazyDfa deterministic;
+    nfa::NfaRunner runner;
+};
+
+RegexSet::RegexSet(const std::vector<std::string>& expressions, std::shared_ptr<Parser> parser)
+    : expressions_(expressions),
+      parser_(parser ? parser : std::shared_ptr<Parser> {new SimpleParser}) {}
+
+int RegexSet::add(const std::string& expression) {
+    expressions_.push_back(expression);
+    anchored_.reset();
+    unanchored_.reset();
+    return expressions_.size() - 1;
+}
+
+int RegexSet::size() const {
+    return expressions_.size();
+}
+
+std::string RegexSet::expression(int index) const {
+    return expressions_[index];
+}
+
+std::vector<int> RegexSet::full_match(const std::string &string) {
+    if (!anchored_)
+        compile();
+    return anchored_->run(string, size(), false);
+}
+
+std::vector<int> RegexSet::search(const std::string &string) {
+    if (!unanchored_)
+        compile();
+    return unanchored_->run(string, size(), true);
+}
+
+MatchStats RegexSet::stats() const {
+    MatchStats stats;
+    if (anchored_)
+        stats.merge(anchored_->stats());
+    if (unanchored_)
+        stats.merge(unanchored_->stats());
+    return stats;
+}
+
+void RegexSet::compile() {
+    // The union of all the expressions, each keeping its own output state
+    nfa::ProgramBuilder builder;
+    int anchor = builder.add_state();
+    builder.set_input(anchor);
+    for (std::size_t i = 0; i < expressions_.size(); i++) {
+        nfa::ProgramBuilder::Fragment compiled = parser_->compile_into(expressions_[i], builder);
+        builder.add_transition(anchor, compiled.input);
+        builder.set_match_id(compiled.output, i);
+    }
+    anchored_ = std::make_shared<Automaton>(builder);
+
+    // Prepend a loop accepting any character, equivalent to /.*(a|b|...)/
+    int loop = builder.add_state();
+    builder.set_input(loop);
+    builder.add_transition(loop, loop, nfa::ByteSet::all());
+    builder.add_transition(loop, anchor);
+    unanchored_ = std::make_shared<Automaton>(builder);
 }
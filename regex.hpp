@@ -26,42 +26,277 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <memory>
 #include <string>
+#include <vector>
+
+#include "re_match.hpp"
 
 /**
  * \brief Namespace for stuff regarding regular expressions
  */
 namespace regex {
 
-namespace nfa { class NFA; }
+namespace nfa { class Program; class NfaRunner; class Scanner; }
+namespace dfa { class LazyDfa; }
 class Parser;
+struct Literals;
+
+/**
+ * \brief Compiled regular expression
+ *
+ * It's immutable, so it can be shared and used by any number of threads at
+ * once, each with its own MatchContext.
+ */
+class Pattern {
+public:
+    explicit Pattern(const std::string& expression, std::shared_ptr<Parser> parser = nullptr);
+
+    const std::string& expression() const;
+
+    /**
+     * \brief Automaton ready to be executed
+     */
+    const nfa::Program& program() const;
+
+    /**
+     * \brief Literals found in every match
+     */
+    const Literals& literals() const;
+
+private:
+    std::string expression_;
+    std::shared_ptr<const nfa::Program> program_;
+    std::shared_ptr<const Literals> literals_;
+};
+
+/**
+ * \brief Scratch state needed to match a Pattern
+ *
+ * Holds the runner buffers and the lazy DFA cache, which are only created
+ * when needed. A context must not be used by multiple threads at once,
+ * create one per thread sharing the same Pattern instead.
+ */
+class MatchContext {
+public:
+    explicit MatchContext(std::shared_ptr<const Pattern> pattern);
+
+    /**
+     * \brief Checks if the entire string matches the regular expression
+     *
+     * The input is first checked for the literals the expression requires,
+     * then it runs on the lazy DFA, falling back to the NFA when the DFA
+     * reaches its state limit.
+     */
+    bool full_match(const std::string &string);
+
+    /**
+     * \brief Finds the leftmost-longest match in \p string
+     * \param match If not null, it's set to the location of the match
+     * \return Whether a match has been found
+     */
+    bool search(const std::string &string, Match* match = nullptr);
+
+    /**
+     * \brief Finds all the non-overlapping matches in \p string
+     * \complexity O(string.size() * m) for a program of m states, the input
+     * after the end of a match is read again at most once per state
+     * \see nfa::Scanner
+     */
+    std::vector<Match> find_all(const std::string &string);
+
+    const std::shared_ptr<const Pattern>& pattern() const;
+
+    /**
+     * \brief Work done by the automata of this context, empty unless the
+     * library is built with REGEX_STATS
+     */
+    MatchStats stats() const;
+
+    void reset_stats();
+
+private:
+    std::shared_ptr<const Pattern> pattern_;
+    std::shared_ptr<dfa::LazyDfa> deterministic_;
+    /// Used when the DFA runs out of states
+    std::shared_ptr<nfa::NfaRunner> runner_;
+    std::shared_ptr<nfa::Scanner> scanner_;
+};
+
+/**
+ * \brief Searches a regular expression in input fed in chunks
+ *
+ * Match offsets are relative to the start of the whole input, chunks
+ * don't need to be aligned to lines or matches.
+ * \note The input following a match is buffered for as long as a longer
+ *       match is possible, which has no bound: "a|a.*z" keeps the rest of
+ *       the stream until it finds a "z" or the stream ends
+ * \see nfa::Scanner
+ */
+class Matcher {
+public:
+    explicit Matcher(std::shared_ptr<const Pattern> pattern);
+
+    /**
+     * \brief Reads the next chunk of input
+     * \param matches Matches completed within the chunk are appended here
+     */
+    void feed(const char* data, std::size_t size, std::vector<Match>& matches);
+
+    /**
+     * \brief Reads the next chunk of input
+     * \param matches Matches completed within the chunk are appended here
+     */
+    void feed(const std::string& chunk, std::vector<Match>& matches);
+
+    /**
+     * \brief Marks the end of the input, reporting the pending matches
+     */
+    void finish(std::vector<Match>& matches);
+
+    /**
+     * \brief Goes back to the start of the input
+     */
+    void reset();
 
+    /**
+     * \brief Work done by the automaton, empty unless the library is built
+     * with REGEX_STATS
+     * \note Kept across reset()
+     */
+    MatchStats stats() const;
+
+    void reset_stats();
+
+private:
+    std::shared_ptr<const Pattern> pattern_;
+    std::shared_ptr<nfa::Scanner> scanner_;
+};
+
+/**
+ * \brief Regular expression, compiled on first use
+ *
+ * Compiled patterns are looked up in PatternCache::global() first, so
+ * objects with the same expression and parser type share them.
+ *
+ * Not thread-safe, to match from multiple threads share pattern() and give
+ * each thread its own MatchContext.
+ */
 class RegEx {
 public:
     explicit RegEx(const std::string& expression, std::shared_ptr<Parser> parser = nullptr);
 
     /**
      * \brief Checks if the entire string matches the regular expression
+     * \see MatchContext::full_match
      */
     bool full_match(const std::string &string);
 
+    /**
+     * \brief Finds the leftmost-longest match in \p string
+     * \see MatchContext::search
+     */
+    bool search(const std::string &string, Match* match = nullptr);
+
+    /**
+     * \brief Finds all the non-overlapping matches in \p string
+     * \see MatchContext::find_all
+     */
+    std::vector<Match> find_all(const std::string &string);
+
+    /**
+     * \brief Creates an object to search input which is fed in chunks
+     */
+    Matcher matcher();
+
+    /**
+     * \brief Compiled expression
+     */
+    std::shared_ptr<const Pattern> pattern();
+
     void set_expression(const std::string& expression);
     std::string expression() const;
 
+    /**
+     * \brief Work done matching the current expression
+     * \see MatchContext::stats
+     */
+    MatchStats stats() const;
+
 protected:
     /**
-     * \brief Compiles the regular expression
+     * \brief Compiles the regular expression (bypassing the cache)
      * \return A pointer with the compiled expression
      */
-    nfa::NFA *compiled() const;
+    Pattern *compiled() const;
     /**
-     * \brief Compiles the regular expression and stores the result
+     * \brief Retrieves the compiled expression from the cache and stores it
      */
     void compile();
 
 private:
     std::string expression_;
-    std::shared_ptr<nfa::NFA> compiled_;
+    std::shared_ptr<const Pattern> compiled_;
+    std::shared_ptr<MatchContext> context_;
+    std::shared_ptr<Parser> parser_;
+};
+
+/**
+ * \brief Collection of regular expressions compiled into a single automaton
+ *
+ * Each expression is identified by its index, a single pass over the input
+ * finds all the expressions matching it.
+ */
+class RegexSet {
+public:
+    explicit RegexSet(const std::vector<std::string>& expressions = {},
+                      std::shared_ptr<Parser> parser = nullptr);
+
+    /**
+     * \brief Appends an expression
+     * \return The index of the new expression
+     */
+    int add(const std::string& expression);
+
+    /**
+     * \brief Number of expressions
+     */
+    int size() const;
+
+    /**
+     * \brief Expression with the given index
+     */
+    std::string expression(int index) const;
+
+    /**
+     * \brief Returns the sorted indices of the expressions matching the entire string
+     */
+    std::vector<int> full_match(const std::string &string);
+
+    /**
+     * \brief Returns the sorted indices of the expressions matching
+     * somewhere in the string
+     */
+    std::vector<int> search(const std::string &string);
+
+    /**
+     * \brief Work done by the automata of the set, empty unless the
+     * library is built with REGEX_STATS
+     */
+    MatchStats stats() const;
+
+private:
+    struct Automaton;
+
+    /**
+     * \brief Compiles all the expressions
+     */
+    void compile();
+
+    std::vector<std::string> expressions_;
     std::shared_ptr<Parser> parser_;
+    /// Matches from the start of the input
+    std::shared_ptr<Automaton> anchored_;
+    /// Matches from any position of the input
+    std::shared_ptr<Automaton> unanchored_;
 };
 
 } // namespace regex
@@ -0,0 +1,194 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+/**
+ * \brief Distribution of non-negative counts in power of two buckets
+ *
+ * Bucket 0 holds the zeroes and bucket \c i the values in [2^(i-1), 2^i),
+ * recording is a few additions however large the values get.
+ */
+class Histogram {
+public:
+    static const int bucket_count = 65;
+
+    /**
+     * \complexity O(1)
+     */
+    void record(std::uint64_t value) {
+        buckets_[bucket_of(value)]++;
+        count_++;
+        sum_ += value;
+        max_ = std::max(max_, value);
+    }
+
+    /**
+     * \brief Adds the values recorded by \p other
+     * \complexity O(bucket_count)
+     */
+    void merge(const Histogram& other) {
+        for (int i = 0; i < bucket_count; i++)
+            buckets_[i] += other.buckets_[i];
+        count_ += other.count_;
+        sum_ += other.sum_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    /**
+     * \brief Number of recorded values
+     */
+    std::uint64_t count() const {
+        return count_;
+    }
+
+    std::uint64_t sum() const {
+        return sum_;
+    }
+
+    std::uint64_t max() const {
+        return max_;
+    }
+
+    /**
+     * \brief Average of the recorded values, 0 if there are none
+     */
+    double mean() const {
+        return count_ ? double(sum_) / count_ : 0;
+    }
+
+    /**
+     * \brief Number of values recorded in the bucket \p index
+     */
+    std::uint64_t bucket(int index) const {
+        return buckets_[index];
+    }
+
+    /**
+     * \brief Smallest value counted by the bucket \p index
+     */
+    static std::uint64_t bucket_floor(int index) {
+        return index ? std::uint64_t(1) << (index - 1) : 0;
+    }
+
+    /**
+     * \brief Largest value counted by the bucket \p index
+     */
+    static std::uint64_t bucket_ceiling(int index) {
+        return index == bucket_count - 1 ? UINT64_MAX : (std::uint64_t(1) << index) - 1;
+    }
+
+    /**
+     * \brief Value which at least \p fraction of the recorded values don't exceed
+     * \return The ceiling of the bucket where the fraction is reached, at most max()
+     * \complexity O(bucket_count)
+     */
+    std::uint64_t percentile(double fraction) const {
+        std::uint64_t rank = std::uint64_t(fraction * count_);
+        std::uint64_t seen = 0;
+        for (int i = 0; i < bucket_count; i++) {
+            seen += buckets_[i];
+            if (seen && seen >= rank)
+                return std::min(bucket_ceiling(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    static int bucket_of(std::uint64_t value) {
+        if (!value)
+            return 0;
+#ifdef __GNUC__
+        return 64 - __builtin_clzll(value);
+#else
+        int bits = 0;
+        for (; value; value >>= 1)
+            bits++;
+        return bits;
+#endif
+    }
+
+    std::uint64_t buckets_[bucket_count] = {};
+    std::uint64_t count_ = 0;
+    std::uint64_t sum_ = 0;
+    std::uint64_t max_ = 0;
+};
+
+/**
+ * \brief Statistics of type \p Stats kept by a container when \p Enabled
+ *
+ * Containers derive from it and record through record_stats(), whose
+ * function is only called when enabled. Disabled, the base is empty and
+ * the calls, with whatever their functions compute, compile to nothing.
+ *
+ * Statistics describe the operations done on an object: copies and moved-to
+ * objects start with empty ones, assignments keep their own.
+ * \note Lookups record too, so enabled statistics make concurrent reads
+ *       of a container a data race
+ */
+template<class Stats, bool Enabled>
+class StatsRecorder {
+public:
+    typedef Stats stats_type;
+
+    /**
+     * \brief Statistics recorded so far, always empty when disabled
+     */
+    Stats stats() const {
+        return Stats();
+    }
+
+    void reset_stats() {}
+
+protected:
+    template<class Func>
+        void record_stats(const Func&) const {}
+
+    void swap_stats(StatsRecorder&) {}
+};
+
+template<class Stats>
+class StatsRecorder<Stats, true> {
+public:
+    typedef Stats stats_type;
+
+    StatsRecorder() = default;
+
+    StatsRecorder(const StatsRecorder&) {}
+
+    StatsRecorder& operator=(const StatsRecorder&) {
+        return *this;
+    }
+
+    const Stats& stats() const {
+        return stats_;
+    }
+
+    void reset_stats() {
+        stats_ = Stats();
+    }
+
+protected:
+    /**
+     * \brief Calls \p func on the statistics to update them
+     */
+    template<class Func>
+        void record_stats(const Func& func) const {
+            func(stats_);
+        }
+
+    /**
+     * \brief Exchanges the statistics, for those describing the contents
+     * of the container rather than its operations
+     */
+    void swap_stats(StatsRecorder& other) {
+        std::swap(stats_, other.stats_);
+    }
+
+private:
+    mutable Stats stats_;
+};
+
+#endif // STATS_HPP
@@ -0,0 +1,189 @@
+#ifndef TRAVERSAL_HPP
+#define TRAVERSAL_HPP
+
+/**
+\file
+
+\author Mattia Basaglia
+
+\section License
+
+Copyright (C) 2014-2016  Mattia Basaglia
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/**
+ * \brief Traversal policies for RedBlackTree::traverse() and BPlusTree::traverse()
+ *
+ * The policies walk binary nodes with \c key, \c value, \c left, \c right
+ * and \c parent members, BPlusTree only uses the Direction they are
+ * instantiated with. They follow the parent pointers back up instead of
+ * recursing, so they need neither stack nor extra memory, and the
+ * subtree they are given is the only part of the tree they visit.
+ */
+namespace traversal {
+
+struct Forward
+{
+    template<class NodePtr>
+        static NodePtr first(NodePtr node)
+        {
+            return node->left;
+        }
+
+    template<class NodePtr>
+        static NodePtr last(NodePtr node)
+        {
+            return node->right;
+        }
+};
+
+struct Reverse
+{
+    template<class NodePtr>
+        static NodePtr first(NodePtr node)
+        {
+            return node->right;
+        }
+
+    template<class NodePtr>
+        static NodePtr last(NodePtr node)
+        {
+            return node->left;
+        }
+};
+
+template<class Direction = Forward>
+    struct InOrder
+{
+    template<class NodePtr, class Func>
+        static void traverse(NodePtr node, const Func& func)
+        {
+            if ( !node )
+                return;
+            NodePtr stop = node->parent;
+            node = first_leaf(node);
+            while ( node != stop )
+            {
+                func(node->key, node->value);
+                if ( Direction::last(node) )
+                {
+                    node = first_leaf(Direction::last(node));
+                }
+                else
+                {
+                    // climb up to the first ancestor reached from its first child
+                    NodePtr child;
+                    do {
+                        child = node;
+                        node = node->parent;
+                    } while ( node != stop && Direction::last(node) == child );
+                }
+            }
+        }
+
+private:
+    template<class NodePtr>
+        static NodePtr first_leaf(NodePtr node)
+        {
+            while ( Direction::first(node) )
+                node = Direction::first(node);
+            return node;
+        }
+};
+
+template<class Direction = Forward>
+    struct PreOrder
+{
+    template<class NodePtr, class Func>
+        static void traverse(NodePtr node, const Func& func)
+        {
+            if ( !node )
+                return;
+            NodePtr stop = node->parent;
+            while ( node )
+            {
+                func(node->key, node->value);
+                if ( Direction::first(node) )
+                {
+                    node = Direction::first(node);
+                }
+                else if ( Direction::last(node) )
+                {
+                    node = Direction::last(node);
+                }
+                else
+                {
+                    // climb up to the first ancestor with a last child not visited yet
+                    NodePtr child = node;
+                    node = node->parent;
+                    while ( node != stop && (!Direction::last(node) || Direction::last(node) == child) )
+                    {
+                        child = node;
+                        node = node->parent;
+                    }
+                    node = node != stop ? Direction::last(node) : NodePtr();
+                }
+            }
+        }
+};
+
+template<class Direction = Forward>
+    struct PostOrder
+{
+    template<class NodePtr, class Func>
+        static void traverse(NodePtr node, const Func& func)
+        {
+            if ( !node )
+                return;
+            NodePtr stop = node->parent;
+            node = deepest_first(node);
+            for ( ;; )
+            {
+                func(node->key, node->value);
+                NodePtr parent = node->parent;
+                if ( parent == stop )
+                    break;
+                if ( Direction::first(parent) == node && Direction::last(parent) )
+                    node = deepest_first(Direction::last(parent));
+                else
+                    node = parent;
+            }
+        }
+
+private:
+    /**
+     * \brief First node of the post-order traversal of the subtree of \p node
+     */
+    template<class NodePtr>
+        static NodePtr deepest_first(NodePtr node)
+        {
+            for ( ;; )
+            {
+                if ( Direction::first(node) )
+                    node = Direction::first(node);
+                else if ( Direction::last(node) )
+                    node = Direction::last(node);
+                else
+                    return node;
+            }
+        }
+};
+
+
+} // namespace traversal
+
+#endif // TRAVERSAL_HPP
@@ -1,7 +1,16 @@
 #ifndef TRIE_HPP
 #define TRIE_HPP
 
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <queue>
+#include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "stats.hpp"
 
 struct TrieNode {
     explicit TrieNode(TrieNode* parent = nullptr) : parent(parent) {}
@@ -34,6 +43,8 @@ struct TrieNode {
     TrieNode* deep_copy() const {
         TrieNode* node = new TrieNode(nullptr);
         node->marks_end = marks_end;
+        node->weight = weight;
+        node->max_weight = max_weight;
 
         for (const auto& pair : children) {
             TrieNode* new_node = pair.second->deep_copy();
@@ -46,32 +57,69 @@ struct TrieNode {
 
     TrieNode* parent = nullptr;
     bool marks_end = false;
+    /// Weight of the word ending here
+    std::uint64_t weight = 0;
+    /// Upper bound of the weights of the words in the sub-tree
+    std::uint64_t max_weight = 0;
     std::unordered_map<char,TrieNode*> children;
 };
 
 
-class Trie {
+/**
+ * \brief Statistics of a BasicTrie, collected when its CollectStats parameter is true
+ *
+ * They describe the current nodes, so unlike those of the other containers
+ * they move along with them.
+ */
+struct TrieStats {
+    /// Number of nodes, including the root
+    std::uint64_t nodes = 0;
+    /// Bytes taken by the nodes and the hash maps of their children,
+    /// without the overhead of the allocator
+    std::uint64_t bytes = 0;
+};
+
+/**
+ * \brief Set of words, stored as a tree with a node per character
+ *
+ * If \p CollectStats is true, stats() gives the TrieStats of the nodes.
+ * Trie is the version without statistics.
+ */
+template<bool CollectStats = false>
+class BasicTrie : public StatsRecorder<TrieStats, CollectStats> {
 public:
-    Trie() : root(new TrieNode) {}
+    /// Word and its weight
+    typedef std::pair<std::string, std::uint64_t> completion_type;
 
-    Trie(const Trie& other) : root(other.root->deep_copy()) {}
+    BasicTrie() : root(new TrieNode) {
+        record_added(root);
+    }
 
-    Trie(Trie&& other) : root(other.root) { other.root = nullptr; }
+    BasicTrie(const BasicTrie& other) : StatsRecorder<TrieStats, CollectStats>(), root(other.root->deep_copy()) {
+        record_added(root);
+    }
 
-    Trie& operator= (const Trie& other) {
+    BasicTrie(BasicTrie&& other) : root(other.root) {
+        other.root = nullptr;
+        this->swap_stats(other);
+    }
+
+    BasicTrie& operator= (const BasicTrie& other) {
         recursive_delete(root);
         root = other.root->deep_copy();
+        record_added(root);
         return *this;
     }
 
-    Trie& operator= (Trie&& other) {
+    BasicTrie& operator= (BasicTrie&& other) {
         recursive_delete(root);
         root = other.root;
         other.root = nullptr;
+        this->swap_stats(other);
         return *this;
     }
 
-    ~Trie() {
+    ~BasicTrie() {
         recursive_delete(root);
     }
 
@@ -82,10 +130,28 @@ public:
     void insert(const std::string& word) {
         TrieNode* node = root;
         for ( auto c : word )
-            node = node->get_or_create(c);
+            node = get_or_create(node, c);
         node->marks_end = true;
     }
 
+    /**
+     * \brief Add a new word to the trie or change its weight
+     *
+     * The nodes on its path remember the largest weight below them,
+     * which top_completions() uses to skip the lighter sub-trees.
+     * \complexity O(word.size)
+     */
+    void insert(const std::string& word, std::uint64_t weight) {
+        TrieNode* node = root;
+        node->max_weight = std::max(node->max_weight, weight);
+        for ( auto c : word ) {
+            node = get_or_create(node, c);
+            node->max_weight = std::max(node->max_weight, weight);
+        }
+        node->marks_end = true;
+        node->weight = weight;
+    }
+
     /**
      * \brief Remove a word from the trie
      * \complexity O(word.size)
@@ -98,6 +164,7 @@ public:
                 return;
         }
         node->marks_end = false;
+        node->weight = 0;
         remove_dangling(node);
     }
 
@@ -106,13 +173,8 @@ public:
      * \complexity O(word.size)
      */
     bool contains(const std::string& word) const {
-        TrieNode* node = root;
-        for ( auto c : word ) {
-            node = node->get(c);
-            if (!node)
-                return false;
-        }
-        return node->marks_end;
+        const TrieNode* node = find_node(word);
+        return node && node->marks_end;
     }
 
     /**
@@ -120,13 +182,135 @@ public:
      * \complexity O(word.size)
      */
     bool contains_prefix(const std::string& word) const {
-        TrieNode* node = root;
-        for ( auto c : word ) {
-            node = node->get(c);
+        return find_node(word);
+    }
+
+    /**
+     * \brief Checks all the words in [first, last), writing whether each of
+     * them exists to \p out
+     *
+     * Words are looked up batch_size at a time, one character of each per
+     * round, prefetching the nodes reached, so the cache misses of the
+     * words of a batch overlap instead of happening one after the other.
+     * \pre The iterators are forward iterators to std::string
+     * \return The output iterator past the last written value
+     * \complexity O(total size of the words)
+     */
+    template<class WordIterator, class OutputIterator>
+        OutputIterator contains_many(WordIterator first, WordIterator last, OutputIterator out) const {
+            const std::string* words[batch_size];
+            const TrieNode* nodes[batch_size];
+            while (first != last) {
+                std::size_t count = 0;
+                for (; first != last && count < batch_size; ++first, ++count) {
+                    words[count] = &*first;
+                    nodes[count] = root;
+                }
+
+                for (std::size_t depth = 0, active = count; active; depth++) {
+                    active = 0;
+                    for (std::size_t i = 0; i < count; i++) {
+                        if (!nodes[i] || depth >= words[i]->size())
+                            continue;
+                        nodes[i] = nodes[i]->get((*words[i])[depth]);
+                        if (nodes[i] && depth + 1 < words[i]->size()) {
+                            prefetch(nodes[i]);
+                            active++;
+                        }
+                    }
+                }
+
+                for (std::size_t i = 0; i < count; i++)
+                    *out++ = nodes[i] && nodes[i]->marks_end;
+            }
+            return out;
+        }
+
+    /**
+     * \brief Weight of a word, 0 if it doesn't exist or has none
+     * \complexity O(word.size)
+     */
+    std::uint64_t weight(const std::string& word) const {
+        const TrieNode* node = find_node(word);
+        return node && node->marks_end ? node->weight : 0;
+    }
+
+    /**
+     * \brief Calls \p func on every word starting with \p prefix
+     *
+     * The words are passed in a single buffer which is extended and
+     * shrunk along the walk, so no string is copied.
+     * \param func Called with a const std::string& which is only valid
+     *        during the call
+     * \complexity O(size of the sub-tree of \p prefix)
+     */
+    template<class Func>
+        void for_each_completion(const std::string& prefix, const Func& func) const {
+            const TrieNode* node = find_node(prefix);
             if (!node)
-                return false;
+                return;
+            std::string word = prefix;
+            const std::string& visited = word;
+            if (node->marks_end)
+                func(visited);
+
+            typedef std::unordered_map<char,TrieNode*>::const_iterator child_iterator;
+            std::vector<std::pair<const TrieNode*, child_iterator>> path;
+            path.emplace_back(node, node->children.begin());
+            while (!path.empty()) {
+                auto& top = path.back();
+                if (top.second == top.first->children.end()) {
+                    path.pop_back();
+                    if (!path.empty())
+                        word.pop_back();
+                    continue;
+                }
+                const TrieNode* child = top.second->second;
+                word.push_back(top.second->first);
+                ++top.second;
+                if (child->marks_end)
+                    func(visited);
+                path.emplace_back(child, child->children.begin());
+            }
         }
-        return true;
+
+    /**
+     * \brief The \p count heaviest words starting with \p prefix, heaviest first
+     *
+     * Best-first search: sub-trees are expanded in the order of the largest
+     * weight below them, so only the branches which can still hold one of
+     * the results are visited, and each word is spelled out only once
+     * it's known to be one of them.
+     * \complexity O(r * a * log(r * a)) where r is the number of nodes expanded
+     *             and a their number of children
+     */
+    std::vector<completion_type> top_completions(const std::string& prefix, std::size_t count) const {
+        std::vector<completion_type> result;
+        const TrieNode* node = find_node(prefix);
+        if (!node || !count)
+            return result;
+
+        // Nodes reached so far, each linked to the one it was reached from
+        std::vector<Step> steps;
+        std::priority_queue<Candidate> candidates;
+        steps.push_back(Step{node, 0, 0});
+        candidates.push(Candidate{node->max_weight, false, 0});
+        while (!candidates.empty() && result.size() < count) {
+            Candidate candidate = candidates.top();
+            candidates.pop();
+            const TrieNode* reached = steps[candidate.step].node;
+            if (candidate.is_word) {
+                result.emplace_back(spell(prefix, steps, candidate.step), reached->weight);
+                continue;
+            }
+            if (reached->marks_end)
+                candidates.push(Candidate{reached->weight, true, candidate.step});
+            for (const auto& pair : reached->children) {
+                candidates.push(Candidate{pair.second->max_weight, false, steps.size()});
+                steps.push_back(Step{pair.second, candidate.step, pair.first});
+            }
+        }
+        return result;
     }
 
     /**
@@ -138,6 +322,112 @@ public:
     }
 
 private:
+    /**
+     * \brief Node reached during top_completions()
+     */
+    struct Step {
+        const TrieNode* node;
+        std::size_t from;
+        char label;
+    };
+
+    /**
+     * \brief Word or sub-tree queued by top_completions(), the words come
+     * first among those of the same weight
+     */
+    struct Candidate {
+        bool operator<(const Candidate& other) const {
+            return weight < other.weight || (weight == other.weight && is_word < other.is_word);
+        }
+
+        std::uint64_t weight;
+        bool is_word;
+        std::size_t step;
+    };
+
+    /**
+     * \brief Node of a word or prefix, null if there is none
+     * \complexity O(word.size)
+     */
+    const TrieNode* find_node(const std::string& word) const {
+        const TrieNode* node = root;
+        for ( auto c : word ) {
+            node = node->get(c);
+            if (!node)
+                return nullptr;
+        }
+        return node;
+    }
+
+    /**
+     * \brief Word of the node reached by \p step
+     * \complexity O(word.size)
+     */
+    static std::string spell(const std::string& prefix, const std::vector<Step>& steps, std::size_t step) {
+        std::string word;
+        for (; step; step = steps[step].from)
+            word.push_back(steps[step].label);
+        return prefix + std::string(word.rbegin(), word.rend());
+    }
+
+    static void prefetch(const void* address) {
+#ifdef __GNUC__
+        __builtin_prefetch(address);
+#else
+        (void)address;
+#endif
+    }
+
+    static const std::size_t batch_size = 16;
+
+    /**
+     * \brief Gets the child of \p node corresponding to the given character,
+     * creating it when needed
+     * \complexity Best: O(1) Worst: O(number of children)
+     */
+    TrieNode* get_or_create(TrieNode* node, char c) {
+        if (!CollectStats)
+            return node->get_or_create(c);
+
+        std::size_t parent_bytes = footprint(node);
+        TrieNode* child = node->get_or_create(c);
+        std::size_t grown_bytes = footprint(node);
+        if (grown_bytes != parent_bytes) {
+            this->record_stats([&](TrieStats& stats) {
+                stats.nodes++;
+                stats.bytes += grown_bytes - parent_bytes + footprint(child);
+            });
+        }
+        return child;
+    }
+
+    /**
+     * \brief Bytes taken by \p node and the hash map of its children
+     */
+    static std::size_t footprint(const TrieNode* node) {
+        // The hash map allocates its buckets and a node holding each child
+        return sizeof(TrieNode) + node->children.bucket_count() * sizeof(void*) +
+            node->children.size() * (sizeof(void*) + sizeof(std::pair<const char, TrieNode*>));
+    }
+
+    /**
+     * \brief Records the nodes of a sub-tree which has just been created
+     * \complexity O(n) with statistics, nothing without
+     */
+    void record_added(const TrieNode* node) {
+        this->record_stats([node](TrieStats& stats) {
+            std::vector<const TrieNode*> pending(1, node);
+            while (!pending.empty()) {
+                const TrieNode* added = pending.back();
+                pending.pop_back();
+                stats.nodes++;
+                stats.bytes += footprint(added);
+                for (const auto& child : added->children)
+                    pending.push_back(child.second);
+            }
+        });
+    }
+
     /**
      * \brief Recursively removes a sub-tree
      * \complexity O(n)
@@ -147,19 +437,39 @@ private:
             return;
         for(const auto& child : node->children)
             recursive_delete(child.second);
+        this->record_stats([node](TrieStats& stats) {
+            stats.nodes--;
+            stats.bytes -= footprint(node);
+        });
         delete node;
     }
 
     /**
-     * \brief Removes branches which don't lead to any word
-     * \complexity O(h)
+     * \brief Removes the branch ending in \p node if it doesn't lead to any word
+     *
+     * The branch goes up to the first ancestor which ends a word or has
+     * other children, which keeps the node and forgets the branch.
+     * \complexity O(h + alphabet)
      */
     void remove_dangling(TrieNode* node) {
-        while(node && node->parent != root &&
-                !node->marks_end && node->children.size() <= 1)
+        if (node == root || node->marks_end || !node->children.empty())
+            return;
+        while (node->parent != root && !node->parent->marks_end && node->parent->children.size() == 1)
             node = node->parent;
-        if (node != root )
-            recursive_delete(node);
+
+        TrieNode* parent = node->parent;
+        std::size_t parent_bytes = footprint(parent);
+        for (auto it = parent->children.begin(); it != parent->children.end(); ++it) {
+            if (it->second == node) {
+                parent->children.erase(it);
+                break;
+            }
+        }
+        std::size_t shrunk_bytes = footprint(parent);
+        this->record_stats([=](TrieStats& stats) {
+            stats.bytes -= parent_bytes - shrunk_bytes;
+        });
+        recursive_delete(node);
     }
 
     /**
@@ -176,6 +486,10 @@ private:
     }
 
     TrieNode* root;
+
+    friend class TrieView;
 };
 
+typedef BasicTrie<> Trie;
+
 #endif // TRIE_HPP
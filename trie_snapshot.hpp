@@ -0,0 +1,370 @@
+#ifndef TRIE_SNAPSHOT_HPP
+#define TRIE_SNAPSHOT_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#   define TRIE_SNAPSHOT_MMAP
+#endif
+
+#include "trie.hpp"
+
+/**
+ * \brief Read-only set of words over a snapshot written by write_snapshot()
+ *
+ * A snapshot is a Trie frozen into its minimal automaton (a DAWG): the
+ * sub-trees holding the same suffixes are stored once, so a dictionary
+ * takes a fraction of the trie nodes. Each state is a run of edges sorted
+ * by label, an edge being a label byte in one array and, in another, the
+ * first edge of its target with two flags: whether the target ends a word
+ * and whether the edge is the last of its run.
+ *
+ * The view looks words up directly in that memory, so a mapped file is
+ * usable without deserializing anything and its pages can be shared by
+ * all the processes mapping it. The file uses the native byte order.
+ */
+class TrieView {
+public:
+    /**
+     * \brief Uses the snapshot at \p data, which must outlive the view
+     * \return Whether \p data holds a valid snapshot, if not the view is left empty
+     * \complexity O(1)
+     */
+    bool assign(const void* data, std::size_t size) {
+        reset();
+        const char* bytes = static_cast<const char*>(data);
+        Header header;
+        if (size < sizeof(header))
+            return false;
+        std::memcpy(&header, bytes, sizeof(header));
+        if (!header.valid(size) ||
+                reinterpret_cast<std::uintptr_t>(bytes + header.targets_offset) % alignof(std::uint32_t))
+            return false;
+
+        targets_ = reinterpret_cast<const std::uint32_t*>(bytes + header.targets_offset);
+        labels_ = reinterpret_cast<const unsigned char*>(bytes + header.labels_offset);
+        edge_count_ = header.edge_count;
+        root_ = header.root;
+        root_final_ = header.root_final;
+        size_ = header.word_count;
+        return true;
+    }
+
+    /**
+     * \brief Maps the snapshot file at \p path read-only
+     * \return Whether the file has been mapped and holds a valid snapshot
+     * \note Only supported on POSIX systems, elsewhere it always fails
+     * \complexity O(1), pages are loaded by the lookups touching them
+     */
+    bool map(const std::string& path) {
+        reset();
+#ifdef TRIE_SNAPSHOT_MMAP
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0)
+            return false;
+        struct stat status;
+        void* address = MAP_FAILED;
+        if (::fstat(file, &status) == 0 && status.st_size > 0)
+            address = ::mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, file, 0);
+        ::close(file);
+        if (address == MAP_FAILED)
+            return false;
+
+        std::size_t size = status.st_size;
+        std::shared_ptr<const void> mapping(address, [size](const void* address) {
+            ::munmap(const_cast<void*>(address), size);
+        });
+        if (!assign(address, size))
+            return false;
+        mapping_ = mapping;
+        return true;
+#else
+        (void)path;
+        return false;
+#endif
+    }
+
+    /**
+     * \brief Detaches the view from its snapshot, unmapping it if it was
+     * the last view on a mapped file
+     */
+    void reset() {
+        mapping_.reset();
+        targets_ = nullptr;
+        labels_ = nullptr;
+        edge_count_ = 0;
+        root_ = 0;
+        root_final_ = false;
+        size_ = 0;
+    }
+
+    /**
+     * \brief Check if a word exists
+     * \complexity O(word.size * alphabet)
+     */
+    bool contains(const std::string& word) const {
+        std::uint32_t state = root_;
+        bool final = root_final_;
+        for (char c : word) {
+            std::uint32_t edge = find_edge(state, c);
+            if (!edge)
+                return false;
+            final = targets_[edge] & final_bit;
+            state = targets_[edge] & target_mask;
+        }
+        return final;
+    }
+
+    /**
+     * \brief Check if a prefix exists
+     * \note As for Trie, the empty prefix always exists
+     * \complexity O(prefix.size * alphabet)
+     */
+    bool contains_prefix(const std::string& prefix) const {
+        std::uint32_t state = root_;
+        for (char c : prefix) {
+            std::uint32_t edge = find_edge(state, c);
+            if (!edge)
+                return false;
+            state = targets_[edge] & target_mask;
+        }
+        return true;
+    }
+
+    /**
+     * \brief Number of words
+     * \complexity O(1)
+     */
+    std::size_t size() const {
+        return size_;
+    }
+
+    /**
+     * \brief Whether the view has no words (or no snapshot)
+     * \complexity O(1)
+     */
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    /**
+     * \brief Number of edges of the automaton
+     * \complexity O(1)
+     */
+    std::size_t edge_count() const {
+        return edge_count_ ? edge_count_ - 1 : 0;
+    }
+
+    /**
+     * \brief Writes \p trie as a snapshot
+     * \return Whether the stream is still good afterwards, false without
+     *         writing anything if the automaton has too many edges
+     * \complexity O(n log alphabet) expected
+     */
+    template<bool CollectStats>
+        static bool write(const BasicTrie<CollectStats>& trie, std::ostream& out) {
+            Automaton automaton(trie.root);
+            if (automaton.edge_count() > max_edges)
+                return false;
+
+            Header header = Header::make(automaton);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(std::vector<char>(header.targets_offset - sizeof(header), 0).data(),
+                      header.targets_offset - sizeof(header));
+            out.write(reinterpret_cast<const char*>(automaton.targets.data()),
+                      automaton.targets.size() * sizeof(automaton.targets[0]));
+            out.write(reinterpret_cast<const char*>(automaton.labels.data()), automaton.labels.size());
+            return bool(out);
+        }
+
+private:
+    /**
+     * \brief Minimal automaton of a trie, laid out as in the snapshot
+     *
+     * The trie is walked in post-order and each node is looked up in a
+     * register of the states built so far by its finality and its edges,
+     * finding the node it's equivalent with, if any, once all its children
+     * have been replaced by their own representatives.
+     */
+    struct Automaton {
+        explicit Automaton(const TrieNode* root) : targets(1, std::uint32_t(last_bit)), labels(1, 0) {
+            // A moved-from trie has no root
+            if (!root)
+                return;
+            State state = add(root);
+            root_edges = state.first_edge;
+            root_final = state.final;
+        }
+
+        struct State {
+            std::uint32_t first_edge;
+            bool final;
+            bool dead;
+        };
+
+        /**
+         * \brief Builds the state of the sub-tree rooted in \p node
+         * \return Its state, dead if it holds no word
+         */
+        State add(const TrieNode* node) {
+            std::vector<std::pair<unsigned char, State>> edges;
+            edges.reserve(node->children.size());
+            for (const auto& pair : node->children) {
+                State child = add(pair.second);
+                if (!child.dead)
+                    edges.emplace_back(pair.first, child);
+            }
+            word_count += node->marks_end;
+            if (edges.empty())
+                return State{0, node->marks_end, !node->marks_end};
+            std::sort(edges.begin(), edges.end(),
+                      [](const std::pair<unsigned char, State>& a, const std::pair<unsigned char, State>& b) {
+                return a.first < b.first;
+            });
+
+            std::string signature(1, node->marks_end);
+            for (const auto& edge : edges) {
+                std::uint32_t target = encode(edge.second);
+                signature += char(edge.first);
+                signature.append(reinterpret_cast<const char*>(&target), sizeof(target));
+            }
+            auto found = states.find(signature);
+            if (found != states.end())
+                return State{found->second, node->marks_end, false};
+
+            std::uint32_t first_edge = targets.size();
+            for (const auto& edge : edges) {
+                labels.push_back(edge.first);
+                targets.push_back(encode(edge.second));
+            }
+            targets.back() |= last_bit;
+            states.emplace(std::move(signature), first_edge);
+            return State{first_edge, node->marks_end, false};
+        }
+
+        static std::uint32_t encode(const State& state) {
+            return state.first_edge | (state.final ? std::uint32_t(final_bit) : 0);
+        }
+
+        std::size_t edge_count() const {
+            return targets.size();
+        }
+
+        /// Edge 0 is a sentinel, the states without edges start there
+        std::vector<std::uint32_t> targets;
+        std::vector<unsigned char> labels;
+        std::unordered_map<std::string, std::uint32_t> states;
+        std::uint32_t root_edges = 0;
+        bool root_final = false;
+        std::uint64_t word_count = 0;
+    };
+
+    /**
+     * \brief Start of the snapshot, followed at targets_offset by the
+     * targets of the edges and by their labels
+     */
+    struct Header {
+        static Header make(const Automaton& automaton) {
+            Header header;
+            std::memcpy(header.magic, expected_magic, sizeof(header.magic));
+            header.word_count = automaton.word_count;
+            header.edge_count = automaton.edge_count();
+            header.root = automaton.root_edges;
+            header.root_final = automaton.root_final;
+            header.targets_offset = (sizeof(Header) + edge_alignment - 1) / edge_alignment * edge_alignment;
+            header.labels_offset = header.targets_offset + header.edge_count * sizeof(std::uint32_t);
+            return header;
+        }
+
+        /**
+         * \brief Whether the header describes a snapshot of \p file_size bytes
+         */
+        bool valid(std::size_t file_size) const {
+            return std::memcmp(magic, expected_magic, sizeof(magic)) == 0 &&
+                edge_count >= 1 && edge_count <= max_edges &&
+                root < edge_count && root_final <= 1 &&
+                targets_offset >= sizeof(Header) && targets_offset <= file_size &&
+                edge_count <= (file_size - targets_offset) / sizeof(std::uint32_t) &&
+                labels_offset >= targets_offset + edge_count * sizeof(std::uint32_t) &&
+                labels_offset <= file_size && edge_count <= file_size - labels_offset;
+        }
+
+        char magic[8];
+        std::uint64_t word_count;
+        std::uint64_t edge_count;
+        std::uint32_t root;
+        std::uint32_t root_final;
+        std::uint64_t targets_offset;
+        std::uint64_t labels_offset;
+    };
+
+    /**
+     * \brief Edge of \p state labelled \p c
+     * \return Its index, 0 if there is none
+     * \complexity O(alphabet)
+     */
+    std::uint32_t find_edge(std::uint32_t state, char c) const {
+        unsigned char label = c;
+        // Targets are checked so a corrupted file can't send a lookup out of the edges
+        if (!state || state >= edge_count_)
+            return 0;
+        for (std::uint32_t edge = state; edge < edge_count_; edge++) {
+            if (labels_[edge] == label)
+                return edge;
+            if (labels_[edge] > label || targets_[edge] & last_bit)
+                break;
+        }
+        return 0;
+    }
+
+    static const std::uint32_t last_bit = 1u << 31;
+    static const std::uint32_t final_bit = 1u << 30;
+    static const std::uint32_t target_mask = final_bit - 1;
+    static const std::uint64_t max_edges = target_mask;
+    /// Starts the edges on their own cache line
+    static const std::size_t edge_alignment = 64;
+    static constexpr const char* expected_magic = "TRIESNP1";
+
+    std::shared_ptr<const void> mapping_;
+    const std::uint32_t* targets_ = nullptr;
+    const unsigned char* labels_ = nullptr;
+    std::size_t edge_count_ = 0;
+    std::uint32_t root_ = 0;
+    bool root_final_ = false;
+    std::size_t size_ = 0;
+};
+
+/**
+ * \brief Freezes \p trie into a snapshot, to be read back with TrieView
+ * \return Whether the snapshot has been written and the stream is still good
+ * \complexity O(n log alphabet) expected
+ */
+template<bool CollectStats>
+    bool write_snapshot(const BasicTrie<CollectStats>& trie, std::ostream& out) {
+        return TrieView::write(trie, out);
+    }
+
+/**
+ * \brief Freezes \p trie into a snapshot file at \p path
+ * \return Whether the file has been written successfully
+ */
+template<bool CollectStats>
+    bool write_snapshot(const BasicTrie<CollectStats>& trie, const std::string& path) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        return write_snapshot(trie, out) && out.flush();
+    }
+
+#endif // TRIE_SNAPSHOT_HPP